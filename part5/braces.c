@@ -0,0 +1,765 @@
+/*
+ *    Programmed By: Mohammed Isam [mohammed_isam1984@yahoo.com]
+ *    Copyright 2020 (c)
+ *
+ *    file: braces.c
+ *    This file is part of the "Let's Build a Linux Shell" tutorial.
+ *
+ *    This tutorial is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This tutorial is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this tutorial.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <limits.h>
+#include "shell.h"
+
+
+/*
+ * brace expansion turns a word such as a{b,c}d into abd acd, and {1..3} into
+ * 1 2 3.. we parse the word into a sequence of parts (literal text, lists of
+ * alternatives, which are sequences themselves, and ranges), from which we
+ * can tell how many strings we'll get and how long they are, before we make
+ * any of them.. the strings are then written, one after the other, into one
+ * buffer that we alloc only once.
+ */
+enum brace_type_e
+{
+    BRACE_TEXT,
+    BRACE_LIST,
+    BRACE_RANGE,
+};
+
+struct brace_seq_s;
+
+struct brace_part_s
+{
+    enum   brace_type_e type;
+    char  *text;                        /* text (in the original word).. */
+    size_t len;                         /* ..and its length */
+    struct brace_seq_s *alts;           /* alternatives of a list */
+    size_t nalts;
+    long   start, end, step;            /* range, step is negative if going down */
+    int    width;                       /* zero-pad numbers to this width */
+    int    chars;                       /* range of chars instead of numbers? */
+    size_t count;                       /* number of strings this part gives.. */
+    size_t bytes;                       /* ..their total length.. */
+    size_t maxlen;                      /* ..and the longest of them */
+};
+
+struct brace_seq_s
+{
+    struct brace_part_s *parts;
+    size_t nparts;
+    size_t count, bytes, maxlen;        /* same as the above, for the sequence */
+};
+
+/* chars we escape when they come out of a range of chars */
+#define BRACE_SPECIAL_CHARS     "\\'\"`$*?[]~{},"
+
+
+void free_brace_seq(struct brace_seq_s *seq)
+{
+    size_t i, j;
+    for(i = 0; i < seq->nparts; i++)
+    {
+        struct brace_part_s *part = &seq->parts[i];
+        for(j = 0; j < part->nalts; j++)
+        {
+            free_brace_seq(&part->alts[j]);
+        }
+        free(part->alts);
+    }
+    free(seq->parts);
+}
+
+
+/*
+ * skip the quoted string, escaped char, or ${...}, $(...) or `...` at p, none
+ * of which can have brace expansion inside it.
+ *
+ * returns a pointer to the char after the thing we've skipped, or to the char
+ * after p if there is nothing to skip (or it doesn't end before end).
+ */
+char *brace_skip(char *p, char *end)
+{
+    size_t len = 0;
+    switch(*p)
+    {
+        case '\\':
+            len = p[1] ? 1 : 0;
+            break;
+
+        case '\'':
+        case '"':
+        case '`':
+            len = find_closing_quote(p);
+            break;
+
+        case '$':
+            if(p[1] == '{' || p[1] == '(')
+            {
+                len = find_closing_brace(p+1);
+                len += !!len;
+            }
+            break;
+    }
+    return (p+len < end) ? p+len+1 : p+1;
+}
+
+
+/*
+ * find the closing brace that matches the opening brace at p, and count the
+ * commas between them (not counting the ones in nested braces).
+ *
+ * returns a pointer to the closing brace, or NULL if there is none before end.
+ */
+char *brace_close(char *p, char *end, size_t *commas)
+{
+    int depth = 0;
+    *commas = 0;
+    while(p < end)
+    {
+        if(*p == '{')
+        {
+            depth++;
+        }
+        else if(*p == '}')
+        {
+            if(--depth == 0)
+            {
+                return p;
+            }
+        }
+        else if(*p == ',' && depth == 1)
+        {
+            (*commas)++;
+        }
+        p = brace_skip(p, end);
+    }
+    return NULL;
+}
+
+
+/*
+ * get a range endpoint, which is an integer or a single char, from str.
+ *
+ * returns a pointer to the char after it, or NULL if there is no endpoint.
+ */
+char *brace_endpoint(char *str, char *end, long *val, int *is_char, int *zero_pad)
+{
+    char *p = str, *q;
+    if(*p == '-' || *p == '+')
+    {
+        p++;
+    }
+
+    if(isdigit(*p))
+    {
+        errno = 0;
+        *val = strtol(str, &q, 10);
+        if(errno || q > end)
+        {
+            return NULL;
+        }
+        *is_char  = 0;
+        *zero_pad = (p[0] == '0' && isdigit(p[1]));
+        return q;
+    }
+
+    if(str+1 <= end && (str+1 == end || str[1] == '.') && !isdigit(*str))
+    {
+        *val = (unsigned char)*str;
+        *is_char = 1;
+        *zero_pad = 0;
+        return str+1;
+    }
+    return NULL;
+}
+
+
+/*
+ * the number of chars needed to write val (without zero padding).
+ */
+static inline int num_width(long val)
+{
+    int width = (val < 0) ? 2 : 1;
+    unsigned long n = (val < 0) ? -(unsigned long)val : (unsigned long)val;
+    while(n >= 10)
+    {
+        n /= 10;
+        width++;
+    }
+    return width;
+}
+
+
+/*
+ * the number of chars we'll write for the given value of the range.
+ */
+static inline int range_width(struct brace_part_s *part, long val)
+{
+    if(part->chars)
+    {
+        return strchr(BRACE_SPECIAL_CHARS, (int)val) ? 2 : 1;
+    }
+    int width = num_width(val);
+    return (width < part->width) ? part->width : width;
+}
+
+
+/*
+ * write the given value of the range to buf.
+ *
+ * returns the number of chars written.
+ */
+size_t range_format(struct brace_part_s *part, long val, char *buf)
+{
+    if(part->chars)
+    {
+        size_t len = 0;
+        if(strchr(BRACE_SPECIAL_CHARS, (int)val))
+        {
+            buf[len++] = '\\';
+        }
+        buf[len++] = (char)val;
+        return len;
+    }
+
+    /* write the digits backwards, then the zeros and the sign */
+    char digits[32], *d = digits+sizeof(digits);
+    unsigned long n = (val < 0) ? -(unsigned long)val : (unsigned long)val;
+    do
+    {
+        *--d = '0' + n%10;
+        n /= 10;
+    } while(n);
+
+    size_t ndigits = digits+sizeof(digits)-d;
+    size_t width   = range_width(part, val), len = 0;
+    if(val < 0)
+    {
+        buf[len++] = '-';
+    }
+    while(len+ndigits < width)
+    {
+        buf[len++] = '0';
+    }
+    memcpy(buf+len, d, ndigits);
+    return len+ndigits;
+}
+
+
+/*
+ * add to a, without letting the sum overflow.
+ *
+ * returns 1 on success, 0 on overflow.
+ */
+static inline int size_add(size_t *a, size_t b)
+{
+    if(*a+b < *a)
+    {
+        return 0;
+    }
+    *a += b;
+    return 1;
+}
+
+
+/*
+ * multiply a by b, without letting the product overflow.
+ *
+ * returns 1 on success, 0 on overflow.
+ */
+static inline int size_mul(size_t *a, size_t b)
+{
+    if(b && *a > SIZE_MAX/b)
+    {
+        return 0;
+    }
+    *a *= b;
+    return 1;
+}
+
+
+/*
+ * get the value that is n steps after val.. the distance can be too big for a
+ * long (in the range LONG_MIN..LONG_MAX), even though the result is not.
+ */
+static inline long range_advance(long val, long step, size_t n)
+{
+    unsigned long dist = (step < 0) ? -(unsigned long)step : (unsigned long)step;
+    dist *= n;
+    return (step < 0) ? (long)((unsigned long)val - dist) : (long)((unsigned long)val + dist);
+}
+
+
+/*
+ * find the total length of the values of a range, without going through all
+ * of them: we go from one power of 10 to the next (the values in between all
+ * have the same width), and count the values on the way.
+ *
+ * returns 1 on success, 0 if the length doesn't fit in a size_t.
+ */
+int range_bytes(struct brace_part_s *part, size_t *bytes)
+{
+    size_t left = part->count;
+    long   val  = part->start;
+    unsigned long step = (part->step < 0) ? -(unsigned long)part->step : (unsigned long)part->step;
+
+    *bytes = 0;
+    while(left)
+    {
+        size_t width = range_width(part, val), n;
+        if(part->chars)
+        {
+            n = 1;
+        }
+        else
+        {
+            /* find the first value (in the range's direction) that is wider or narrower */
+            int up = (part->step > 0);
+            unsigned long mag = (val < 0) ? -(unsigned long)val : (unsigned long)val;
+            unsigned long pow = 1;
+            while(pow <= mag/10)
+            {
+                pow *= 10;
+            }
+
+            /* how far is that value from val? */
+            unsigned long dist;
+            if((val >= 0) == up)
+            {
+                /* moving away from 0, values get wider at the next power of 10 */
+                dist = (pow > ULONG_MAX/10) ? ULONG_MAX : pow*10-mag;
+            }
+            else if(mag >= 10)
+            {
+                /* moving towards 0, values get narrower below the current power of 10 */
+                dist = mag-pow+1;
+            }
+            else
+            {
+                /* single digits change width when they change sign */
+                dist = mag + (val >= 0);
+            }
+            n = (dist-1)/step + 1;
+            if(n > left)
+            {
+                n = left;
+            }
+        }
+
+        size_t b = width;
+        if(!size_mul(&b, n) || !size_add(bytes, b))
+        {
+            return 0;
+        }
+
+        left -= n;
+        if(left)
+        {
+            val = range_advance(val, part->step, n);
+        }
+    }
+    return 1;
+}
+
+
+/*
+ * check if the text between the braces is a range {x..y} or {x..y..step},
+ * and fill the part if so.
+ *
+ * returns 1 if we have a range, 0 if not.
+ */
+int brace_range(char *p, char *end, struct brace_part_s *part)
+{
+    long start, stop, step = 1;
+    int  c1, c2, z1, z2, dummy;
+    char *q;
+
+    if(!(q = brace_endpoint(p, end, &start, &c1, &z1)) || end-q < 3 || q[0] != '.' || q[1] != '.')
+    {
+        return 0;
+    }
+    char *p2 = q+2, *end2;
+    if(!(q = end2 = brace_endpoint(p2, end, &stop, &c2, &z2)) || c1 != c2)
+    {
+        return 0;
+    }
+
+    if(q < end)
+    {
+        if(end-q < 3 || q[0] != '.' || q[1] != '.' ||
+           !(q = brace_endpoint(q+2, end, &step, &dummy, &z2)) || dummy || q != end)
+        {
+            return 0;
+        }
+        /* the step's sign doesn't matter, and a zero step is one */
+        step = labs(step) ? : 1;
+    }
+
+    part->type  = BRACE_RANGE;
+    part->start = start;
+    part->end   = stop;
+    part->step  = (start <= stop) ? step : -step;
+    part->chars = c1;
+    /* if any endpoint has leading zeros, all numbers are as wide as the widest endpoint */
+    part->width = (z1 || z2) ? ((p2-2-p > end2-p2) ? p2-2-p : end2-p2) : 0;
+
+    unsigned long span = (start <= stop) ? (unsigned long)stop-start : (unsigned long)start-stop;
+    part->count = span/step + 1;
+
+    /* the values at both ends are the widest */
+    long last = range_advance(start, part->step, part->count-1);
+    part->maxlen = range_width(part, start);
+    if((size_t)range_width(part, last) > part->maxlen)
+    {
+        part->maxlen = range_width(part, last);
+    }
+
+    /* a range too big to expand is taken literally (as bash does) */
+    return range_bytes(part, &part->bytes);
+}
+
+
+/*
+ * add a part to the sequence.
+ *
+ * returns 1 on success, 0 if insufficient memory.
+ */
+int brace_add_part(struct brace_seq_s *seq, struct brace_part_s *part)
+{
+    struct brace_part_s *parts = realloc(seq->parts, (seq->nparts+1)*sizeof(struct brace_part_s));
+    if(!parts)
+    {
+        return 0;
+    }
+    parts[seq->nparts++] = *part;
+    seq->parts = parts;
+    return 1;
+}
+
+
+/*
+ * find how many strings the sequence gives, their total length, and the
+ * length of the longest one.. each part gives all of its strings for each
+ * combination of the other parts' strings.
+ *
+ * returns 1 on success, 0 if the numbers don't fit in a size_t.
+ */
+int brace_seq_size(struct brace_seq_s *seq)
+{
+    size_t i, j;
+
+    for(i = 0; i < seq->nparts; i++)
+    {
+        struct brace_part_s *part = &seq->parts[i];
+        if(part->type != BRACE_LIST)
+        {
+            continue;
+        }
+        for(j = 0; j < part->nalts; j++)
+        {
+            struct brace_seq_s *alt = &part->alts[j];
+            if(!size_add(&part->count, alt->count) || !size_add(&part->bytes, alt->bytes))
+            {
+                return 0;
+            }
+            if(alt->maxlen > part->maxlen)
+            {
+                part->maxlen = alt->maxlen;
+            }
+        }
+    }
+
+    seq->count  = 1;
+    seq->bytes  = 0;
+    seq->maxlen = 0;
+    for(i = 0; i < seq->nparts; i++)
+    {
+        if(!size_mul(&seq->count, seq->parts[i].count) ||
+           !size_add(&seq->maxlen, seq->parts[i].maxlen))
+        {
+            return 0;
+        }
+    }
+
+    for(i = 0; i < seq->nparts; i++)
+    {
+        struct brace_part_s *part = &seq->parts[i];
+        size_t bytes = part->bytes;
+        if(!size_mul(&bytes, seq->count/part->count) || !size_add(&seq->bytes, bytes))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+/*
+ * parse the text between p and end into a sequence of literal text, lists and
+ * ranges.. a brace that doesn't start a list (with at least one comma) or a
+ * range is taken literally, but the text after it can still have lists or
+ * ranges.
+ *
+ * returns 1 on success, 0 on error.
+ */
+int brace_parse(char *p, char *end, struct brace_seq_s *seq)
+{
+    char *text = p, *close, *q, *alt;
+    struct brace_part_s group;
+    size_t commas, n;
+
+    while(p < end)
+    {
+        if(*p != '{' || !(close = brace_close(p, end, &commas)))
+        {
+            p = brace_skip(p, end);
+            continue;
+        }
+
+        group = (struct brace_part_s){ .type = BRACE_LIST };
+        if(commas)
+        {
+            if(!(group.alts = calloc(commas+1, sizeof(struct brace_seq_s))))
+            {
+                fprintf(stderr, "error: insufficient memory for brace expansion\n");
+                goto err;
+            }
+            group.nalts = commas+1;
+
+            /* split the list at the commas that are not in nested braces */
+            int depth = 0;
+            for(n = 0, q = alt = p+1; ; )
+            {
+                if(q == close || (*q == ',' && depth == 0))
+                {
+                    if(!brace_parse(alt, q, &group.alts[n++]))
+                    {
+                        goto err_group;
+                    }
+                    if(q == close)
+                    {
+                        break;
+                    }
+                    alt = ++q;
+                    continue;
+                }
+
+                if(*q == '{')
+                {
+                    depth++;
+                }
+                else if(*q == '}')
+                {
+                    depth--;
+                }
+                q = brace_skip(q, close);
+            }
+        }
+        else if(!brace_range(p+1, close, &group))
+        {
+            p++;
+            continue;
+        }
+
+        /* the text before the braces */
+        if(p > text)
+        {
+            struct brace_part_s part = { .type = BRACE_TEXT, .text = text, .len = p-text,
+                                         .count = 1, .bytes = p-text, .maxlen = p-text };
+            if(!brace_add_part(seq, &part))
+            {
+                fprintf(stderr, "error: insufficient memory for brace expansion\n");
+                goto err_group;
+            }
+        }
+
+        if(!brace_add_part(seq, &group))
+        {
+            fprintf(stderr, "error: insufficient memory for brace expansion\n");
+            goto err_group;
+        }
+        p = text = close+1;
+    }
+
+    /* the text after the last braces */
+    if(p > text)
+    {
+        struct brace_part_s part = { .type = BRACE_TEXT, .text = text, .len = p-text,
+                                     .count = 1, .bytes = p-text, .maxlen = p-text };
+        if(!brace_add_part(seq, &part))
+        {
+            fprintf(stderr, "error: insufficient memory for brace expansion\n");
+            goto err;
+        }
+    }
+
+    if(!brace_seq_size(seq))
+    {
+        fprintf(stderr, "error: brace expansion gives too many words\n");
+        return 0;
+    }
+    return 1;
+
+err_group:
+    for(n = 0; n < group.nalts; n++)
+    {
+        free_brace_seq(&group.alts[n]);
+    }
+    free(group.alts);
+
+err:
+    return 0;
+}
+
+
+/*
+ * the state of brace_gen(), with the string we're building in buf, and the
+ * buffer where we write the finished strings.
+ */
+struct brace_gen_s
+{
+    char  **vec;                        /* the strings we've made.. */
+    size_t  n;                          /* ..and their number */
+    char   *out;                        /* where the next string goes */
+    char   *buf;                        /* the string we're building.. */
+    size_t  len;                        /* ..and its length so far */
+};
+
+/* the rest of the sequences we're in the middle of, when we go into a list */
+struct brace_cont_s
+{
+    struct brace_seq_s  *seq;
+    size_t  i;                          /* the part after the list */
+    struct brace_cont_s *next;
+};
+
+
+/*
+ * make the strings of the sequence, starting at the i-th part, and followed by
+ * each of the strings of the rest of the enclosing sequences (in cont).
+ */
+void brace_gen(struct brace_gen_s *g, struct brace_seq_s *seq, size_t i, struct brace_cont_s *cont)
+{
+    size_t len = g->len, j;
+
+    for( ; i < seq->nparts && seq->parts[i].type == BRACE_TEXT; i++)
+    {
+        memcpy(g->buf+g->len, seq->parts[i].text, seq->parts[i].len);
+        g->len += seq->parts[i].len;
+    }
+
+    if(i == seq->nparts)
+    {
+        if(cont)
+        {
+            brace_gen(g, cont->seq, cont->i, cont->next);
+        }
+        else
+        {
+            /* we've got a whole string */
+            g->vec[g->n++] = g->out;
+            memcpy(g->out, g->buf, g->len);
+            g->out[g->len] = '\0';
+            g->out += g->len+1;
+        }
+        g->len = len;
+        return;
+    }
+
+    struct brace_part_s *part = &seq->parts[i];
+    if(part->type == BRACE_LIST)
+    {
+        struct brace_cont_s next = { seq, i+1, cont };
+        for(j = 0; j < part->nalts; j++)
+        {
+            brace_gen(g, &part->alts[j], 0, &next);
+        }
+    }
+    else
+    {
+        size_t len2 = g->len;
+        long   val  = part->start;
+        for(j = 0; ; )
+        {
+            g->len = len2 + range_format(part, val, g->buf+len2);
+            brace_gen(g, seq, i+1, cont);
+            if(++j == part->count)
+            {
+                break;
+            }
+            val += part->step;
+        }
+    }
+    g->len = len;
+}
+
+
+/*
+ * perform brace expansion on the word.
+ *
+ * returns the strings we get, in one malloc'd block that is freed by one call
+ * to free(), and sets *count to their number.. returns NULL if the word has
+ * no brace expansion (or on error, in which case the word is used as-is).
+ */
+char **brace_expand(char *word, size_t *count)
+{
+    if(!strchr(word, '{'))
+    {
+        return NULL;
+    }
+
+    struct brace_seq_s seq = { 0 };
+    char **vec = NULL;
+
+    if(!brace_parse(word, word+strlen(word), &seq) || !seq.nparts ||
+       (seq.nparts == 1 && seq.parts[0].type == BRACE_TEXT))
+    {
+        free_brace_seq(&seq);
+        return NULL;
+    }
+
+    /* the pointers to the strings come first, followed by the strings */
+    size_t size = seq.count, strs = seq.bytes;
+    char  *buf  = NULL;
+    if(!size_mul(&size, sizeof(char *)) || !size_add(&strs, seq.count) ||
+       !size_add(&size, strs))
+    {
+        fprintf(stderr, "error: brace expansion gives too many words\n");
+        goto end;
+    }
+
+    if(!(vec = malloc(size)) || !(buf = malloc(seq.maxlen+1)))
+    {
+        fprintf(stderr, "error: insufficient memory for brace expansion\n");
+        free(vec);
+        vec = NULL;
+        goto end;
+    }
+
+    struct brace_gen_s g = { .vec = vec, .out = (char *)(vec+seq.count), .buf = buf };
+    brace_gen(&g, &seq, 0, NULL);
+    *count = seq.count;
+
+end:
+    free(buf);
+    free_brace_seq(&seq);
+    return vec;
+}
@@ -0,0 +1,83 @@
+/*
+ *    Programmed By: Mohammed Isam [mohammed_isam1984@yahoo.com]
+ *    Copyright 2020 (c)
+ *
+ *    file: break.c
+ *    This file is part of the "Let's Build a Linux Shell" tutorial.
+ *
+ *    This tutorial is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This tutorial is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this tutorial.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include "../shell.h"
+
+
+/*
+ * the break and continue builtin utilities, which leave the enclosing loops..
+ * usage:
+ *
+ *     break [n]
+ *     continue [n]
+ *
+ * break leaves the n innermost loops, while continue leaves the n-1 innermost
+ * loops and goes on with the next iteration of the n-th one.. n defaults to 1,
+ * and if it is greater than the number of loops, the outermost loop is used..
+ * we only mark the jump here, and the executor stops the loops' lists (see
+ * do_list() and loop_done() in executor.c).
+ *
+ * returns 0 on success, 1 if n is out of range, 2 on usage error.
+ */
+int break_builtin(int argc, char **argv)
+{
+    long n = 1;
+
+    if(!loop_depth)
+    {
+        fprintf(stderr, "%s: only meaningful in a loop\n", argv[0]);
+        return 0;
+    }
+
+    if(argc > 2)
+    {
+        fprintf(stderr, "%s: too many arguments\n", argv[0]);
+        fprintf(stderr, "usage: %s [n]\n", argv[0]);
+        return 2;
+    }
+
+    if(argc == 2)
+    {
+        char *end;
+        errno = 0;
+        n = strtol(argv[1], &end, 10);
+        if(end == argv[1] || *end || errno)
+        {
+            fprintf(stderr, "%s: %s: numeric argument required\n", argv[0], argv[1]);
+            return 2;
+        }
+        if(n < 1 || n > INT_MAX)
+        {
+            fprintf(stderr, "%s: %s: loop count out of range\n", argv[0], argv[1]);
+            return 1;
+        }
+    }
+
+    loop_jump     = (n > loop_depth) ? loop_depth : n;
+    loop_continue = (strcmp(argv[0], "continue") == 0);
+    return 0;
+}
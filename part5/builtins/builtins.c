@@ -24,6 +24,20 @@
 struct builtin_s builtins[] =
 {
     { "dump"    , dump       },
+    { "declare" , declare    },
+    { "typeset" , declare    },
+    { "let"     , let        },
+    { "test"    , test       },
+    { "["       , test       },
+    { "echo"    , echo       },
+    { "printf"  , printf_builtin },
+    { "read"    , read_builtin   },
+    { "mapfile" , mapfile        },
+    { "readarray", mapfile       },
+    { "shift"   , shift      },
+    { "set"     , set        },
+    { "break"   , break_builtin  },
+    { "continue", break_builtin  },
 };
 
 int builtins_count = sizeof(builtins)/sizeof(struct builtin_s);
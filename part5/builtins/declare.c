@@ -0,0 +1,207 @@
+/*
+ *    Programmed By: Mohammed Isam [mohammed_isam1984@yahoo.com]
+ *    Copyright 2020 (c)
+ *
+ *    file: declare.c
+ *    This file is part of the "Let's Build a Linux Shell" tutorial.
+ *
+ *    This tutorial is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This tutorial is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this tutorial.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../shell.h"
+#include "../symtab/symtab.h"
+#include "../executor.h"
+
+
+/*
+ * print the given variable in a format that can be reused as input to the shell.
+ */
+void print_declared_var(struct symtab_entry_s *entry)
+{
+    if(entry->val_type == SYM_ARRAY || entry->val_type == SYM_ASSOC)
+    {
+        char *sep = "", *key, *val, buf[32];
+        size_t pos = 0, index;
+
+        printf("declare -%c%s %s=(", (entry->val_type == SYM_ARRAY) ? 'a' : 'A',
+               (entry->flags & FLAG_INTEGER) ? "i" : "", entry->name);
+        while((entry->val_type == SYM_ARRAY) ?
+                array_next(entry->array, &pos, &index, &val) :
+                assoc_next(entry->assoc, &pos, &key, &val))
+        {
+            if(entry->val_type == SYM_ARRAY)
+            {
+                sprintf(buf, "%zu", index);
+                key = buf;
+            }
+            char *qval = quote_val(val, 1);
+            printf("%s[%s]=%s", sep, key, qval ? qval : "\"\"");
+            free(qval);
+            sep = " ";
+        }
+        printf(")\n");
+        return;
+    }
+
+    char *val = symtab_entry_getval(entry);
+    char *qval = quote_val(val, 1);
+
+    printf("declare %s %s=%s\n", (entry->flags & FLAG_INTEGER) ? "-i" : "--",
+           entry->name, qval ? qval : "\"\"");
+
+    if(qval)
+    {
+        free(qval);
+    }
+}
+
+
+/*
+ * the declare (and typeset) builtin utility, which sets variable attributes
+ * and values.. usage:
+ *
+ *     declare [-a|-A] [-i|+i] [name[=value] ...]
+ *
+ * the -i option gives the variable the integer attribute, so that values
+ * assigned to it are evaluated as arithmetic expressions and stored as native
+ * integers.. +i removes the attribute.. -a makes the variable an indexed
+ * array, and -A an associative array.. with no names, the variables that
+ * have the given attributes (or all variables, if no options are given) are
+ * printed.. a name=(value ...) argument assigns the values to the array,
+ * after it gets the given attributes.
+ *
+ * returns 0 on success, non-zero on error.
+ */
+int declare(int argc, char **argv)
+{
+    int set_flags = 0, unset_flags = 0, type = 0;
+    int i = 1, res = 0;
+
+    /* parse the options */
+    for( ; i < argc; i++)
+    {
+        char *p = argv[i];
+        if((*p != '-' && *p != '+') || !p[1])
+        {
+            break;
+        }
+
+        /* -- marks the end of options */
+        if(strcmp(p, "--") == 0)
+        {
+            i++;
+            break;
+        }
+
+        int *flags = (*p == '-') ? &set_flags : &unset_flags;
+        while(*++p)
+        {
+            switch(*p)
+            {
+                case 'i':
+                    (*flags) |= FLAG_INTEGER;
+                    break;
+
+                case 'a':
+                case 'A':
+                    /* arrays can't be turned back into scalars */
+                    if(flags == &set_flags)
+                    {
+                        type = (*p == 'a') ? SYM_ARRAY : SYM_ASSOC;
+                        break;
+                    }
+                    /* fall through */
+
+                default:
+                    fprintf(stderr, "%s: invalid option: %c%c\n", argv[0], argv[i][0], *p);
+                    fprintf(stderr, "usage: %s [-a|-A] [-i|+i] [name[=value] ...]\n", argv[0]);
+                    return 2;
+            }
+        }
+    }
+
+    /* no names given. print the variables */
+    if(i >= argc)
+    {
+        struct symtab_stack_s *stack = get_symtab_stack();
+        int j;
+        for(j = 0; j < stack->symtab_count; j++)
+        {
+            struct symtab_entry_s *entry = stack->symtab_list[j]->first;
+            while(entry)
+            {
+                if((entry->flags & set_flags) == (unsigned int)set_flags &&
+                   (!type || entry->val_type == (enum symbol_type_e)type))
+                {
+                    print_declared_var(entry);
+                }
+                entry = entry->next;
+            }
+        }
+        return 0;
+    }
+
+    /* set the attributes and values of the given variables */
+    for( ; i < argc; i++)
+    {
+        size_t len = is_assignment(argv[i]);
+        if(!len)
+        {
+            len = strlen(argv[i]);
+        }
+
+        char name[len+1];
+        strncpy(name, argv[i], len);
+        name[len] = '\0';
+
+        if(!is_name(name))
+        {
+            fprintf(stderr, "%s: invalid variable name: %s\n", argv[0], name);
+            res = 1;
+            continue;
+        }
+
+        struct symtab_entry_s *entry = add_to_symtab(name);
+        if(!entry)
+        {
+            res = 1;
+            continue;
+        }
+
+        entry->flags |=  set_flags;
+        entry->flags &= ~unset_flags;
+
+        if((type == SYM_ARRAY && !symtab_entry_getarray(entry)) ||
+           (type == SYM_ASSOC && !symtab_entry_getassoc(entry)))
+        {
+            res = 1;
+            continue;
+        }
+
+        /* assign the value (if any) after setting the attributes */
+        if(argv[i][len] == '=')
+        {
+            if(is_array_assignment(argv[i]) ? !do_array_assignment(argv[i], len) :
+                                              !symtab_entry_assign(entry, argv[i]+len+1))
+            {
+                res = 1;
+            }
+        }
+    }
+
+    return res;
+}
@@ -0,0 +1,86 @@
+/*
+ *    Programmed By: Mohammed Isam [mohammed_isam1984@yahoo.com]
+ *    Copyright 2020 (c)
+ *
+ *    file: echo.c
+ *    This file is part of the "Let's Build a Linux Shell" tutorial.
+ *
+ *    This tutorial is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This tutorial is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this tutorial.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../shell.h"
+
+
+/*
+ * the echo builtin utility, which prints its arguments, separated by spaces
+ * and followed by a newline.. usage:
+ *
+ *     echo [-neE] [arg ...]
+ *
+ * the -n option suppresses the newline, -e enables the interpretation of
+ * backslash escape sequences, and -E disables it (the default).. an argument
+ * that contains any other char is not an option, but is printed.
+ *
+ * returns 0 on success, non-zero on error.
+ */
+int echo(int argc, char **argv)
+{
+    int newline = 1, escapes = 0, stop = 0;
+    int i = 1;
+
+    /* parse the options */
+    for( ; i < argc; i++)
+    {
+        char *p = argv[i];
+        if(p[0] != '-' || !p[1] || p[strspn(p+1, "neE")+1])
+        {
+            break;
+        }
+        while(*++p)
+        {
+            switch(*p)
+            {
+                case 'n': newline = 0; break;
+                case 'e': escapes = 1; break;
+                case 'E': escapes = 0; break;
+            }
+        }
+    }
+
+    for( ; i < argc && !stop; i++)
+    {
+        char *arg = argv[i];
+        size_t len = strlen(arg);
+        if(escapes)
+        {
+            /* escapes never make the string longer, so convert in place */
+            len = expand_escapes(arg, arg, 1, &stop);
+        }
+        fwrite(arg, 1, len, stdout);
+        if(i < argc-1 && !stop)
+        {
+            putchar(' ');
+        }
+    }
+
+    if(newline && !stop)
+    {
+        putchar('\n');
+    }
+
+    return ferror(stdout) ? 1 : 0;
+}
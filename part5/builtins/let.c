@@ -0,0 +1,53 @@
+/*
+ *    Programmed By: Mohammed Isam [mohammed_isam1984@yahoo.com]
+ *    Copyright 2020 (c)
+ *
+ *    file: let.c
+ *    This file is part of the "Let's Build a Linux Shell" tutorial.
+ *
+ *    This tutorial is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This tutorial is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this tutorial.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include "../shell.h"
+
+
+/*
+ * the let builtin utility, which evaluates arithmetic expressions.. usage:
+ *
+ *     let expr [expr ...]
+ *
+ * each argument is evaluated as a separate expression, in the same way as the
+ * expression of the ((expr)) command.
+ *
+ * returns 0 if the last expression evaluates to non-zero, 1 otherwise.
+ */
+int let(int argc, char **argv)
+{
+    int i, res = 1;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "%s: missing expression\n", argv[0]);
+        fprintf(stderr, "usage: %s expr [expr ...]\n", argv[0]);
+        return 2;
+    }
+
+    for(i = 1; i < argc; i++)
+    {
+        res = arithm_cond(argv[i]);
+    }
+
+    return res;
+}
@@ -0,0 +1,329 @@
+/*
+ *    Programmed By: Mohammed Isam [mohammed_isam1984@yahoo.com]
+ *    Copyright 2020 (c)
+ *
+ *    file: mapfile.c
+ *    This file is part of the "Let's Build a Linux Shell" tutorial.
+ *
+ *    This tutorial is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This tutorial is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this tutorial.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "../shell.h"
+#include "../symtab/symtab.h"
+
+
+/*
+ * regular files are mapped into memory, and the lines are found with memchr()
+ * straight from the mapping.. other files are read in blocks (or one byte at a
+ * time, if we must not read past the last line we want and we can't seek back).
+ */
+#define MAPFILE_BLOCK_SIZE      65536
+
+struct mapfile_s
+{
+    struct symtab_array_s *arr;         /* the array we're loading */
+    size_t index;                       /* subscript of the next element */
+    int    delim;                       /* the line delimiter */
+    int    strip;                       /* remove the delimiter from lines? */
+    long   skip;                        /* number of lines still to skip */
+    long   count;                       /* number of lines still to load (-1 for all) */
+};
+
+
+/*
+ * add the lines in the buffer to the array.. an incomplete line at the end of
+ * the buffer is left for the next call, unless we've reached EOF.
+ *
+ * returns the number of bytes consumed, or -1 if insufficient memory.
+ */
+ssize_t mapfile_lines(struct mapfile_s *mf, char *buf, size_t len, int eof)
+{
+    char *p = buf, *end = buf+len;
+
+    while(p < end && mf->count)
+    {
+        char *nl = memchr(p, mf->delim, end-p);
+        if(!nl && !eof)
+        {
+            break;
+        }
+
+        size_t linelen = nl ? (size_t)(nl-p) : (size_t)(end-p);
+        size_t dlen    = nl ? 1 : 0;
+
+        if(mf->skip)
+        {
+            mf->skip--;
+        }
+        else
+        {
+            if(!array_setn(mf->arr, mf->index++, p, linelen + (mf->strip ? 0 : dlen)))
+            {
+                return -1;
+            }
+            if(mf->count > 0)
+            {
+                mf->count--;
+            }
+        }
+        p += linelen+dlen;
+    }
+    return p-buf;
+}
+
+
+/*
+ * load the lines of a regular file by mapping it into memory.
+ *
+ * returns 1 if the file was loaded, 0 if it can't be mapped (and should be
+ * read instead), -1 on error.
+ */
+int mapfile_mmap(struct mapfile_s *mf, int fd)
+{
+    struct stat st;
+    off_t  off;
+
+    if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+       (off = lseek(fd, 0, SEEK_CUR)) < 0 || st.st_size <= off)
+    {
+        return 0;
+    }
+
+    /* the mapping must start at a page boundary */
+    off_t  start  = off - off%sysconf(_SC_PAGESIZE);
+    size_t maplen = st.st_size-start;
+    char  *map    = mmap(NULL, maplen, PROT_READ, MAP_PRIVATE, fd, start);
+    if(map == MAP_FAILED)
+    {
+        return 0;
+    }
+
+    ssize_t used = mapfile_lines(mf, map+(off-start), st.st_size-off, 1);
+    munmap(map, maplen);
+    if(used < 0)
+    {
+        return -1;
+    }
+
+    /* leave the file offset after the last line we've loaded */
+    lseek(fd, off+used, SEEK_SET);
+    return 1;
+}
+
+
+/*
+ * load the lines of a file by reading it.
+ *
+ * returns 1 on success, -1 on error.
+ */
+int mapfile_read(struct mapfile_s *mf, int fd)
+{
+    int    seekable = !isatty(fd) && lseek(fd, 0, SEEK_CUR) >= 0;
+    size_t chunk    = (seekable || mf->count < 0) ? MAPFILE_BLOCK_SIZE : 1;
+    char  *buf = NULL;
+    size_t len = 0, size = 0;
+    int    res = 1, eof = 0;
+
+    while(!eof && mf->count)
+    {
+        if(len+chunk > size)
+        {
+            size_t size2 = size ? size*2 : chunk;
+            while(size2 < len+chunk)
+            {
+                size2 *= 2;
+            }
+            char *buf2 = realloc(buf, size2);
+            if(!buf2)
+            {
+                res = -1;
+                break;
+            }
+            buf  = buf2;
+            size = size2;
+        }
+
+        ssize_t n = read(fd, buf+len, chunk);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            res = -1;
+            break;
+        }
+        eof  = (n == 0);
+        len += n;
+
+        /* when reading byte by byte, wait for a whole line */
+        if(chunk == 1 && !eof && buf[len-1] != mf->delim)
+        {
+            continue;
+        }
+
+        ssize_t used = mapfile_lines(mf, buf, len, eof);
+        if(used < 0)
+        {
+            res = -1;
+            break;
+        }
+        memmove(buf, buf+used, len-used);
+        len -= used;
+    }
+
+    /* give back what we've read past the last line we've loaded */
+    if(seekable && len)
+    {
+        lseek(fd, -(off_t)len, SEEK_CUR);
+    }
+    free(buf);
+    return res;
+}
+
+
+/*
+ * the mapfile (and readarray) builtin utility, which loads the lines of the
+ * standard input into an indexed array.. usage:
+ *
+ *     mapfile [-d delim] [-n count] [-O origin] [-s count] [-t] [-u fd] [array]
+ *
+ * the -d option gives the line delimiter (newline by default, or NUL if delim
+ * is empty).. -n loads at most count lines (0 means all of them).. -O starts
+ * at the given subscript, instead of clearing the array first.. -s skips the
+ * first count lines.. -t removes the delimiter from each line.. -u reads from
+ * the given fd instead of the standard input.. the default array is MAPFILE.
+ *
+ * returns 0 on success, 1 on error, 2 on usage error.
+ */
+int mapfile(int argc, char **argv)
+{
+    struct mapfile_s mf = { .delim = '\n', .count = -1 };
+    long fd = 0, origin = -1, n;
+    char *end;
+    int i;
+
+    for(i = 1; i < argc; i++)
+    {
+        char *p = argv[i];
+        if(*p != '-' || !p[1])
+        {
+            break;
+        }
+
+        /* -- marks the end of options */
+        if(strcmp(p, "--") == 0)
+        {
+            i++;
+            break;
+        }
+
+        while(*++p)
+        {
+            if(*p == 't')
+            {
+                mf.strip = 1;
+                continue;
+            }
+
+            if(!strchr("dnOsu", *p))
+            {
+                fprintf(stderr, "%s: invalid option: -%c\n", argv[0], *p);
+                fprintf(stderr, "usage: %s [-d delim] [-n count] [-O origin] [-s count] "
+                                "[-t] [-u fd] [array]\n", argv[0]);
+                return 2;
+            }
+
+            /* the option argument is the rest of this word, or the next word */
+            char  opt = *p;
+            char *arg = p[1] ? p+1 : argv[++i];
+            if(!arg)
+            {
+                fprintf(stderr, "%s: -%c: option requires an argument\n", argv[0], opt);
+                return 2;
+            }
+
+            if(opt == 'd')
+            {
+                mf.delim = (unsigned char)*arg;
+                break;
+            }
+
+            errno = 0;
+            n = strtol(arg, &end, 10);
+            if(end == arg || *end || errno || n < 0 || n > INT_MAX)
+            {
+                fprintf(stderr, "%s: %s: invalid %s\n", argv[0], arg,
+                        (opt == 'u') ? "file descriptor" : "number");
+                return 2;
+            }
+
+            switch(opt)
+            {
+                case 'n': mf.count = n ? n : -1; break;
+                case 'O': origin   = n         ; break;
+                case 's': mf.skip  = n         ; break;
+                case 'u': fd       = n         ; break;
+            }
+            break;
+        }
+    }
+
+    if(argc-i > 1)
+    {
+        fprintf(stderr, "%s: too many arguments\n", argv[0]);
+        return 2;
+    }
+
+    char *name = (i < argc) ? argv[i] : "MAPFILE";
+    if(!is_name(name))
+    {
+        fprintf(stderr, "%s: invalid variable name: %s\n", argv[0], name);
+        return 2;
+    }
+
+    struct symtab_entry_s *entry = add_to_symtab(name);
+    if(!entry || !(mf.arr = symtab_entry_getarray(entry)))
+    {
+        return 1;
+    }
+
+    if(origin < 0)
+    {
+        array_clear(mf.arr);
+        origin = 0;
+    }
+    mf.index = origin;
+
+    int res = mapfile_mmap(&mf, fd);
+    if(res == 0)
+    {
+        res = mapfile_read(&mf, fd);
+    }
+
+    if(res < 0)
+    {
+        fprintf(stderr, "%s: failed to read input: %s\n", argv[0], strerror(errno));
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,727 @@
+/*
+ *    Programmed By: Mohammed Isam [mohammed_isam1984@yahoo.com]
+ *    Copyright 2020 (c)
+ *
+ *    file: printf.c
+ *    This file is part of the "Let's Build a Linux Shell" tutorial.
+ *
+ *    This tutorial is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This tutorial is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this tutorial.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <time.h>
+#include "../shell.h"
+#include "../symtab/symtab.h"
+
+
+/*
+ * a format string is compiled into a list of segments, each of which is either
+ * literal text (with the escape sequences already converted), or a conversion
+ * specification, which we keep as the spec we'll pass to snprintf().. the
+ * conversions that produce strings (%s, %b, %q, %c and %(...)T) are all done
+ * with a %s spec.
+ */
+struct printf_seg_s
+{
+    char    conv;                       /* conversion char, 0 for literal text */
+    char   *text;                       /* the literal text, or the snprintf() spec */
+    size_t  len;                        /* length of the literal text */
+    int     nstars;                     /* number of '*' widths/precisions */
+    char   *tfmt;                       /* the strftime() format of %(...)T */
+};
+
+struct printf_fmt_s
+{
+    char         *text;                 /* the format string */
+    unsigned int  hash;                 /* its hash value */
+    int           nsegs, nconvs;        /* number of segments and conversions */
+    struct printf_seg_s *segs;          /* the segments */
+    struct printf_fmt_s *next;          /* next format in the hash bucket */
+};
+
+/* the output buffer */
+struct printf_out_s
+{
+    char   *buf;
+    size_t  len, size;
+};
+
+
+/*
+ * free the memory used by a compiled format.
+ */
+void free_printf_fmt(struct printf_fmt_s *fmt)
+{
+    int i;
+    for(i = 0; i < fmt->nsegs; i++)
+    {
+        free(fmt->segs[i].text);
+        free(fmt->segs[i].tfmt);
+    }
+    free(fmt->segs);
+    free(fmt->text);
+    free(fmt);
+}
+
+
+/*
+ * add a segment to the compiled format.
+ *
+ * returns the new segment, or NULL if insufficient memory.
+ */
+struct printf_seg_s *add_printf_seg(struct printf_fmt_s *fmt, char conv, char *text, size_t len)
+{
+    struct printf_seg_s *segs = realloc(fmt->segs, (fmt->nsegs+1)*sizeof(struct printf_seg_s));
+    if(!segs)
+    {
+        return NULL;
+    }
+    fmt->segs = segs;
+
+    struct printf_seg_s *seg = &segs[fmt->nsegs];
+    memset(seg, 0, sizeof(struct printf_seg_s));
+    if(!(seg->text = malloc(len+1)))
+    {
+        return NULL;
+    }
+    memcpy(seg->text, text, len);
+    seg->text[len] = '\0';
+    seg->conv = conv;
+    seg->len  = len;
+    fmt->nsegs++;
+    if(conv)
+    {
+        fmt->nconvs++;
+    }
+    return seg;
+}
+
+
+/*
+ * compile the given format string.. invalid conversions are reported to stderr.
+ *
+ * returns the compiled format, or NULL on error.
+ */
+struct printf_fmt_s *compile_printf_fmt(char *text, unsigned int hash)
+{
+    struct printf_fmt_s *fmt = malloc(sizeof(struct printf_fmt_s));
+    size_t len = strlen(text);
+    char   buf[len+1], spec[len+8];
+    char  *p = text, *p2;
+
+    if(!fmt)
+    {
+        return NULL;
+    }
+    memset(fmt, 0, sizeof(struct printf_fmt_s));
+    if(!(fmt->text = malloc(len+1)))
+    {
+        free(fmt);
+        return NULL;
+    }
+    strcpy(fmt->text, text);
+    fmt->hash = hash;
+
+    while(*p)
+    {
+        /* literal text, up to the next conversion */
+        if(*p != '%' || p[1] == '%')
+        {
+            size_t n = 0;
+            while(*p && (*p != '%' || p[1] == '%'))
+            {
+                if(*p == '%')
+                {
+                    p++;
+                }
+                else if(*p == '\\' && p[1])
+                {
+                    buf[n++] = *p++;
+                }
+                buf[n++] = *p++;
+            }
+            buf[n] = '\0';
+            n = expand_escapes(buf, buf, 0, NULL);
+            if(!add_printf_seg(fmt, 0, buf, n))
+            {
+                goto err;
+            }
+            continue;
+        }
+
+        /* the flags, width and precision go to the snprintf() spec */
+        char  *s = spec, *tfmt = NULL;
+        size_t tlen = 0;
+        int    nstars = 0;
+
+        *s++ = *p++;
+        while(*p && strchr("-+ #0'", *p))
+        {
+            *s++ = *p++;
+        }
+        if(*p == '*')
+        {
+            *s++ = *p++;
+            nstars++;
+        }
+        while(*p >= '0' && *p <= '9')
+        {
+            *s++ = *p++;
+        }
+        if(*p == '.')
+        {
+            *s++ = *p++;
+            if(*p == '*')
+            {
+                *s++ = *p++;
+                nstars++;
+            }
+            while(*p >= '0' && *p <= '9')
+            {
+                *s++ = *p++;
+            }
+        }
+
+        /* length modifiers don't mean anything here */
+        while(*p && strchr("hlLjzt", *p))
+        {
+            p++;
+        }
+
+        /* the strftime() format of %(...)T */
+        if(*p == '(')
+        {
+            if(!(p2 = strchr(p, ')')) || p2[1] != 'T')
+            {
+                fprintf(stderr, "printf: `%s': missing time format\n", p);
+                goto err;
+            }
+            tfmt = p+1;
+            tlen = p2-tfmt;
+            p = p2+1;
+        }
+
+        char conv = *p;
+        if(!conv || !strchr("diouxXfFeEgGaAcsbqT", conv) || (conv == 'T' && !tfmt))
+        {
+            fprintf(stderr, "printf: `%c': invalid format character\n", conv ? conv : '%');
+            goto err;
+        }
+        p++;
+
+        if(strchr("diouxX", conv))
+        {
+            *s++ = 'l';
+            *s++ = 'l';
+            *s++ = conv;
+        }
+        else if(strchr("fFeEgGaA", conv))
+        {
+            *s++ = conv;
+        }
+        else
+        {
+            *s++ = 's';
+        }
+
+        struct printf_seg_s *seg = add_printf_seg(fmt, conv, spec, s-spec);
+        if(!seg)
+        {
+            goto err;
+        }
+        seg->nstars = nstars;
+        if(tfmt)
+        {
+            /* an empty format gives the locale's time representation */
+            if(!tlen)
+            {
+                tfmt = "%X", tlen = 2;
+            }
+            if(!(seg->tfmt = malloc(tlen+1)))
+            {
+                goto err;
+            }
+            memcpy(seg->tfmt, tfmt, tlen);
+            seg->tfmt[tlen] = '\0';
+        }
+    }
+
+    return fmt;
+
+err:
+    free_printf_fmt(fmt);
+    return NULL;
+}
+
+
+/*
+ * the compiled formats cache.. when the table is full, we throw away the
+ * formats in the bucket we are adding to.
+ */
+#define PRINTF_CACHE_BUCKETS    32      /* hash table size (power of 2) */
+#define PRINTF_CACHE_SIZE       32      /* max. number of cached formats */
+
+struct printf_fmt_s *printf_cache[PRINTF_CACHE_BUCKETS];
+int    printf_cache_count = 0;
+
+
+/*
+ * get the compiled form of the given format string, compiling it and adding
+ * it to the cache if it's not already there.
+ *
+ * returns the compiled format, or NULL on error.
+ */
+struct printf_fmt_s *get_printf_fmt(char *text)
+{
+    unsigned int hash = str_hash(text);
+    int bucket = hash & (PRINTF_CACHE_BUCKETS-1);
+    struct printf_fmt_s *fmt;
+
+    for(fmt = printf_cache[bucket]; fmt; fmt = fmt->next)
+    {
+        if(fmt->hash == hash && strcmp(fmt->text, text) == 0)
+        {
+            return fmt;
+        }
+    }
+
+    if(!(fmt = compile_printf_fmt(text, hash)))
+    {
+        return NULL;
+    }
+
+    /* make room by emptying the bucket */
+    if(printf_cache_count >= PRINTF_CACHE_SIZE)
+    {
+        while(printf_cache[bucket])
+        {
+            struct printf_fmt_s *next = printf_cache[bucket]->next;
+            free_printf_fmt(printf_cache[bucket]);
+            printf_cache[bucket] = next;
+            printf_cache_count--;
+        }
+    }
+
+    fmt->next = printf_cache[bucket];
+    printf_cache[bucket] = fmt;
+    printf_cache_count++;
+    return fmt;
+}
+
+
+/*
+ * make sure the output buffer has room for n more chars (plus a NUL).
+ *
+ * returns 1 on success, 0 if insufficient memory.
+ */
+int printf_reserve(struct printf_out_s *out, size_t n)
+{
+    if(out->len+n+1 <= out->size)
+    {
+        return 1;
+    }
+
+    size_t size = out->size ? out->size : 256;
+    while(size < out->len+n+1)
+    {
+        size *= 2;
+    }
+    char *buf = realloc(out->buf, size);
+    if(!buf)
+    {
+        return 0;
+    }
+    out->buf  = buf;
+    out->size = size;
+    return 1;
+}
+
+
+/*
+ * add the given text to the output buffer.
+ */
+void printf_append(struct printf_out_s *out, char *text, size_t len)
+{
+    if(printf_reserve(out, len))
+    {
+        memcpy(out->buf+out->len, text, len);
+        out->len += len;
+        out->buf[out->len] = '\0';
+    }
+}
+
+
+/* the value of a conversion's argument */
+union printf_val_u
+{
+    long long  l;                       /* for the integer conversions */
+    double     d;                       /* for the floating point conversions */
+    char      *s;                       /* for the string conversions */
+};
+
+
+/*
+ * call snprintf() with the spec of the given conversion segment, passing it
+ * the '*' widths/precisions (if any) and the value.
+ */
+int printf_spec(char *buf, size_t size, struct printf_seg_s *seg, int *stars,
+                union printf_val_u *val)
+{
+    if(strchr("diouxX", seg->conv))
+    {
+        switch(seg->nstars)
+        {
+            case 0 : return snprintf(buf, size, seg->text, val->l);
+            case 1 : return snprintf(buf, size, seg->text, stars[0], val->l);
+            default: return snprintf(buf, size, seg->text, stars[0], stars[1], val->l);
+        }
+    }
+
+    if(strchr("fFeEgGaA", seg->conv))
+    {
+        switch(seg->nstars)
+        {
+            case 0 : return snprintf(buf, size, seg->text, val->d);
+            case 1 : return snprintf(buf, size, seg->text, stars[0], val->d);
+            default: return snprintf(buf, size, seg->text, stars[0], stars[1], val->d);
+        }
+    }
+
+    switch(seg->nstars)
+    {
+        case 0 : return snprintf(buf, size, seg->text, val->s);
+        case 1 : return snprintf(buf, size, seg->text, stars[0], val->s);
+        default: return snprintf(buf, size, seg->text, stars[0], stars[1], val->s);
+    }
+}
+
+
+/*
+ * format the value according to the given conversion segment, and add the
+ * result to the output buffer.
+ */
+void printf_format(struct printf_out_s *out, struct printf_seg_s *seg, int *stars,
+                   union printf_val_u val)
+{
+    int n = printf_spec(out->buf+out->len, out->size-out->len, seg, stars, &val);
+
+    /* not enough room. make some and try again */
+    if(n >= 0 && (size_t)n >= out->size-out->len)
+    {
+        if(!printf_reserve(out, n))
+        {
+            return;
+        }
+        n = printf_spec(out->buf+out->len, out->size-out->len, seg, stars, &val);
+    }
+    out->len += (n > 0) ? n : 0;
+}
+
+
+/*
+ * convert a numeric argument.. an argument starting with a quote gives the
+ * value of the char after the quote.. invalid numbers are reported to stderr,
+ * and *err is set to 1.
+ */
+long long printf_get_long(char *arg, int *err)
+{
+    char *end;
+
+    if(!arg || !*arg)
+    {
+        return 0;
+    }
+    if(*arg == '\'' || *arg == '"')
+    {
+        return (unsigned char)arg[1];
+    }
+
+    errno = 0;
+    long long val = (*arg == '-') ? strtoll(arg, &end, 0) : (long long)strtoull(arg, &end, 0);
+    if(*end || errno)
+    {
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+        *err = 1;
+    }
+    return val;
+}
+
+
+double printf_get_double(char *arg, int *err)
+{
+    char *end;
+
+    if(!arg || !*arg)
+    {
+        return 0;
+    }
+    if(*arg == '\'' || *arg == '"')
+    {
+        return (unsigned char)arg[1];
+    }
+
+    double val = str_to_double(arg, &end);
+    if(*end)
+    {
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+        *err = 1;
+    }
+    return val;
+}
+
+
+/*
+ * quote a string in a format that can be reused as shell input.. special chars
+ * are backslash-escaped, while empty strings and strings with control chars
+ * (which can't be escaped that way) are single-quoted.
+ *
+ * returns the malloc'd quoted string, or NULL if insufficient memory.
+ */
+char *printf_quote(char *str)
+{
+    char *specials = " \t|&;()<>$`\\\"'*?[]#~=%{}!,^";
+    char *res, *p, *s;
+    size_t len = 0;
+    int cntrl = !*str;
+
+    for(s = str; *s; s++)
+    {
+        cntrl = cntrl || iscntrl((unsigned char)*s);
+        len  += (*s == '\'') ? 4 : 2;
+    }
+    if(!(res = malloc(len+3)))
+    {
+        return NULL;
+    }
+
+    p = res;
+    if(!cntrl)
+    {
+        for(s = str; *s; s++)
+        {
+            if(strchr(specials, *s))
+            {
+                *p++ = '\\';
+            }
+            *p++ = *s;
+        }
+        *p = '\0';
+        return res;
+    }
+
+    /* each single quote becomes '\'' */
+    *p++ = '\'';
+    for(s = str; *s; s++)
+    {
+        if(*s == '\'')
+        {
+            strcpy(p, "'\\''");
+            p += 4;
+        }
+        else
+        {
+            *p++ = *s;
+        }
+    }
+    *p++ = '\'';
+    *p   = '\0';
+    return res;
+}
+
+
+/*
+ * do one conversion, using as many arguments as it needs.
+ *
+ * returns 1 if the output should stop (because of a \c in a %b argument),
+ * 0 otherwise.
+ */
+int printf_convert(struct printf_out_s *out, struct printf_seg_s *seg,
+                   char **args, int nargs, int *argi, int *err)
+{
+    int    stars[2] = { 0, 0 }, stop = 0, i;
+    char  *arg, *str = NULL, buf[512];
+    union  printf_val_u val;
+    time_t t;
+    struct tm tm;
+
+    for(i = 0; i < seg->nstars; i++)
+    {
+        stars[i] = (int)printf_get_long((*argi < nargs) ? args[(*argi)++] : NULL, err);
+    }
+    arg = (*argi < nargs) ? args[(*argi)++] : NULL;
+
+    switch(seg->conv)
+    {
+        case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+            val.l = printf_get_long(arg, err);
+            printf_format(out, seg, stars, val);
+            return 0;
+
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            val.d = printf_get_double(arg, err);
+            printf_format(out, seg, stars, val);
+            return 0;
+
+        case 'c':
+            buf[0] = arg ? *arg : '\0';
+            buf[1] = '\0';
+            val.s  = buf;
+            break;
+
+        case 'b':
+            if(!arg || !(str = malloc(strlen(arg)+1)))
+            {
+                val.s = "";
+                break;
+            }
+            str[expand_escapes(arg, str, 1, &stop)] = '\0';
+            val.s = str;
+            break;
+
+        case 'q':
+            str   = printf_quote(arg ? arg : "");
+            val.s = str ? str : "";
+            break;
+
+        case 'T':
+            /* -1 (and a missing argument) means the current time */
+            t = arg ? (time_t)printf_get_long(arg, err) : -1;
+            if(t == -1 || t == -2)
+            {
+                t = time(NULL);
+            }
+            buf[0] = '\0';
+            if(localtime_r(&t, &tm))
+            {
+                strftime(buf, sizeof(buf), seg->tfmt, &tm);
+            }
+            val.s = buf;
+            break;
+
+        default:
+            val.s = arg ? arg : "";
+            break;
+    }
+
+    printf_format(out, seg, stars, val);
+    free(str);
+    return stop;
+}
+
+
+/*
+ * the printf builtin utility, which prints its arguments according to the
+ * given format.. usage:
+ *
+ *     printf [-v var] format [arg ...]
+ *
+ * the format is reused as many times as needed to consume all the arguments..
+ * in addition to the conversions of printf(3), %b expands the backslash
+ * escapes in its argument, %q quotes its argument for reuse as shell input,
+ * and %(fmt)T formats its argument (seconds since the epoch, or -1 for the
+ * current time) using strftime(3).. with -v, the output is assigned to the
+ * variable var instead of being printed.. formats are compiled once, and
+ * the compiled form is cached for when the same format is used again.
+ *
+ * returns 0 on success, non-zero on error.
+ */
+int printf_builtin(int argc, char **argv)
+{
+    struct printf_out_s out = { .buf = NULL, .len = 0, .size = 0 };
+    char *var = NULL;
+    int   i = 1, argi = 0, err = 0, stop = 0, j;
+
+    /* parse the options */
+    for( ; i < argc && argv[i][0] == '-' && argv[i][1]; i++)
+    {
+        if(strcmp(argv[i], "--") == 0)
+        {
+            i++;
+            break;
+        }
+        if(strcmp(argv[i], "-v") == 0 && i+1 < argc)
+        {
+            var = argv[++i];
+            if(!is_name(var))
+            {
+                fprintf(stderr, "%s: `%s': not a valid identifier\n", argv[0], var);
+                return 2;
+            }
+            continue;
+        }
+        fprintf(stderr, "%s: invalid option: %s\n", argv[0], argv[i]);
+        fprintf(stderr, "usage: %s [-v var] format [arg ...]\n", argv[0]);
+        return 2;
+    }
+
+    if(i >= argc)
+    {
+        fprintf(stderr, "usage: %s [-v var] format [arg ...]\n", argv[0]);
+        return 2;
+    }
+
+    struct printf_fmt_s *fmt = get_printf_fmt(argv[i]);
+    if(!fmt)
+    {
+        return 1;
+    }
+
+    char **args  = argv+i+1;
+    int    nargs = argc-i-1;
+    if(!printf_reserve(&out, 0))
+    {
+        return 1;
+    }
+    out.buf[0] = '\0';
+
+    do
+    {
+        for(j = 0; j < fmt->nsegs && !stop; j++)
+        {
+            struct printf_seg_s *seg = &fmt->segs[j];
+            if(!seg->conv)
+            {
+                printf_append(&out, seg->text, seg->len);
+            }
+            else
+            {
+                stop = printf_convert(&out, seg, args, nargs, &argi, &err);
+            }
+        }
+    } while(fmt->nconvs && argi < nargs && !stop);
+
+    if(var)
+    {
+        struct symtab_entry_s *entry = add_to_symtab(var);
+        if(!entry || !symtab_entry_assign(entry, out.buf))
+        {
+            err = 1;
+        }
+    }
+    else
+    {
+        fwrite(out.buf, 1, out.len, stdout);
+        if(ferror(stdout))
+        {
+            err = 1;
+        }
+    }
+
+    free(out.buf);
+    return err;
+}
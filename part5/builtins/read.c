@@ -0,0 +1,401 @@
+/*
+ *    Programmed By: Mohammed Isam [mohammed_isam1984@yahoo.com]
+ *    Copyright 2020 (c)
+ *
+ *    file: read.c
+ *    This file is part of the "Let's Build a Linux Shell" tutorial.
+ *
+ *    This tutorial is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This tutorial is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this tutorial.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include "../shell.h"
+#include "../symtab/symtab.h"
+
+
+/*
+ * read must not consume any input past the delimiter, as the rest belongs to
+ * whoever reads the file next.. if the file is seekable, we read big blocks
+ * and seek back to just after the delimiter when we're done.. otherwise (pipes
+ * and terminals), we have no choice but to read one byte at a time.
+ */
+#define READ_BLOCK_SIZE     8192
+
+struct read_input_s
+{
+    int    fd;
+    int    seekable;
+    char  *buf;
+    size_t len, pos;
+};
+
+
+/*
+ * get the next byte of input.
+ *
+ * returns the byte, or -1 on EOF or error.
+ */
+int read_next_byte(struct read_input_s *in)
+{
+    if(in->pos == in->len)
+    {
+        ssize_t n;
+        do
+        {
+            n = read(in->fd, in->buf, in->seekable ? READ_BLOCK_SIZE : 1);
+        } while(n < 0 && errno == EINTR);
+
+        if(n <= 0)
+        {
+            return -1;
+        }
+        in->len = n;
+        in->pos = 0;
+    }
+    return (unsigned char)in->buf[in->pos++];
+}
+
+
+/*
+ * the line we read, and which of its chars were backslash-escaped (those are
+ * not delimiters when splitting the line into fields).
+ */
+struct read_line_s
+{
+    char  *str, *escaped;
+    size_t len, size;
+};
+
+
+/*
+ * add a char to the line.
+ *
+ * returns 1 on success, 0 if insufficient memory.
+ */
+int read_add_char(struct read_line_s *line, char c, int escaped)
+{
+    if(line->len+1 >= line->size)
+    {
+        size_t size = line->size ? line->size*2 : 128;
+        char *str = realloc(line->str, size);
+        if(!str)
+        {
+            return 0;
+        }
+        line->str = str;
+
+        char *esc = realloc(line->escaped, size);
+        if(!esc)
+        {
+            return 0;
+        }
+        line->escaped = esc;
+        line->size = size;
+    }
+    line->escaped[line->len] = escaped;
+    line->str[line->len++] = c;
+    line->str[line->len] = '\0';
+    return 1;
+}
+
+
+/*
+ * check if the char at the given index in the line is an (unescaped) $IFS char.
+ */
+static inline int read_is_IFS(struct read_line_s *line, size_t i, char *IFS)
+{
+    return !line->escaped[i] && line->str[i] && strchr(IFS, line->str[i]);
+}
+
+
+/*
+ * skip the $IFS whitespace chars, followed by at most one other $IFS delimiter
+ * and the whitespace after it.
+ *
+ * returns the index of the first char after the delimiter.
+ */
+size_t read_skip_delim(struct read_line_s *line, size_t i, char *IFS_space, char *IFS_delim)
+{
+    while(i < line->len && read_is_IFS(line, i, IFS_space))
+    {
+        i++;
+    }
+    if(i < line->len && read_is_IFS(line, i, IFS_delim))
+    {
+        i++;
+        while(i < line->len && read_is_IFS(line, i, IFS_space))
+        {
+            i++;
+        }
+    }
+    return i;
+}
+
+
+/*
+ * assign the part of the line between the given indices to a variable.
+ *
+ * returns 1 on success, 0 on error.
+ */
+int read_assign(char *name, struct read_line_s *line, size_t start, size_t end)
+{
+    struct symtab_entry_s *entry = add_to_symtab(name);
+    if(!entry)
+    {
+        return 0;
+    }
+
+    /* we haven't read anything */
+    if(!line->str)
+    {
+        return symtab_entry_assign(entry, "");
+    }
+
+    char c = line->str[end];
+    line->str[end] = '\0';
+    int res = symtab_entry_assign(entry, line->str+start);
+    line->str[end] = c;
+    return res;
+}
+
+
+/*
+ * split the line into fields using the chars in $IFS (the same way as the
+ * field splitting of word expansion), and assign them to the given variables..
+ * the last variable gets the rest of the line.
+ *
+ * returns 0 on success, 1 on error.
+ */
+int read_split(struct read_line_s *line, char **names, int count)
+{
+    char IFS_space[64];
+    char IFS_delim[64];
+    size_t i = 0, j;
+    int n, res = 0;
+
+    if(!get_IFS_chars(IFS_space, IFS_delim))
+    {
+        IFS_space[0] = '\0';
+        IFS_delim[0] = '\0';
+    }
+
+    /* skip leading and trailing $IFS whitespace */
+    while(i < line->len && read_is_IFS(line, i, IFS_space))
+    {
+        i++;
+    }
+    while(line->len > i && read_is_IFS(line, line->len-1, IFS_space))
+    {
+        line->len--;
+    }
+
+    for(n = 0; n < count; n++)
+    {
+        /* find the end of the field */
+        j = i;
+        while(j < line->len && !read_is_IFS(line, j, IFS_space) &&
+                               !read_is_IFS(line, j, IFS_delim))
+        {
+            j++;
+        }
+
+        size_t next = read_skip_delim(line, j, IFS_space, IFS_delim);
+
+        /*
+         * the last variable gets the rest of the line, unless the rest is one
+         * field followed by a delimiter.
+         */
+        if(n == count-1 && next < line->len)
+        {
+            j = line->len;
+        }
+
+        if(!read_assign(names[n], line, i, j))
+        {
+            res = 1;
+        }
+        i = next;
+    }
+    return res;
+}
+
+
+/*
+ * the read builtin utility, which reads a line from the standard input and
+ * splits it into fields.. usage:
+ *
+ *     read [-r] [-d delim] [-n nchars] [-u fd] [name ...]
+ *
+ * the -r option means backslash is not an escape character.. -d reads up to
+ * the first char of delim (newline by default, or NUL if delim is empty)..
+ * -n reads at most nchars chars.. -u reads from the given fd instead of the
+ * standard input.. with no names, the line is assigned to $REPLY as-is.
+ *
+ * returns 0 on success, 1 on EOF or error, 2 on usage error.
+ */
+int read_builtin(int argc, char **argv)
+{
+    int  raw = 0, delim = '\n', c, i;
+    long nchars = -1, fd = 0;
+    char *end;
+
+    for(i = 1; i < argc; i++)
+    {
+        char *p = argv[i];
+        if(*p != '-' || !p[1])
+        {
+            break;
+        }
+
+        /* -- marks the end of options */
+        if(strcmp(p, "--") == 0)
+        {
+            i++;
+            break;
+        }
+
+        while(*++p)
+        {
+            if(*p == 'r')
+            {
+                raw = 1;
+                continue;
+            }
+
+            if(!strchr("dnu", *p))
+            {
+                fprintf(stderr, "%s: invalid option: -%c\n", argv[0], *p);
+                fprintf(stderr, "usage: %s [-r] [-d delim] [-n nchars] [-u fd] [name ...]\n", argv[0]);
+                return 2;
+            }
+
+            /* the option argument is the rest of this word, or the next word */
+            char  opt = *p;
+            char *arg = p[1] ? p+1 : argv[++i];
+            if(!arg)
+            {
+                fprintf(stderr, "%s: -%c: option requires an argument\n", argv[0], opt);
+                return 2;
+            }
+
+            if(opt == 'd')
+            {
+                delim = (unsigned char)*arg;
+            }
+            else
+            {
+                long *val = (opt == 'n') ? &nchars : &fd;
+                errno = 0;
+                *val = strtol(arg, &end, 10);
+                if(end == arg || *end || errno || *val < 0 || *val > INT_MAX)
+                {
+                    fprintf(stderr, "%s: %s: invalid %s\n", argv[0], arg,
+                            (opt == 'n') ? "number" : "file descriptor");
+                    return 2;
+                }
+            }
+            break;
+        }
+    }
+
+    char **names = argv+i;
+    int count = argc-i;
+    for(i = 0; i < count; i++)
+    {
+        if(!is_name(names[i]))
+        {
+            fprintf(stderr, "%s: invalid variable name: %s\n", argv[0], names[i]);
+            return 2;
+        }
+    }
+
+    /* let the user see any prompt we have printed */
+    flush_output();
+
+    char buf[READ_BLOCK_SIZE];
+    struct read_input_s in = { .fd = fd, .buf = buf };
+    struct read_line_s line = { 0 };
+    in.seekable = !isatty(fd) && lseek(fd, 0, SEEK_CUR) >= 0;
+
+    int res = 1, backslash = 0;
+    while(nchars && (c = read_next_byte(&in)) >= 0)
+    {
+        /* the NUL byte can't be stored in a variable */
+        if(c == '\0' && delim != '\0')
+        {
+            continue;
+        }
+
+        int escaped = backslash;
+        backslash = 0;
+        if(escaped)
+        {
+            /* backslash-newline is a line continuation */
+            if(c == '\n')
+            {
+                continue;
+            }
+        }
+        else if(c == delim)
+        {
+            res = 0;
+            break;
+        }
+        else if(c == '\\' && !raw)
+        {
+            backslash = 1;
+            continue;
+        }
+
+        if(!read_add_char(&line, c, escaped))
+        {
+            fprintf(stderr, "%s: insufficient memory\n", argv[0]);
+            break;
+        }
+        nchars--;
+    }
+
+    /* -n reached its count without seeing the delimiter */
+    if(!nchars)
+    {
+        res = 0;
+    }
+
+    /* give back what we've read past the delimiter */
+    if(in.seekable && in.pos < in.len)
+    {
+        lseek(fd, -(off_t)(in.len-in.pos), SEEK_CUR);
+    }
+
+    if(count == 0)
+    {
+        if(!read_assign("REPLY", &line, 0, line.len))
+        {
+            res = 1;
+        }
+    }
+    else if(read_split(&line, names, count))
+    {
+        res = 1;
+    }
+
+    free(line.str);
+    free(line.escaped);
+    return res;
+}
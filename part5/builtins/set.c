@@ -0,0 +1,60 @@
+/*
+ *    Programmed By: Mohammed Isam [mohammed_isam1984@yahoo.com]
+ *    Copyright 2020 (c)
+ *
+ *    file: set.c
+ *    This file is part of the "Let's Build a Linux Shell" tutorial.
+ *
+ *    This tutorial is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This tutorial is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this tutorial.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include "../shell.h"
+
+
+/*
+ * the set builtin utility, which sets the positional parameters.. usage:
+ *
+ *     set [--] [arg ...]
+ *
+ * the args become $1, $2, and so on.. set -- with no args unsets all the
+ * positional parameters.. we don't have any shell options yet, so any other
+ * option is an error.
+ *
+ * returns 0 on success, 1 on error, 2 on usage error.
+ */
+int set(int argc, char **argv)
+{
+    int i = 1;
+
+    if(argc < 2)
+    {
+        return 0;
+    }
+
+    if(strcmp(argv[1], "--") == 0)
+    {
+        i++;
+    }
+    else if(argv[1][0] == '-' || argv[1][0] == '+')
+    {
+        fprintf(stderr, "%s: invalid option: %s\n", argv[0], argv[1]);
+        fprintf(stderr, "usage: %s [--] [arg ...]\n", argv[0]);
+        return 2;
+    }
+
+    return set_pos_params(argc-i, argv+i) ? 0 : 1;
+}
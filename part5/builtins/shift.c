@@ -0,0 +1,64 @@
+/*
+ *    Programmed By: Mohammed Isam [mohammed_isam1984@yahoo.com]
+ *    Copyright 2020 (c)
+ *
+ *    file: shift.c
+ *    This file is part of the "Let's Build a Linux Shell" tutorial.
+ *
+ *    This tutorial is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This tutorial is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this tutorial.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+#include "../shell.h"
+
+
+/*
+ * the shift builtin utility, which shifts the positional parameters to the
+ * left.. usage:
+ *
+ *     shift [n]
+ *
+ * $n+1 becomes $1, $n+2 becomes $2, and so on.. n defaults to 1.
+ *
+ * returns 0 on success, 1 if n is greater than $#, 2 on usage error.
+ */
+int shift(int argc, char **argv)
+{
+    long n = 1;
+
+    if(argc > 2)
+    {
+        fprintf(stderr, "%s: too many arguments\n", argv[0]);
+        fprintf(stderr, "usage: %s [n]\n", argv[0]);
+        return 2;
+    }
+
+    if(argc == 2)
+    {
+        char *end;
+        errno = 0;
+        n = strtol(argv[1], &end, 10);
+        if(end == argv[1] || *end || errno || n < 0 || n > INT_MAX)
+        {
+            fprintf(stderr, "%s: %s: invalid shift count\n", argv[0], argv[1]);
+            return 2;
+        }
+    }
+
+    return shift_pos_params(n) ? 0 : 1;
+}
@@ -0,0 +1,320 @@
+/*
+ *    Programmed By: Mohammed Isam [mohammed_isam1984@yahoo.com]
+ *    Copyright 2020 (c)
+ *
+ *    file: test.c
+ *    This file is part of the "Let's Build a Linux Shell" tutorial.
+ *
+ *    This tutorial is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This tutorial is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this tutorial.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include "../shell.h"
+#include "../cond.h"
+
+
+/* the name we were invoked with (test or [), for error messages */
+char *test_name = "test";
+
+
+/*
+ * convert the operand of an integer operator to a number.. unlike [[ ]], the
+ * operand must be an integer, optionally surrounded by whitespace.
+ *
+ * returns 1 on success, 0 if the operand is not an integer.
+ */
+int test_get_int(char *str, long *n)
+{
+    char *end;
+
+    errno = 0;
+    *n = strtol(str, &end, 10);
+    while(isspace(*end))
+    {
+        end++;
+    }
+    if(end == str || *end || errno)
+    {
+        fprintf(stderr, "%s: %s: integer expression expected\n", test_name, str);
+        return 0;
+    }
+    return 1;
+}
+
+
+/*
+ * get the binary operator in the given word.. the =~ operator is only
+ * available in [[ ]].
+ */
+static inline enum cond_op_e test_binary_op(char *word)
+{
+    enum cond_op_e op = get_cond_op(word, COND_BINARY);
+    return (op == COND_REGEX) ? 0 : op;
+}
+
+
+/*
+ * evaluate a binary operator.
+ *
+ * returns 1 if the condition is true, 0 if false, -1 on error.
+ */
+int test_binary(enum cond_op_e op, char *arg1, char *arg2)
+{
+    long n1, n2;
+
+    switch(op)
+    {
+        case COND_INT_EQ:
+        case COND_INT_NE:
+        case COND_INT_LT:
+        case COND_INT_LE:
+        case COND_INT_GT:
+        case COND_INT_GE:
+            if(!test_get_int(arg1, &n1) || !test_get_int(arg2, &n2))
+            {
+                return -1;
+            }
+            return cond_int_compare(op, n1, n2);
+
+        default:
+            return cond_binary(op, arg1, arg2);
+    }
+}
+
+
+/*
+ * the words of the expression, and our position in them, as we evaluate the
+ * expression.
+ */
+struct test_args_s
+{
+    char **argv;
+    int    argc, i;
+};
+
+int test_or(struct test_args_s *args);
+
+
+/*
+ * evaluate a primary expression, which is a parenthesized expression, a unary
+ * or binary operator with its operands, or a string.
+ */
+int test_primary(struct test_args_s *args)
+{
+    char **argv = args->argv;
+    int i = args->i, res;
+    enum cond_op_e op;
+
+    if(i >= args->argc)
+    {
+        fprintf(stderr, "%s: argument expected\n", test_name);
+        return -1;
+    }
+
+    if(strcmp(argv[i], "(") == 0)
+    {
+        args->i++;
+        if((res = test_or(args)) < 0)
+        {
+            return res;
+        }
+        if(args->i >= args->argc || strcmp(argv[args->i], ")") != 0)
+        {
+            fprintf(stderr, "%s: missing ')'\n", test_name);
+            return -1;
+        }
+        args->i++;
+        return res;
+    }
+
+    if(i+2 < args->argc && (op = test_binary_op(argv[i+1])))
+    {
+        args->i += 3;
+        return test_binary(op, argv[i], argv[i+2]);
+    }
+
+    if((op = get_cond_op(argv[i], COND_UNARY)) && i+1 < args->argc)
+    {
+        args->i += 2;
+        return cond_unary(op, argv[i+1]);
+    }
+
+    args->i++;
+    return !!*argv[i];
+}
+
+
+/*
+ * evaluate a negation, or a primary expression.
+ */
+int test_not(struct test_args_s *args)
+{
+    if(args->i < args->argc && strcmp(args->argv[args->i], "!") == 0)
+    {
+        args->i++;
+        int res = test_not(args);
+        return (res < 0) ? res : !res;
+    }
+    return test_primary(args);
+}
+
+
+/*
+ * evaluate expressions joined by -a.
+ */
+int test_and(struct test_args_s *args)
+{
+    int res = test_not(args);
+
+    while(res >= 0 && args->i < args->argc && strcmp(args->argv[args->i], "-a") == 0)
+    {
+        args->i++;
+        int res2 = test_not(args);
+        res = (res2 < 0) ? res2 : (res && res2);
+    }
+    return res;
+}
+
+
+/*
+ * evaluate expressions joined by -o.
+ */
+int test_or(struct test_args_s *args)
+{
+    int res = test_and(args);
+
+    while(res >= 0 && args->i < args->argc && strcmp(args->argv[args->i], "-o") == 0)
+    {
+        args->i++;
+        int res2 = test_and(args);
+        res = (res2 < 0) ? res2 : (res || res2);
+    }
+    return res;
+}
+
+
+/*
+ * evaluate the expression in the given arguments.. expressions of up to four
+ * arguments are evaluated according to their number, as POSIX says, which
+ * resolves the ambiguous cases (like [ ! = x ]).. longer expressions are
+ * parsed with the usual precedence rules.
+ *
+ * returns 1 if the expression is true, 0 if false, -1 on error.
+ */
+int test_eval(char **argv, int argc)
+{
+    struct test_args_s args = { .argv = argv, .argc = argc, .i = 0 };
+    enum cond_op_e op;
+    int res;
+
+    switch(argc)
+    {
+        case 0:
+            return 0;
+
+        case 1:
+            return !!*argv[0];
+
+        case 2:
+            if(strcmp(argv[0], "!") == 0)
+            {
+                return !*argv[1];
+            }
+            if((op = get_cond_op(argv[0], COND_UNARY)))
+            {
+                return cond_unary(op, argv[1]);
+            }
+            fprintf(stderr, "%s: %s: unary operator expected\n", test_name, argv[0]);
+            return -1;
+
+        case 3:
+            if((op = test_binary_op(argv[1])))
+            {
+                return test_binary(op, argv[0], argv[2]);
+            }
+            if(strcmp(argv[1], "-a") == 0)
+            {
+                return *argv[0] && *argv[2];
+            }
+            if(strcmp(argv[1], "-o") == 0)
+            {
+                return *argv[0] || *argv[2];
+            }
+            if(strcmp(argv[0], "!") == 0)
+            {
+                res = test_eval(argv+1, 2);
+                return (res < 0) ? res : !res;
+            }
+            if(strcmp(argv[0], "(") == 0 && strcmp(argv[2], ")") == 0)
+            {
+                return !!*argv[1];
+            }
+            break;
+
+        case 4:
+            if(strcmp(argv[0], "!") == 0)
+            {
+                res = test_eval(argv+1, 3);
+                return (res < 0) ? res : !res;
+            }
+            if(strcmp(argv[0], "(") == 0 && strcmp(argv[3], ")") == 0)
+            {
+                return test_eval(argv+1, 2);
+            }
+            break;
+    }
+
+    if((res = test_or(&args)) >= 0 && args.i < argc)
+    {
+        fprintf(stderr, "%s: %s: too many arguments\n", test_name, argv[args.i]);
+        return -1;
+    }
+    return res;
+}
+
+
+/*
+ * the test (and [) builtin utility, which evaluates a conditional expression..
+ * usage:
+ *
+ *     test expr
+ *     [ expr ]
+ *
+ * the operators are the same as those of [[ ]] (except =~), with -a and -o
+ * instead of && and ||, and no pattern matching.
+ *
+ * returns 0 if the expression is true, 1 if false, 2 on error.
+ */
+int test(int argc, char **argv)
+{
+    test_name = argv[0];
+
+    if(strcmp(argv[0], "[") == 0)
+    {
+        if(strcmp(argv[argc-1], "]") != 0)
+        {
+            fprintf(stderr, "%s: missing ']'\n", argv[0]);
+            return 2;
+        }
+        argc--;
+    }
+
+    int res = test_eval(argv+1, argc-1);
+    cond_flush_stat_cache();
+    return (res < 0) ? 2 : !res;
+}
@@ -0,0 +1,394 @@
+/*
+ *    Programmed By: Mohammed Isam [mohammed_isam1984@yahoo.com]
+ *    Copyright 2020 (c)
+ *
+ *    file: cond.c
+ *    This file is part of the "Let's Build a Linux Shell" tutorial.
+ *
+ *    This tutorial is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This tutorial is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this tutorial.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE         /* AT_EACCESS */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include "shell.h"
+#include "cond.h"
+#include "symtab/symtab.h"
+
+
+/*
+ * the operators of conditional expressions, which are shared by the [[ ]]
+ * compound command and the test builtin.
+ */
+struct cond_op_s cond_ops[] =
+{
+    { "-a" , COND_UNARY , COND_EXISTS   },
+    { "-b" , COND_UNARY , COND_BLK      },
+    { "-c" , COND_UNARY , COND_CHR      },
+    { "-d" , COND_UNARY , COND_DIR      },
+    { "-e" , COND_UNARY , COND_EXISTS   },
+    { "-f" , COND_UNARY , COND_REG      },
+    { "-g" , COND_UNARY , COND_SETGID   },
+    { "-h" , COND_UNARY , COND_LINK     },
+    { "-k" , COND_UNARY , COND_STICKY   },
+    { "-n" , COND_UNARY , COND_NONZERO  },
+    { "-p" , COND_UNARY , COND_FIFO     },
+    { "-r" , COND_UNARY , COND_READ     },
+    { "-s" , COND_UNARY , COND_NONEMPTY },
+    { "-t" , COND_UNARY , COND_TTY      },
+    { "-u" , COND_UNARY , COND_SETUID   },
+    { "-v" , COND_UNARY , COND_VARSET   },
+    { "-w" , COND_UNARY , COND_WRITE    },
+    { "-x" , COND_UNARY , COND_EXEC     },
+    { "-z" , COND_UNARY , COND_ZERO     },
+    { "-G" , COND_UNARY , COND_GROUP    },
+    { "-L" , COND_UNARY , COND_LINK     },
+    { "-N" , COND_UNARY , COND_MODIFIED },
+    { "-O" , COND_UNARY , COND_OWNER    },
+    { "-S" , COND_UNARY , COND_SOCK     },
+    { "-nt", COND_BINARY, COND_NEWER    },
+    { "-ot", COND_BINARY, COND_OLDER    },
+    { "-ef", COND_BINARY, COND_SAMEFILE },
+    { "="  , COND_BINARY, COND_STR_EQ   },
+    { "==" , COND_BINARY, COND_STR_EQ   },
+    { "!=" , COND_BINARY, COND_STR_NE   },
+    { "<"  , COND_BINARY, COND_STR_LT   },
+    { ">"  , COND_BINARY, COND_STR_GT   },
+    { "=~" , COND_BINARY, COND_REGEX    },
+    { "-eq", COND_BINARY, COND_INT_EQ   },
+    { "-ne", COND_BINARY, COND_INT_NE   },
+    { "-lt", COND_BINARY, COND_INT_LT   },
+    { "-le", COND_BINARY, COND_INT_LE   },
+    { "-gt", COND_BINARY, COND_INT_GT   },
+    { "-ge", COND_BINARY, COND_INT_GE   },
+};
+
+int cond_ops_count = sizeof(cond_ops)/sizeof(struct cond_op_s);
+
+
+/*
+ * find the operator with the given name and type.
+ *
+ * returns the operator, or 0 if there's no such operator.
+ */
+enum cond_op_e get_cond_op(char *name, int type)
+{
+    int i;
+
+    /* all operators are short, and start with '-', '=', '!', '<' or '>' */
+    if(!name || !strchr("-=!<>", *name) || !name[0] || (name[1] && name[2] && name[3]))
+    {
+        return 0;
+    }
+
+    for(i = 0; i < cond_ops_count; i++)
+    {
+        if(cond_ops[i].type == type && strcmp(cond_ops[i].name, name) == 0)
+        {
+            return cond_ops[i].op;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * the file status cache.. while evaluating an expression, we keep the status
+ * of the last few files we've checked, so that an expression which applies
+ * several tests to the same file (like [ -f file -a -r file -a -s file ]) only
+ * asks the kernel once.. we use statx() to ask only for the fields we need,
+ * which the filesystem may be able to answer more cheaply.. the cache is
+ * flushed when the evaluation is done.
+ */
+#define COND_STAT_CACHE     4
+
+struct cond_stat_s
+{
+    char   *path;                       /* the file's path, NULL if unused */
+    int     nofollow;                   /* did we follow symlinks? */
+    unsigned int mask;                  /* the fields we've asked for */
+    int     res;                        /* statx() result (0 or -1) */
+    struct  statx stx;                  /* the file's status */
+};
+
+struct cond_stat_s cond_stat_cache[COND_STAT_CACHE];
+int    cond_stat_next = 0;
+
+
+/*
+ * flush the file status cache.
+ */
+void cond_flush_stat_cache(void)
+{
+    int i;
+    for(i = 0; i < COND_STAT_CACHE; i++)
+    {
+        free(cond_stat_cache[i].path);
+        cond_stat_cache[i].path = NULL;
+    }
+    cond_stat_next = 0;
+}
+
+
+/*
+ * get the status of the given file, asking for (at least) the fields in mask.
+ *
+ * returns the status, or NULL if the file doesn't exist (or can't be reached).
+ */
+struct statx *cond_stat(char *path, int nofollow, unsigned int mask)
+{
+    struct cond_stat_s *cs = NULL;
+    int i;
+
+    for(i = 0; i < COND_STAT_CACHE; i++)
+    {
+        struct cond_stat_s *cs2 = &cond_stat_cache[i];
+        if(cs2->path && cs2->nofollow == nofollow && strcmp(cs2->path, path) == 0)
+        {
+            if(cs2->res != 0 || (cs2->mask & mask) == mask)
+            {
+                return cs2->res ? NULL : &cs2->stx;
+            }
+            /* ask again for the fields we had, and the new ones */
+            mask |= cs2->mask;
+            cs = cs2;
+            break;
+        }
+    }
+
+    if(!cs)
+    {
+        cs = &cond_stat_cache[cond_stat_next];
+        cond_stat_next = (cond_stat_next+1) % COND_STAT_CACHE;
+        free(cs->path);
+        /* if we can't save the path, the entry just won't be reused */
+        if((cs->path = malloc(strlen(path)+1)))
+        {
+            strcpy(cs->path, path);
+        }
+    }
+
+    cs->nofollow = nofollow;
+    cs->mask     = mask;
+    cs->res      = statx(AT_FDCWD, path, nofollow ? AT_SYMLINK_NOFOLLOW : 0, mask, &cs->stx);
+    if(cs->res != 0 && errno == ENOSYS)
+    {
+        /* the kernel doesn't have statx(). fill in the fields from stat() */
+        struct stat st;
+        if((cs->res = fstatat(AT_FDCWD, path, &st, nofollow ? AT_SYMLINK_NOFOLLOW : 0)) == 0)
+        {
+            memset(&cs->stx, 0, sizeof(struct statx));
+            cs->stx.stx_mode  = st.st_mode;
+            cs->stx.stx_uid   = st.st_uid;
+            cs->stx.stx_gid   = st.st_gid;
+            cs->stx.stx_size  = st.st_size;
+            cs->stx.stx_ino   = st.st_ino;
+            cs->stx.stx_dev_major   = major(st.st_dev);
+            cs->stx.stx_dev_minor   = minor(st.st_dev);
+            cs->stx.stx_atime.tv_sec  = st.st_atim.tv_sec;
+            cs->stx.stx_atime.tv_nsec = st.st_atim.tv_nsec;
+            cs->stx.stx_mtime.tv_sec  = st.st_mtim.tv_sec;
+            cs->stx.stx_mtime.tv_nsec = st.st_mtim.tv_nsec;
+        }
+    }
+    return cs->res ? NULL : &cs->stx;
+}
+
+
+/*
+ * evaluate a unary operator on the given argument.
+ *
+ * returns 1 if the condition is true, 0 otherwise.
+ */
+int cond_unary(enum cond_op_e op, char *arg)
+{
+    struct statx *stx;
+    unsigned int mask;
+
+    switch(op)
+    {
+        case COND_ZERO:
+            return !*arg;
+
+        case COND_NONZERO:
+            return !!*arg;
+
+        case COND_VARSET:
+        {
+            struct symtab_entry_s *entry = get_symtab_entry(arg);
+            return entry && symtab_entry_getval(entry);
+        }
+
+        case COND_TTY:
+            return isatty(atoi(arg));
+
+        case COND_READ:
+            return faccessat(AT_FDCWD, arg, R_OK, AT_EACCESS) == 0;
+
+        case COND_WRITE:
+            return faccessat(AT_FDCWD, arg, W_OK, AT_EACCESS) == 0;
+
+        case COND_EXEC:
+            return faccessat(AT_FDCWD, arg, X_OK, AT_EACCESS) == 0;
+
+        case COND_LINK:
+            stx = cond_stat(arg, 1, STATX_TYPE);
+            return stx && S_ISLNK(stx->stx_mode);
+
+        default:
+            break;
+    }
+
+    /* the rest of the operators need some of the file's status fields */
+    switch(op)
+    {
+        case COND_SETGID  :
+        case COND_SETUID  :
+        case COND_STICKY  : mask = STATX_MODE                  ; break;
+        case COND_NONEMPTY: mask = STATX_SIZE                  ; break;
+        case COND_OWNER   : mask = STATX_UID                   ; break;
+        case COND_GROUP   : mask = STATX_GID                   ; break;
+        case COND_MODIFIED: mask = STATX_MTIME | STATX_ATIME   ; break;
+        default           : mask = STATX_TYPE                  ; break;
+    }
+
+    if(!(stx = cond_stat(arg, 0, mask)))
+    {
+        return 0;
+    }
+
+    switch(op)
+    {
+        case COND_EXISTS  : return 1;
+        case COND_REG     : return S_ISREG(stx->stx_mode);
+        case COND_DIR     : return S_ISDIR(stx->stx_mode);
+        case COND_BLK     : return S_ISBLK(stx->stx_mode);
+        case COND_CHR     : return S_ISCHR(stx->stx_mode);
+        case COND_FIFO    : return S_ISFIFO(stx->stx_mode);
+        case COND_SOCK    : return S_ISSOCK(stx->stx_mode);
+        case COND_SETGID  : return !!(stx->stx_mode & S_ISGID);
+        case COND_SETUID  : return !!(stx->stx_mode & S_ISUID);
+        case COND_STICKY  : return !!(stx->stx_mode & S_ISVTX);
+        case COND_NONEMPTY: return (stx->stx_size > 0);
+        case COND_OWNER   : return (stx->stx_uid == geteuid());
+        case COND_GROUP   : return (stx->stx_gid == getegid());
+        case COND_MODIFIED: return (stx->stx_mtime.tv_sec > stx->stx_atime.tv_sec);
+        default           : return 0;
+    }
+}
+
+
+/*
+ * compare two file modification times.
+ */
+static inline int cmp_mtime(struct statx *stx1, struct statx *stx2)
+{
+    if(stx1->stx_mtime.tv_sec != stx2->stx_mtime.tv_sec)
+    {
+        return (stx1->stx_mtime.tv_sec < stx2->stx_mtime.tv_sec) ? -1 : 1;
+    }
+    if(stx1->stx_mtime.tv_nsec != stx2->stx_mtime.tv_nsec)
+    {
+        return (stx1->stx_mtime.tv_nsec < stx2->stx_mtime.tv_nsec) ? -1 : 1;
+    }
+    return 0;
+}
+
+
+/*
+ * evaluate a binary file or string operator on the given arguments.. the
+ * string operators compare the arguments as plain strings (the caller deals
+ * with pattern matching, if needed).
+ *
+ * returns 1 if the condition is true, 0 otherwise.
+ */
+int cond_binary(enum cond_op_e op, char *arg1, char *arg2)
+{
+    struct statx *stx1, *stx2;
+    struct statx st1;           /* our copy of stx1 (see below) */
+
+    switch(op)
+    {
+        case COND_STR_EQ:
+            return strcmp(arg1, arg2) == 0;
+
+        case COND_STR_NE:
+            return strcmp(arg1, arg2) != 0;
+
+        case COND_STR_LT:
+            return strcoll(arg1, arg2) < 0;
+
+        case COND_STR_GT:
+            return strcoll(arg1, arg2) > 0;
+
+        case COND_NEWER:
+        case COND_OLDER:
+            /* a file that exists is newer than one that doesn't */
+            /*
+             * stx1 points into the status cache, and the second lookup may
+             * reuse its slot.. so copy it first.
+             */
+            if((stx1 = cond_stat(arg1, 0, STATX_MTIME)))
+            {
+                st1  = *stx1;
+                stx1 = &st1;
+            }
+            stx2 = cond_stat(arg2, 0, STATX_MTIME);
+            if(!stx1 || !stx2)
+            {
+                return (op == COND_NEWER) ? (stx1 && !stx2) : (!stx1 && stx2);
+            }
+            return (op == COND_NEWER) ? (cmp_mtime(stx1, stx2) > 0) :
+                                        (cmp_mtime(stx1, stx2) < 0);
+
+        case COND_SAMEFILE:
+            if((stx1 = cond_stat(arg1, 0, STATX_INO)))
+            {
+                st1  = *stx1;
+                stx1 = &st1;
+            }
+            stx2 = cond_stat(arg2, 0, STATX_INO);
+            return stx1 && stx2 && stx1->stx_ino == stx2->stx_ino &&
+                   stx1->stx_dev_major == stx2->stx_dev_major &&
+                   stx1->stx_dev_minor == stx2->stx_dev_minor;
+
+        default:
+            return 0;
+    }
+}
+
+
+/*
+ * evaluate a binary integer operator on the given numbers.
+ *
+ * returns 1 if the condition is true, 0 otherwise.
+ */
+int cond_int_compare(enum cond_op_e op, long n1, long n2)
+{
+    switch(op)
+    {
+        case COND_INT_EQ: return n1 == n2;
+        case COND_INT_NE: return n1 != n2;
+        case COND_INT_LT: return n1 <  n2;
+        case COND_INT_LE: return n1 <= n2;
+        case COND_INT_GT: return n1 >  n2;
+        case COND_INT_GE: return n1 >= n2;
+        default         : return 0;
+    }
+}
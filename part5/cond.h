@@ -0,0 +1,97 @@
+/*
+ *    Programmed By: Mohammed Isam [mohammed_isam1984@yahoo.com]
+ *    Copyright 2020 (c)
+ *
+ *    file: cond.h
+ *    This file is part of the "Let's Build a Linux Shell" tutorial.
+ *
+ *    This tutorial is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This tutorial is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this tutorial.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COND_H
+#define COND_H
+
+/* the operators of conditional expressions */
+enum cond_op_e
+{
+    /* the logical operators */
+    COND_AND = 1,       /* expr && expr */
+    COND_OR,            /* expr || expr */
+    COND_NOT,           /* ! expr */
+
+    /* unary file operators */
+    COND_EXISTS,        /* -e and -a */
+    COND_REG,           /* -f */
+    COND_DIR,           /* -d */
+    COND_BLK,           /* -b */
+    COND_CHR,           /* -c */
+    COND_FIFO,          /* -p */
+    COND_SOCK,          /* -S */
+    COND_LINK,          /* -h and -L */
+    COND_SETGID,        /* -g */
+    COND_SETUID,        /* -u */
+    COND_STICKY,        /* -k */
+    COND_NONEMPTY,      /* -s */
+    COND_OWNER,         /* -O */
+    COND_GROUP,         /* -G */
+    COND_MODIFIED,      /* -N */
+    COND_READ,          /* -r */
+    COND_WRITE,         /* -w */
+    COND_EXEC,          /* -x */
+    COND_TTY,           /* -t */
+
+    /* unary string and variable operators */
+    COND_ZERO,          /* -z */
+    COND_NONZERO,       /* -n */
+    COND_VARSET,        /* -v */
+
+    /* binary file operators */
+    COND_NEWER,         /* -nt */
+    COND_OLDER,         /* -ot */
+    COND_SAMEFILE,      /* -ef */
+
+    /* binary string operators */
+    COND_STR_EQ,        /* = and == */
+    COND_STR_NE,        /* != */
+    COND_STR_LT,        /* < */
+    COND_STR_GT,        /* > */
+    COND_REGEX,         /* =~ */
+
+    /* binary integer operators */
+    COND_INT_EQ,        /* -eq */
+    COND_INT_NE,        /* -ne */
+    COND_INT_LT,        /* -lt */
+    COND_INT_LE,        /* -le */
+    COND_INT_GT,        /* -gt */
+    COND_INT_GE,        /* -ge */
+};
+
+/* the types of operators */
+#define COND_UNARY      1
+#define COND_BINARY     2
+
+struct cond_op_s
+{
+    char *name;                 /* the operator as written */
+    int   type;                 /* unary or binary */
+    enum  cond_op_e op;         /* the operator */
+};
+
+enum cond_op_e get_cond_op(char *name, int type);
+int  cond_unary(enum cond_op_e op, char *arg);
+int  cond_binary(enum cond_op_e op, char *arg1, char *arg2);
+int  cond_int_compare(enum cond_op_e op, long n1, long n2);
+void cond_flush_stat_cache(void);
+
+#endif
@@ -24,11 +24,50 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <ctype.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include "shell.h"
 #include "node.h"
 #include "executor.h"
+#include "symtab/symtab.h"
+#include "cond.h"
+
+
+/* the exit status of the last command */
+int exit_status = 0;
+
+/* the symbol table entry of the special parameter $? */
+struct symtab_entry_s *exit_status_entry = NULL;
+
+/* the number of loops we're executing, one inside the other */
+int loop_depth = 0;
+
+/*
+ * the number of loops left by a pending break or continue (see break.c), and
+ * whether the last of them goes on with its next iteration.
+ */
+int loop_jump = 0;
+int loop_continue = 0;
+
+
+/*
+ * set the exit status of the last command.. we also set the value of the
+ * special parameter $?, which is kept as a native integer.. initsh() calls
+ * us first, so the entry is added to the global symbol table.
+ */
+void set_exit_status(int status)
+{
+    exit_status = status;
+    if(!exit_status_entry)
+    {
+        exit_status_entry = add_to_symtab("?");
+    }
+    if(exit_status_entry)
+    {
+        symtab_entry_setlong(exit_status_entry, status);
+    }
+}
 
 
 char *search_path(char *file)
@@ -123,17 +162,729 @@ int do_exec_cmd(int argc, char **argv)
 }
 
 
+/*
+ * free the arguments list, whose strings are the rcstrs of the expanded words.
+ */
 static inline void free_argv(int argc, char **argv)
 {
-    if(!argc)
+    while(argc--)
     {
-        return;
+        rcstr_unref(argv[argc]);
     }
+    free(argv);
+}
 
-    while(argc--)
+
+/*
+ * split an element of an array assignment in the form [subscript]=value.
+ *
+ * returns a pointer to the value (and sets *subscript), or NULL if the element
+ * is not in this form.
+ */
+char *get_elem_subscript(char *elem, char **subscript)
+{
+    if(*elem != '[')
+    {
+        return NULL;
+    }
+
+    char *p = strstr(elem, "]=");
+    if(!p)
+    {
+        return NULL;
+    }
+    *p = '\0';
+    *subscript = elem+1;
+    return p+2;
+}
+
+
+/*
+ * perform an array assignment in the given (unexpanded) name=(value ...) word..
+ * the values are expanded (and split into fields) as if they were the words
+ * of a command.. a value in the form [subscript]=value sets the element with
+ * the given subscript (which is required for associative arrays), otherwise
+ * the value goes to the element after the previous one.
+ *
+ * returns 1 if the assignment is done, 0 on error.
+ */
+int do_array_assignment(char *word, size_t len)
+{
+    char name[len+1];
+    strncpy(name, word, len);
+    name[len] = '\0';
+
+    if(strchr(name, '['))
+    {
+        fprintf(stderr, "error: %s: cannot assign list to array member\n", name);
+        return 0;
+    }
+
+    struct symtab_entry_s *entry = get_symtab_entry(name);
+    if(!entry && !(entry = add_to_symtab(name)))
+    {
+        return 0;
+    }
+
+    /* the values between the parens */
+    size_t vlen = strlen(word+len+2)-1;
+    char   values[vlen+1], buf[32];
+    strncpy(values, word+len+2, vlen);
+    values[vlen] = '\0';
+
+    /* empty array */
+    char *p = values;
+    while(isspace(*p))
+    {
+        p++;
+    }
+    struct word_s *w = *p ? word_expand(values) : NULL, *w2;
+
+    if(entry->val_type == SYM_ASSOC)
+    {
+        assoc_clear(entry->assoc);
+    }
+    else if(symtab_entry_getarray(entry))
+    {
+        array_clear(entry->array);
+    }
+    else
+    {
+        free_all_words(w);
+        return 0;
+    }
+
+    int res = 1;
+    size_t index = 0;
+    for(w2 = w; w2; w2 = w2->next)
+    {
+        /* we're going to cut the [subscript] in place, so we need our own copy */
+        if(*w2->data == '[')
+        {
+            char *data = rcstr_unshare(w2->data, w2->len);
+            if(!data)
+            {
+                res = 0;
+                continue;
+            }
+            w2->data = data;
+        }
+
+        char *subscript, *val = get_elem_subscript(w2->data, &subscript);
+        if(!val)
+        {
+            if(entry->val_type == SYM_ASSOC)
+            {
+                fprintf(stderr, "error: %s: %s: must use subscript when assigning "
+                                "associative array\n", name, w2->data);
+                res = 0;
+                continue;
+            }
+            sprintf(buf, "%zu", index++);
+            subscript = buf;
+            val = w2->data;
+        }
+        else if(entry->val_type != SYM_ASSOC)
+        {
+            /* the following values go after this one */
+            if(!array_subscript(entry, subscript, &index))
+            {
+                res = 0;
+                continue;
+            }
+            sprintf(buf, "%zu", index++);
+            subscript = buf;
+        }
+
+        if(!symtab_entry_setelem(entry, subscript, val))
+        {
+            res = 0;
+        }
+    }
+
+    free_all_words(w);
+    return res;
+}
+
+
+/*
+ * check if the given (unexpanded) word is an array assignment name=(value ...).
+ *
+ * returns the length of the name part if it is, 0 otherwise.
+ */
+size_t is_array_assignment(char *word)
+{
+    size_t len = is_assignment(word);
+    return (len && word[len+1] == '(' && word[strlen(word)-1] == ')') ? len : 0;
+}
+
+
+/*
+ * perform the variable assignment in the given (unexpanded) name=value,
+ * name[subscript]=value or name=(value ...) word.
+ *
+ * returns 1 if the assignment is done, 0 on error.
+ */
+int do_assignment(char *word)
+{
+    size_t len = is_assignment(word);
+    if(!len)
+    {
+        return 0;
+    }
+
+    if(is_array_assignment(word))
+    {
+        return do_array_assignment(word, len);
+    }
+
+    char *str = word_expand_to_str(word);
+    if(!str || !(len = is_assignment(str)))
+    {
+        free(str);
+        return 0;
+    }
+
+    char name[len+1];
+    strncpy(name, str, len);
+    name[len] = '\0';
+
+    /* split the subscript (if any) from the name */
+    char *subscript = strchr(name, '[');
+    if(subscript)
+    {
+        *subscript++ = '\0';
+        name[len-1] = '\0';
+    }
+
+    struct symtab_entry_s *entry = get_symtab_entry(name);
+    int res = 0;
+    if(entry || (entry = add_to_symtab(name)))
+    {
+        res = subscript ? symtab_entry_setelem(entry, subscript, str+len+1) :
+                          symtab_entry_assign(entry, str+len+1);
+    }
+    free(str);
+    return res;
+}
+
+
+/*
+ * execute the given command node.
+ *
+ * returns 1 on success, 0 on error.
+ */
+int do_command(struct node_s *node)
+{
+    if(!node)
+    {
+        return 0;
+    }
+
+    /* directory listings are only reused within the same command */
+    flush_dir_cache();
+
+    switch(node->type)
+    {
+        case NODE_ARITHM:
+            return do_arithm_command(node);
+
+        case NODE_CASE:
+            return do_case_clause(node);
+
+        case NODE_COND:
+            return do_cond_command(node);
+
+        case NODE_FOR:
+            return do_for_loop(node);
+
+        case NODE_WHILE:
+        case NODE_UNTIL:
+            return do_while_loop(node);
+
+        default:
+            return do_simple_command(node);
+    }
+}
+
+
+/*
+ * execute an arithmetic command ((expr)).. the expression is evaluated in the
+ * shell, and the exit status is zero if the result is non-zero, 1 otherwise.
+ */
+int do_arithm_command(struct node_s *node)
+{
+    set_exit_status(arithm_cond(node->val.str));
+    return 1;
+}
+
+
+/*
+ * execute the commands in the given list.. the exit status is that of the
+ * last command, or zero if the list is empty.. a break or continue stops the
+ * list, and we leave it to the loop to deal with it.
+ */
+int do_list(struct node_s *node)
+{
+    struct node_s *child = node->first_child;
+
+    set_exit_status(0);
+    while(child && !loop_jump)
+    {
+        do_command(child);
+        child = child->next_sibling;
+    }
+    return 1;
+}
+
+
+/*
+ * execute a case clause.. the word is expanded and looked up in the clause's
+ * dispatch table, and the list of the first matching item is executed.. the
+ * exit status is zero if no pattern matches.
+ */
+int do_case_clause(struct node_s *node)
+{
+    char *word = word_expand_single(node->val.str);
+    if(!word)
+    {
+        set_exit_status(1);
+        return 0;
+    }
+
+    int i = case_table_lookup(node->case_table, word);
+    free(word);
+
+    struct node_s *item = (i < 0) ? NULL : node->first_child;
+    while(item && i-- > 0)
+    {
+        item = item->next_sibling;
+    }
+
+    if(!item)
+    {
+        set_exit_status(0);
+        return 1;
+    }
+
+    /* the item's list comes after its patterns */
+    struct node_s *list = item->first_child;
+    while(list->type != NODE_LIST)
+    {
+        list = list->next_sibling;
+    }
+    return do_list(list);
+}
+
+
+/*
+ * check for a pending break or continue after executing one of the lists of
+ * a loop.. each loop we leave takes one off the count, and the last one goes
+ * on with its next iteration if this is a continue.
+ *
+ * returns 1 if the loop should stop, 0 if it should go on.
+ */
+static inline int loop_done(void)
+{
+    if(!loop_jump)
+    {
+        return 0;
+    }
+    if(--loop_jump || !loop_continue)
+    {
+        return 1;
+    }
+    loop_continue = 0;
+    return 0;
+}
+
+
+/*
+ * execute a for loop.. the words are expanded once, before the first
+ * iteration, and each field is assigned to the loop's variable in turn before
+ * executing the body.. the exit status is that of the last command executed
+ * in the body, or zero if there was none.
+ */
+int do_for_loop(struct node_s *node)
+{
+    struct word_s *words = NULL, *tail = NULL, *w;
+    struct node_s *child = node->first_child;
+    int res = 1;
+
+    /* the words come before the body */
+    while(child->type != NODE_LIST)
+    {
+        if((w = word_expand(child->val.str)))
+        {
+            if(tail)
+            {
+                tail->next = w;
+            }
+            else
+            {
+                words = w;
+            }
+            for(tail = w; tail->next; tail = tail->next)
+            {
+                ;
+            }
+        }
+        child = child->next_sibling;
+    }
+
+    set_exit_status(0);
+    loop_depth++;
+    for(w = words; w; w = w->next)
+    {
+        struct symtab_entry_s *entry = add_to_symtab(node->val.str);
+        if(!entry || !symtab_entry_assign(entry, w->data))
+        {
+            set_exit_status(1);
+            res = 0;
+            break;
+        }
+
+        do_list(child);
+        if(loop_done())
+        {
+            break;
+        }
+    }
+    loop_depth--;
+
+    free_all_words(words);
+    return res;
+}
+
+
+/*
+ * execute a while or until loop.. the body is executed as long as the exit
+ * status of the condition is zero (for while) or non-zero (for until).. the
+ * exit status is that of the last command executed in the body, or zero if
+ * there was none.
+ */
+int do_while_loop(struct node_s *node)
+{
+    struct node_s *cond = node->first_child;
+    struct node_s *body = cond->next_sibling;
+    int until = (node->type == NODE_UNTIL);
+    int status = 0;
+
+    loop_depth++;
+    while(1)
+    {
+        do_list(cond);
+        if(loop_done())
+        {
+            status = exit_status;
+            break;
+        }
+        if((exit_status == 0) == until)
+        {
+            break;
+        }
+
+        do_list(body);
+        status = exit_status;
+        if(loop_done())
+        {
+            break;
+        }
+    }
+    loop_depth--;
+
+    set_exit_status(status);
+    return 1;
+}
+
+
+/*
+ * match str against the extended regex in the given (unexpanded) word.. on
+ * success, the matched string and the parenthesized subexpressions are saved
+ * in the $BASH_REMATCH array.
+ *
+ * returns 1 if str matches, 0 if not, -1 if the regex is invalid.
+ */
+int cond_regex_match(char *str, char *word)
+{
+    char *p = word_expand_pattern(word, "\\.[]()*+?{}|^$");
+    if(!p)
+    {
+        return -1;
+    }
+
+    regex_t *re = get_regex(p, REG_EXTENDED);
+    free(p);
+    if(!re)
+    {
+        return -1;
+    }
+
+    size_t nmatch = re->re_nsub+1, i;
+    regmatch_t match[nmatch];
+    if(regexec(re, str, nmatch, match, 0) != 0)
+    {
+        return 0;
+    }
+
+    struct symtab_entry_s *entry = add_to_symtab("BASH_REMATCH");
+    struct symtab_array_s *arr;
+    if(!entry || !(arr = symtab_entry_getarray(entry)))
+    {
+        return 1;
+    }
+
+    array_clear(arr);
+    for(i = 0; i < nmatch; i++)
+    {
+        /* unmatched subexpressions give empty strings */
+        size_t len = (match[i].rm_so < 0) ? 0 : (size_t)(match[i].rm_eo-match[i].rm_so);
+        if(!array_setn(arr, i, len ? str+match[i].rm_so : "", len))
+        {
+            break;
+        }
+    }
+    return 1;
+}
+
+
+/*
+ * match str against the glob pattern in the given (unexpanded) word.
+ *
+ * returns 1 if str matches, 0 if not, -1 on error.
+ */
+int cond_pattern_match(char *str, char *word)
+{
+    char *pat = word_expand_pattern(word, "*?[]\\");
+    if(!pat)
     {
-        free(argv[argc]);
+        return -1;
+    }
+
+    struct glob_pat_s *gpat = get_glob_pat(pat);
+    int res = gpat ? glob_match(gpat, str) : -1;
+    release_glob_pat(gpat);
+    free(pat);
+    return res;
+}
+
+
+/*
+ * evaluate a binary operator of a conditional expression.. the right operand
+ * of == and != is a pattern, and that of =~ is a regex.. the operands of the
+ * integer operators are arithmetic expressions.
+ *
+ * returns 1 if the condition is true, 0 if false, -1 on error.
+ */
+int eval_cond_binary(enum cond_op_e op, char *word1, char *word2)
+{
+    char *arg1 = word_expand_single(word1), *arg2 = NULL;
+    long  n1, n2;
+    int   res = -1;
+
+    if(!arg1)
+    {
+        return -1;
+    }
+
+    switch(op)
+    {
+        case COND_STR_EQ:
+        case COND_STR_NE:
+            res = cond_pattern_match(arg1, word2);
+            if(op == COND_STR_NE && res >= 0)
+            {
+                res = !res;
+            }
+            break;
+
+        case COND_REGEX:
+            res = cond_regex_match(arg1, word2);
+            break;
+
+        case COND_INT_EQ:
+        case COND_INT_NE:
+        case COND_INT_LT:
+        case COND_INT_LE:
+        case COND_INT_GT:
+        case COND_INT_GE:
+            if((arg2 = word_expand_single(word2)) &&
+               arithm_eval(arg1, &n1) && arithm_eval(arg2, &n2))
+            {
+                res = cond_int_compare(op, n1, n2);
+            }
+            break;
+
+        default:
+            if((arg2 = word_expand_single(word2)))
+            {
+                res = cond_binary(op, arg1, arg2);
+            }
+            break;
     }
+
+    free(arg1);
+    free(arg2);
+    return res;
+}
+
+
+/*
+ * evaluate a conditional expression tree.
+ *
+ * returns 1 if the expression is true, 0 if false, -1 on error.
+ */
+int eval_cond(struct node_s *node)
+{
+    struct node_s *child = node->first_child;
+    int res;
+
+    if(node->type == NODE_VAR)
+    {
+        char *word = word_expand_single(node->val.str);
+        if(!word)
+        {
+            return -1;
+        }
+        res = !!*word;
+        free(word);
+        return res;
+    }
+
+    switch(node->val.sint)
+    {
+        case COND_AND:
+            res = eval_cond(child);
+            return (res == 1) ? eval_cond(child->next_sibling) : res;
+
+        case COND_OR:
+            res = eval_cond(child);
+            return (res == 0) ? eval_cond(child->next_sibling) : res;
+
+        case COND_NOT:
+            res = eval_cond(child);
+            return (res < 0) ? res : !res;
+
+        default:
+            if(child->next_sibling)
+            {
+                return eval_cond_binary(node->val.sint, child->val.str,
+                                        child->next_sibling->val.str);
+            }
+            char *arg = word_expand_single(child->val.str);
+            if(!arg)
+            {
+                return -1;
+            }
+            res = cond_unary(node->val.sint, arg);
+            free(arg);
+            return res;
+    }
+}
+
+
+/*
+ * execute a conditional command [[ expr ]].. the exit status is zero if the
+ * expression is true, 1 if false, and 2 on error.
+ */
+int do_cond_command(struct node_s *node)
+{
+    int res = eval_cond(node->first_child);
+    cond_flush_stat_cache();
+    set_exit_status((res < 0) ? 2 : !res);
+    return 1;
+}
+
+
+/*
+ * the value a variable had before a prefix assignment changed it for the
+ * duration of a builtin.
+ */
+struct saved_var_s
+{
+    struct symtab_entry_s *entry;   /* the variable */
+    char  *val;                     /* its old value, NULL if it had none */
+    int    is_new;                  /* did the assignment add the variable? */
+    unsigned char val_type;         /* its type when we saved it */
+};
+
+
+/*
+ * perform the prefix assignments of a builtin, saving the old values of the
+ * variables so restore_vars() can put them back when the builtin is done..
+ * assignments to array elements (and of whole arrays) are not undone.
+ *
+ * returns the saved variables, which are *nsaved in number.
+ */
+struct saved_var_s *save_and_assign(int nassigns, char **assigns, int *nsaved)
+{
+    struct saved_var_s *saved = malloc(nassigns * sizeof(struct saved_var_s));
+    int i, n = 0;
+
+    for(i = 0; i < nassigns; i++)
+    {
+        size_t len = is_assignment(assigns[i]);
+        if(!saved || assigns[i][len-1] == ']' || is_array_assignment(assigns[i]))
+        {
+            do_assignment(assigns[i]);
+            continue;
+        }
+
+        char name[len+1];
+        strncpy(name, assigns[i], len);
+        name[len] = '\0';
+
+        struct symtab_entry_s *entry = get_symtab_entry(name);
+        char *val = entry ? symtab_entry_getval(entry) : NULL;
+        if(val && !(val = get_malloced_str(val)))
+        {
+            do_assignment(assigns[i]);
+            continue;
+        }
+
+        int is_new = !entry;
+        if(!do_assignment(assigns[i]) || !(entry = get_symtab_entry(name)))
+        {
+            free(val);
+            continue;
+        }
+
+        saved[n].entry    = entry;
+        saved[n].val      = val;
+        saved[n].is_new   = is_new;
+        saved[n].val_type = entry->val_type;
+        n++;
+    }
+
+    *nsaved = n;
+    return saved;
+}
+
+
+/*
+ * put back the values of the variables saved by save_and_assign(), in the
+ * reverse order, so a variable assigned twice gets its very first value.. a
+ * variable the builtin changed into (or from) an array is left alone.
+ */
+void restore_vars(struct saved_var_s *saved, int nsaved)
+{
+    while(nsaved--)
+    {
+        struct saved_var_s *s = &saved[nsaved];
+        if(s->entry->val_type == s->val_type)
+        {
+            if(s->is_new)
+            {
+                rem_from_symtab(s->entry, get_local_symtab());
+            }
+            else
+            {
+                symtab_entry_setval(s->entry, s->val);
+            }
+        }
+        free(s->val);
+    }
+    free(saved);
 }
 
 
@@ -154,10 +905,59 @@ int do_simple_command(struct node_s *node)
     int targc = 0;          /* total alloc'd arguments count */
     char **argv = NULL;
     char *str;
+    int nassigns = 0;       /* variable assignments count */
+    int tassigns = 0;       /* total alloc'd assignments count */
+    char **assigns = NULL;
+    int decl = 0;           /* is the command declare (or typeset)? */
+
+    /*
+     * the leading name=value words are variable assignments.. they are
+     * expanded when they are done, as array assignments expand their
+     * values one by one.
+     */
+    while(child && is_assignment(child->val.str))
+    {
+        str = malloc(strlen(child->val.str)+1);
+        if(str)
+        {
+            strcpy(str, child->val.str);
+            if(check_buffer_bounds(&nassigns, &tassigns, &assigns))
+            {
+                assigns[nassigns++] = str;
+            }
+            else
+            {
+                free(str);
+            }
+        }
+        child = child->next_sibling;
+    }
 
     while(child)
     {
         str = child->val.str;
+
+        /*
+         * declare's name=(value ...) arguments are array assignments, which
+         * expand (and split) their values themselves.. pass them on as they are.
+         */
+        if(decl && is_array_assignment(str))
+        {
+            if((str = rcstr_dup(str, strlen(str))))
+            {
+                if(check_buffer_bounds(&argc, &targc, &argv))
+                {
+                    argv[argc++] = str;
+                }
+                else
+                {
+                    rcstr_unref(str);
+                }
+            }
+            child = child->next_sibling;
+            continue;
+        }
+
         /*perform word expansion */
         struct word_s *w = word_expand(str);
         
@@ -168,24 +968,25 @@ int do_simple_command(struct node_s *node)
             continue;
         }
 
-        /* add the words to the arguments list */
+        /*
+         * move the words' strings to the arguments list (no need to copy them,
+         * even if they are shared with a variable, as no one changes them).
+         */
         struct word_s *w2 = w;
         while(w2)
         {
             if(check_buffer_bounds(&argc, &targc, &argv))
             {
-                str = malloc(strlen(w2->data)+1);
-                if(str)
-                {
-                    strcpy(str, w2->data);
-                    argv[argc++] = str;
-                }
+                argv[argc++] = w2->data;
+                w2->data = NULL;
             }
             w2 = w2->next;
         }
         
         /* free the memory used by the expanded words */
         free_all_words(w);
+
+        decl = argc && (strcmp(argv[0], "declare") == 0 || strcmp(argv[0], "typeset") == 0);
         
         /* check the next word */
         child = child->next_sibling;
@@ -199,44 +1000,102 @@ int do_simple_command(struct node_s *node)
     }
 
     int i = 0;
+
+    /* no command word. the assignments affect the shell itself */
+    if(argc == 0)
+    {
+        int status = 0;
+        for( ; i < nassigns; i++)
+        {
+            if(!do_assignment(assigns[i]))
+            {
+                status = 1;
+            }
+        }
+        set_exit_status(status);
+        free_buffer(nassigns, assigns);
+        free(argv);
+        return 1;
+    }
+
     for( ; i < builtins_count; i++)
     {
         if(strcmp(argv[0], builtins[i].name) == 0)
         {
-            builtins[i].func(argc, argv);
-            free_buffer(argc, argv);
+            /* the assignments last as long as the builtin */
+            int nsaved = 0;
+            struct saved_var_s *saved = save_and_assign(nassigns, assigns, &nsaved);
+            set_exit_status(builtins[i].func(argc, argv));
+            restore_vars(saved, nsaved);
+            free_argv(argc, argv);
+            free_buffer(nassigns, assigns);
             return 1;
         }
     }
 
+    /* the assignments go to the command's environment */
+    for(i = 0; i < nassigns; i++)
+    {
+        if((str = word_expand_to_str(assigns[i])))
+        {
+            free(assigns[i]);
+            assigns[i] = str;
+        }
+    }
+
+    /* don't let the child inherit (and flush) our buffered output */
+    flush_output();
+
     pid_t child_pid = 0;
     if((child_pid = fork()) == 0)
     {
+        /* the assignments go to the command's environment */
+        for(i = 0; i < nassigns; i++)
+        {
+            putenv(assigns[i]);
+        }
         do_exec_cmd(argc, argv);
         fprintf(stderr, "error: failed to execute command: %s\n", strerror(errno));
-        if(errno == ENOEXEC)
+        /*
+         * use _exit(), as exit() would rewind the stdin we share with the
+         * parent to where stdio thinks we are.. so flush our output first.
+         */
+        int err = errno;
+        flush_output();
+        if(err == ENOEXEC)
         {
-            exit(126);
+            _exit(126);
         }
-        else if(errno == ENOENT)
+        else if(err == ENOENT)
         {
-            exit(127);
+            _exit(127);
         }
         else
         {
-            exit(EXIT_FAILURE);
+            _exit(EXIT_FAILURE);
         }
     }
     else if(child_pid < 0)
     {
         fprintf(stderr, "error: failed to fork command: %s\n", strerror(errno));
-	free_buffer(argc, argv);
+        set_exit_status(EXIT_FAILURE);
+	free_argv(argc, argv);
+        free_buffer(nassigns, assigns);
         return 0;
     }
 
     int status = 0;
     waitpid(child_pid, &status, 0);
-    free_buffer(argc, argv);
+    if(WIFSIGNALED(status))
+    {
+        set_exit_status(128+WTERMSIG(status));
+    }
+    else
+    {
+        set_exit_status(WEXITSTATUS(status));
+    }
+    free_argv(argc, argv);
+    free_buffer(nassigns, assigns);
     
     return 1;
 }
@@ -26,6 +26,15 @@
 
 char *search_path(char *file);
 int do_exec_cmd(int argc, char **argv);
+size_t is_array_assignment(char *word);
+int do_array_assignment(char *word, size_t len);
+int do_command(struct node_s *node);
 int do_simple_command(struct node_s *node);
+int do_arithm_command(struct node_s *node);
+int do_case_clause(struct node_s *node);
+int do_list(struct node_s *node);
+int do_cond_command(struct node_s *node);
+int do_for_loop(struct node_s *node);
+int do_while_loop(struct node_s *node);
 
 #endif
@@ -20,6 +20,7 @@
  */
 
 #include <string.h>
+#include <locale.h>
 #include "shell.h"
 #include "symtab/symtab.h"
 
@@ -27,8 +28,14 @@ extern char **environ;
 
 void initsh()
 {
+    init_output();
     init_symtab();
 
+    /* pathname expansion results are sorted in the user's collation order */
+    setlocale(LC_COLLATE, "");
+    /* and ${var^^} and ${var,,} use the user's case mappings */
+    setlocale(LC_CTYPE, "");
+
     struct symtab_entry_s *entry;
     char **p2 = environ;
     
@@ -63,4 +70,7 @@ void initsh()
 
     entry = add_to_symtab("PS2");
     symtab_entry_setval(entry, "> ");
+
+    /* add the special parameter $? */
+    set_exit_status(0);
 }
@@ -23,17 +23,148 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "shell.h"
 #include "source.h"
 #include "parser.h"
 #include "executor.h"
 
 
+/* the lowest fd we move a script file to */
+#define SCRIPT_FD_MIN       10
+
+/*
+ * commands are read with read() and not stdio, as stdio reads ahead of the
+ * line we want, taking input that belongs to the commands that read the same
+ * stdin (such as the read builtin or cat).. like the read builtin, we read big
+ * blocks from seekable files and seek back to the end of the line, and read
+ * pipes one byte at a time (a terminal gives us one line per read() anyway)..
+ * a script file has an fd of its own, so we keep what we read ahead of the
+ * line for the next one.
+ */
+#define CMD_BLOCK_SIZE      4096
+
+struct cmd_input_s
+{
+    int    fd;
+    int    shared;                      /* do our commands read this fd too? */
+    int    seekable;
+    size_t chunk;                       /* how much we read at a time */
+    char   buf[CMD_BLOCK_SIZE];
+    size_t len, pos;
+};
+
+/* where we read commands from */
+struct cmd_input_s cmd_input;
+
+
+/*
+ * start reading commands from the given fd.
+ */
+void init_cmd_input(int fd, int shared)
+{
+    int tty = isatty(fd);
+    cmd_input.fd       = fd;
+    cmd_input.shared   = shared;
+    cmd_input.seekable = !tty && lseek(fd, 0, SEEK_CUR) >= 0;
+    cmd_input.chunk    = (!shared || tty || cmd_input.seekable) ? CMD_BLOCK_SIZE : 1;
+    cmd_input.len      = 0;
+    cmd_input.pos      = 0;
+}
+
+
+/*
+ * read a line of commands, just like fgets() does.
+ *
+ * returns buf, or NULL on EOF (or error) before reading anything.
+ */
+char *cmd_gets(char *buf, int size)
+{
+    struct cmd_input_s *in = &cmd_input;
+    int len = 0;
+
+    while(len < size-1)
+    {
+        if(in->pos == in->len)
+        {
+            ssize_t n;
+            do
+            {
+                n = read(in->fd, in->buf, in->chunk);
+            } while(n < 0 && errno == EINTR);
+
+            if(n <= 0)
+            {
+                break;
+            }
+            in->len = n;
+            in->pos = 0;
+        }
+
+        char c = in->buf[in->pos++];
+        buf[len++] = c;
+        if(c == '\n')
+        {
+            break;
+        }
+    }
+
+    /* give back what we've read past the line */
+    if(in->shared && in->seekable && in->pos < in->len)
+    {
+        lseek(in->fd, -(off_t)(in->len-in->pos), SEEK_CUR);
+        in->len = 0;
+        in->pos = 0;
+    }
+
+    if(!len)
+    {
+        return NULL;
+    }
+    buf[len] = '\0';
+    return buf;
+}
+
+
 int main(int argc, char **argv)
 {
     char *cmd;
 
     initsh();
+    init_cmd_input(0, 1);
+
+    /*
+     * with no arguments, we read commands from the standard input.. otherwise
+     * the first argument is a script file to run, and the rest become its
+     * positional parameters.
+     */
+    if(argc > 1)
+    {
+        /*
+         * the script gets its own fd, out of the way of the ones the user's
+         * commands use, and closed in the commands we fork.. the standard
+         * input is left alone, so the script's commands can read it.
+         */
+        int fd = open(argv[1], O_RDONLY);
+        int fd2 = (fd < 0) ? -1 : fcntl(fd, F_DUPFD_CLOEXEC, SCRIPT_FD_MIN);
+        if(fd >= 0)
+        {
+            close(fd);
+        }
+        if(fd2 < 0)
+        {
+            fprintf(stderr, "error: %s: %s\n", argv[1], strerror(errno));
+            exit(127);
+        }
+        init_cmd_input(fd2, 0);
+        interactive = 0;
+        init_pos_params(argv[1], argc-2, argv+2);
+    }
+    else
+    {
+        init_pos_params(argv[0], 0, argv+1);
+    }
     
     do
     {
@@ -58,7 +189,8 @@ int main(int argc, char **argv)
         src.bufsize  = strlen(cmd);
         src.curpos   = INIT_SRC_POS;
         parse_and_execute(&src);
-        free(cmd);
+        /* the parser might have read more lines into the buffer */
+        free(src.buffer);
     } while(1);
     exit(EXIT_SUCCESS);
 }
@@ -68,8 +200,8 @@ char *read_cmd(void)
 {
     char buf[1024];
     char *ptr = NULL;
-    char ptrlen = 0;
-    while(fgets(buf, 1024, stdin))
+    int  ptrlen = 0;
+    while(cmd_gets(buf, 1024))
     {
         int buflen = strlen(buf);
         if(!ptr)
@@ -111,10 +243,50 @@ char *read_cmd(void)
 }
 
 
+/*
+ * read another line of input and add it to the end of the source buffer.. the
+ * parser calls us when a compound command continues on the next line.
+ *
+ * returns 1 on success, 0 on EOF or error.
+ */
+int read_more_input(struct source_s *src)
+{
+    print_prompt2();
+    char *cmd = read_cmd();
+    if(!cmd)
+    {
+        return 0;
+    }
+
+    size_t len = strlen(cmd);
+    char *buf = realloc(src->buffer, src->bufsize+len+1);
+    if(!buf)
+    {
+        fprintf(stderr, "error: failed to alloc buffer: %s\n", strerror(errno));
+        free(cmd);
+        return 0;
+    }
+
+    memcpy(buf+src->bufsize, cmd, len+1);
+    /* reading past the end left curpos there. continue with the new line */
+    if(src->curpos > src->bufsize-1)
+    {
+        src->curpos = src->bufsize-1;
+    }
+    src->buffer   = buf;
+    src->bufsize += len;
+    free(cmd);
+    return 1;
+}
+
+
 int parse_and_execute(struct source_s *src)
 {
     skip_white_spaces(src);
 
+    /* discard any token left over from a previous syntax error */
+    unget_token(NULL);
+
     struct token_s *tok = tokenize(src);
 
     if(tok == &eof_token)
@@ -124,14 +296,14 @@ int parse_and_execute(struct source_s *src)
 
     while(tok && tok != &eof_token)
     {
-        struct node_s *cmd = parse_simple_command(tok);
+        struct node_s *cmd = parse_command(tok);
 
         if(!cmd)
         {
             break;
         }
 
-        do_simple_command(cmd);
+        do_command(cmd);
         free_node_tree(cmd);
         tok = tokenize(src);
     }
@@ -112,6 +112,11 @@ void free_node_tree(struct node_s *node)
         child = next;
     }
     
+    if(node->case_table)
+    {
+        free_case_table(node->case_table);
+    }
+
     if(node->val_type == VAL_STR)
     {
         if(node->val.str)
@@ -26,6 +26,15 @@ enum node_type_e
 {
     NODE_COMMAND,           /* simple command */
     NODE_VAR,               /* variable name (or simply, a word) */
+    NODE_ARITHM,            /* arithmetic command ((expr)) */
+    NODE_CASE,              /* case clause */
+    NODE_CASE_ITEM,         /* case item (the patterns, followed by a list) */
+    NODE_LIST,              /* list of commands */
+    NODE_COND,              /* conditional command [[ expr ]] */
+    NODE_COND_OP,           /* operator in a conditional expression */
+    NODE_FOR,               /* for loop */
+    NODE_WHILE,             /* while loop */
+    NODE_UNTIL,             /* until loop */
 };
 
 enum val_type_e
@@ -58,6 +67,7 @@ struct node_s
     enum   val_type_e val_type; /* type of this node's val field */
     union  symval_u val;        /* value of this node */
     int    children;            /* number of child nodes */
+    struct case_table_s *case_table;    /* compiled patterns of a case clause */
     struct node_s *first_child; /* first child node */
     struct node_s *next_sibling, *prev_sibling; /*
                                                  * if this is a child node, keep
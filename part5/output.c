@@ -0,0 +1,176 @@
+/*
+ *    Programmed By: Mohammed Isam [mohammed_isam1984@yahoo.com]
+ *    Copyright 2020 (c)
+ *
+ *    file: output.c
+ *    This file is part of the "Let's Build a Linux Shell" tutorial.
+ *
+ *    This tutorial is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This tutorial is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this tutorial.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE         /* fopencookie() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "shell.h"
+
+
+/*
+ * the shell's output buffers.. stdout and stderr are replaced by streams that
+ * write to these buffers, so that the builtins and the shell's own messages
+ * don't cost a write() call each.. a buffer is flushed when it is full, before
+ * we fork, when we print a prompt, and at exit.. if the fd refers to a terminal,
+ * we also flush after each newline.
+ *
+ * as both streams usually end up at the same place (the terminal, or the same
+ * file with 2>&1), we flush the other buffer before writing to one of them,
+ * which keeps the output in the order it was produced.
+ */
+#define OUTBUF_SIZE     8192
+
+struct outbuf_s
+{
+    int    fd;                          /* the file descriptor we write to */
+    int    tty;                         /* is fd a terminal? */
+    size_t len;                         /* number of bytes in the buffer */
+    char   buf[OUTBUF_SIZE];
+};
+
+struct outbuf_s outbufs[2] =
+{
+    { .fd = 1 },
+    { .fd = 2 },
+};
+
+
+/*
+ * write the given bytes to fd, retrying after interrupts and short writes.
+ *
+ * returns 1 on success, 0 on error.
+ */
+int write_all(int fd, char *buf, size_t len)
+{
+    while(len)
+    {
+        ssize_t n = write(fd, buf, len);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return 0;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 1;
+}
+
+
+/*
+ * write out the contents of the given buffer.. on error, the contents are
+ * discarded (there's no one to tell about it anyway).
+ *
+ * returns 1 on success, 0 on error.
+ */
+int flush_outbuf(struct outbuf_s *out)
+{
+    int res = write_all(out->fd, out->buf, out->len);
+    out->len = 0;
+    return res;
+}
+
+
+/*
+ * flush both of the shell's output buffers.
+ */
+void flush_output(void)
+{
+    flush_outbuf(&outbufs[0]);
+    flush_outbuf(&outbufs[1]);
+}
+
+
+/*
+ * the write function of our streams.. stdio calls it with the output of each
+ * fprintf(), fwrite() and so on (our streams are unbuffered as far as stdio
+ * is concerned, the buffering is done here).
+ *
+ * returns the number of bytes written, or -1 on error (which sets the error
+ * indicator of the stream, so that builtins can report a failure).
+ */
+ssize_t outbuf_write(void *cookie, const char *buf, size_t size)
+{
+    struct outbuf_s *out = cookie;
+    struct outbuf_s *other = &outbufs[out == &outbufs[0]];
+
+    if(other->len)
+    {
+        flush_outbuf(other);
+    }
+
+    if(out->len+size > OUTBUF_SIZE && !flush_outbuf(out))
+    {
+        return -1;
+    }
+
+    /* too big to buffer */
+    if(size > OUTBUF_SIZE)
+    {
+        return write_all(out->fd, (char *)buf, size) ? (ssize_t)size : -1;
+    }
+
+    memcpy(out->buf+out->len, buf, size);
+    out->len += size;
+
+    if(out->tty && memchr(buf, '\n', size) && !flush_outbuf(out))
+    {
+        return -1;
+    }
+    return size;
+}
+
+
+/*
+ * replace stdout and stderr with streams that write to our output buffers.
+ */
+void init_output(void)
+{
+    cookie_io_functions_t funcs = { .write = outbuf_write };
+    FILE *streams[2];
+    int i;
+
+    for(i = 0; i < 2; i++)
+    {
+        outbufs[i].tty = isatty(outbufs[i].fd);
+        if(!(streams[i] = fopencookie(&outbufs[i], "w", funcs)))
+        {
+            fprintf(stderr, "error: failed to buffer output: %s\n", strerror(errno));
+            if(i)
+            {
+                fclose(streams[0]);
+            }
+            return;
+        }
+        setvbuf(streams[i], NULL, _IONBF, 0);
+    }
+
+    fflush(stdout);
+    stdout = streams[0];
+    stderr = streams[1];
+    atexit(flush_output);
+}
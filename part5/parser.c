@@ -20,11 +20,867 @@
  */
 
 #include <unistd.h>
+#include <stdio.h>
+#include <string.h>
 #include "shell.h"
 #include "parser.h"
 #include "scanner.h"
 #include "node.h"
 #include "source.h"
+#include "cond.h"
+
+
+/*
+ * check if the given token is an operator, i.e. one of ';', ';;', '|', '||',
+ * '(' or ')'.
+ *
+ * returns 1 if the token is an operator, 0 otherwise.
+ */
+int is_operator(struct token_s *tok)
+{
+    char c = tok->text[0];
+    if(c != ';' && c != '|' && c != '(' && c != ')')
+    {
+        return 0;
+    }
+    return tok->text_len == 1 || (tok->text_len == 2 && tok->text[1] == c && c != '(');
+}
+
+
+/*
+ * get the next token, reading more input when we reach the end of the source
+ * (which happens when a compound command spans multiple lines).
+ *
+ * returns the token, or &eof_token if there's no more input.
+ */
+struct token_s *tokenize_more(struct source_s *src)
+{
+    struct token_s *tok;
+    while((tok = tokenize(src)) == &eof_token)
+    {
+        if(!read_more_input(src))
+        {
+            return &eof_token;
+        }
+    }
+    return tok;
+}
+
+
+/*
+ * get the next token that is not a newline, reading more input as needed.
+ */
+struct token_s *tokenize_skip_newlines(struct source_s *src)
+{
+    struct token_s *tok;
+    while((tok = tokenize_more(src)) != &eof_token && tok->text[0] == '\n')
+    {
+        free_token(tok);
+    }
+    return tok;
+}
+
+
+/*
+ * check the token that follows a compound command.. a newline or a ';' is
+ * consumed, while other operators are left for the caller to deal with.
+ *
+ * returns 1 if the token is valid, 0 on syntax error.
+ */
+int parse_cmd_end(struct source_s *src)
+{
+    struct token_s *tok = tokenize(src);
+    if(tok == &eof_token)
+    {
+        return 1;
+    }
+
+    if(tok->text[0] == '\n' || (tok->text[0] == ';' && tok->text_len == 1))
+    {
+        free_token(tok);
+        return 1;
+    }
+
+    if(is_operator(tok))
+    {
+        unget_token(tok);
+        return 1;
+    }
+
+    fprintf(stderr, "error: syntax error near token: %s\n", tok->text);
+    free_token(tok);
+    return 0;
+}
+
+
+/*
+ * parse a command.. a command starting with '((' is an arithmetic command,
+ * one starting with the 'case' keyword is a case clause, one starting with
+ * 'for', 'while' or 'until' is a loop, anything else is a simple command.
+ */
+struct node_s *parse_command(struct token_s *tok)
+{
+    if(!tok)
+    {
+        return NULL;
+    }
+
+    if(is_operator(tok))
+    {
+        fprintf(stderr, "error: syntax error near token: %s\n", tok->text);
+        free_token(tok);
+        return NULL;
+    }
+
+    if(tok->text[0] == '(' && tok->text[1] == '(')
+    {
+        return parse_arithm_command(tok);
+    }
+
+    if(strcmp(tok->text, "case") == 0)
+    {
+        return parse_case_clause(tok);
+    }
+
+    if(strcmp(tok->text, "[[") == 0)
+    {
+        return parse_cond_command(tok);
+    }
+
+    if(strcmp(tok->text, "for") == 0)
+    {
+        return parse_for_loop(tok);
+    }
+
+    if(strcmp(tok->text, "while") == 0 || strcmp(tok->text, "until") == 0)
+    {
+        return parse_while_loop(tok);
+    }
+
+    /* these can only come after a loop's condition or words */
+    if(strcmp(tok->text, "do") == 0 || strcmp(tok->text, "done") == 0)
+    {
+        fprintf(stderr, "error: syntax error near token: %s\n", tok->text);
+        free_token(tok);
+        return NULL;
+    }
+
+    return parse_simple_command(tok);
+}
+
+
+/*
+ * parse an arithmetic command in the form ((expr)).. the node's value is the
+ * expression without the (( and )), which is evaluated as is when the command
+ * is executed (just like the expression in an $((expr)) expansion).
+ */
+struct node_s *parse_arithm_command(struct token_s *tok)
+{
+    struct source_s *src = tok->src;
+    char *text = tok->text;
+    int   len  = tok->text_len;
+
+    if(len < 4 || text[len-1] != ')' || text[len-2] != ')')
+    {
+        fprintf(stderr, "error: syntax error near token: %s\n", text);
+        free_token(tok);
+        return NULL;
+    }
+
+    struct node_s *cmd = new_node(NODE_ARITHM);
+    if(!cmd)
+    {
+        free_token(tok);
+        return NULL;
+    }
+
+    text[len-2] = '\0';
+    set_node_val_str(cmd, text+2);
+    free_token(tok);
+
+    if(!parse_cmd_end(src))
+    {
+        free_node_tree(cmd);
+        return NULL;
+    }
+
+    return cmd;
+}
+
+
+/*
+ * parse a case clause in the form:
+ *
+ *     case word in [(]pattern[|pattern]...) list;; ... esac
+ *
+ * the node's value is the word, and its children are the case items.. each
+ * item has the patterns as its first children, followed by the list of
+ * commands to execute.. the patterns are compiled into the clause's dispatch
+ * table as we go, so they're not compiled every time the clause is executed.
+ */
+struct node_s *parse_case_clause(struct token_s *tok)
+{
+    struct source_s *src = tok->src;
+    int items = 0;
+
+    free_token(tok);
+
+    struct node_s *cmd = new_node(NODE_CASE);
+    if(!cmd)
+    {
+        return NULL;
+    }
+
+    if(!(cmd->case_table = new_case_table()))
+    {
+        fprintf(stderr, "error: insufficient memory\n");
+        free_node_tree(cmd);
+        return NULL;
+    }
+
+    /* the word to match, followed by 'in' */
+    tok = tokenize(src);
+    if(tok == &eof_token || tok->text[0] == '\n' || is_operator(tok))
+    {
+        goto syntax_error;
+    }
+    set_node_val_str(cmd, tok->text);
+    free_token(tok);
+
+    tok = tokenize_skip_newlines(src);
+    if(tok == &eof_token || strcmp(tok->text, "in") != 0)
+    {
+        goto syntax_error;
+    }
+    free_token(tok);
+
+    while(1)
+    {
+        tok = tokenize_skip_newlines(src);
+        if(tok == &eof_token)
+        {
+            goto syntax_error;
+        }
+
+        if(strcmp(tok->text, "esac") == 0)
+        {
+            free_token(tok);
+            break;
+        }
+
+        struct node_s *item = new_node(NODE_CASE_ITEM);
+        if(!item)
+        {
+            free_token(tok);
+            free_node_tree(cmd);
+            return NULL;
+        }
+        add_child_node(cmd, item);
+
+        /* the patterns, with an optional leading '(' */
+        if(tok->text[0] == '(' && tok->text_len == 1)
+        {
+            free_token(tok);
+            tok = tokenize(src);
+        }
+
+        while(1)
+        {
+            if(tok == &eof_token || tok->text[0] == '\n' || is_operator(tok))
+            {
+                goto syntax_error;
+            }
+
+            struct node_s *word = new_node(NODE_VAR);
+            if(!word || !case_table_add(cmd->case_table, tok->text, items))
+            {
+                fprintf(stderr, "error: insufficient memory\n");
+                free_node_tree(word);
+                free_token(tok);
+                free_node_tree(cmd);
+                return NULL;
+            }
+            set_node_val_str(word, tok->text);
+            add_child_node(item, word);
+            free_token(tok);
+
+            tok = tokenize(src);
+            if(tok == &eof_token || !is_operator(tok))
+            {
+                goto syntax_error;
+            }
+            if(tok->text[0] == ')')
+            {
+                free_token(tok);
+                break;
+            }
+            if(tok->text[0] != '|' || tok->text_len != 1)
+            {
+                goto syntax_error;
+            }
+            free_token(tok);
+            tok = tokenize(src);
+        }
+
+        /* the list of commands, up to ';;' or 'esac' */
+        struct node_s *list = new_node(NODE_LIST);
+        if(!list)
+        {
+            free_node_tree(cmd);
+            return NULL;
+        }
+        add_child_node(item, list);
+        items++;
+
+        while(1)
+        {
+            tok = tokenize_skip_newlines(src);
+            if(tok == &eof_token)
+            {
+                goto syntax_error;
+            }
+
+            if(strcmp(tok->text, ";;") == 0)
+            {
+                free_token(tok);
+                break;
+            }
+
+            if(strcmp(tok->text, "esac") == 0)
+            {
+                unget_token(tok);
+                break;
+            }
+
+            struct node_s *cmd2 = parse_command(tok);
+            if(!cmd2)
+            {
+                free_node_tree(cmd);
+                return NULL;
+            }
+            add_child_node(list, cmd2);
+        }
+    }
+
+    if(!parse_cmd_end(src))
+    {
+        free_node_tree(cmd);
+        return NULL;
+    }
+
+    return cmd;
+
+syntax_error:
+    if(tok == &eof_token)
+    {
+        fprintf(stderr, "error: syntax error: unexpected end of input in case clause\n");
+    }
+    else
+    {
+        fprintf(stderr, "error: syntax error near token: %s\n",
+                (tok->text[0] == '\n') ? "newline" : tok->text);
+        free_token(tok);
+    }
+    free_node_tree(cmd);
+    return NULL;
+}
+
+
+/*
+ * parse the list of commands in a loop, up to the given keyword (which is
+ * consumed).. the list is parsed only once, and the loop executes the same
+ * tree in each iteration.
+ *
+ * returns the list node, or NULL on error.
+ */
+struct node_s *parse_loop_list(struct source_s *src, char *keyword)
+{
+    struct node_s *list = new_node(NODE_LIST);
+    struct token_s *tok;
+
+    if(!list)
+    {
+        return NULL;
+    }
+
+    while(1)
+    {
+        tok = tokenize_skip_newlines(src);
+        if(tok == &eof_token)
+        {
+            fprintf(stderr, "error: syntax error: unexpected end of input "
+                            "(expecting '%s')\n", keyword);
+            free_node_tree(list);
+            return NULL;
+        }
+
+        if(strcmp(tok->text, keyword) == 0)
+        {
+            /* the list can't be empty */
+            if(!list->children)
+            {
+                fprintf(stderr, "error: syntax error near token: %s\n", tok->text);
+                free_token(tok);
+                free_node_tree(list);
+                return NULL;
+            }
+            free_token(tok);
+            return list;
+        }
+
+        struct node_s *cmd = parse_command(tok);
+        if(!cmd)
+        {
+            free_node_tree(list);
+            return NULL;
+        }
+        add_child_node(list, cmd);
+    }
+}
+
+
+/*
+ * parse a for loop in the form:
+ *
+ *     for name [in word...]; do list; done
+ *
+ * the node's value is the name, and its children are the words, followed by
+ * the list of commands.. with no 'in', the loop goes over the positional
+ * parameters, so we give it a "$@" word.
+ */
+struct node_s *parse_for_loop(struct token_s *tok)
+{
+    struct source_s *src = tok->src;
+
+    free_token(tok);
+
+    struct node_s *cmd = new_node(NODE_FOR);
+    if(!cmd)
+    {
+        return NULL;
+    }
+
+    /* the variable name */
+    tok = tokenize(src);
+    if(tok == &eof_token || tok->text[0] == '\n' || is_operator(tok))
+    {
+        goto syntax_error;
+    }
+    if(!is_name(tok->text))
+    {
+        fprintf(stderr, "error: invalid variable name in for loop: %s\n", tok->text);
+        free_token(tok);
+        free_node_tree(cmd);
+        return NULL;
+    }
+    set_node_val_str(cmd, tok->text);
+    free_token(tok);
+
+    /* the optional 'in' and the words after it, up to a newline or ';' */
+    tok = tokenize_skip_newlines(src);
+    if(tok != &eof_token && strcmp(tok->text, "in") == 0)
+    {
+        free_token(tok);
+        while((tok = tokenize(src)) != &eof_token && tok->text[0] != '\n' &&
+              !(tok->text[0] == ';' && tok->text_len == 1))
+        {
+            if(is_operator(tok))
+            {
+                goto syntax_error;
+            }
+
+            struct node_s *word = new_node(NODE_VAR);
+            if(!word)
+            {
+                free_token(tok);
+                free_node_tree(cmd);
+                return NULL;
+            }
+            set_node_val_str(word, tok->text);
+            add_child_node(cmd, word);
+            free_token(tok);
+        }
+        if(tok != &eof_token)
+        {
+            free_token(tok);
+        }
+        tok = tokenize_skip_newlines(src);
+    }
+    else
+    {
+        struct node_s *word = new_node(NODE_VAR);
+        if(!word)
+        {
+            if(tok != &eof_token)
+            {
+                free_token(tok);
+            }
+            free_node_tree(cmd);
+            return NULL;
+        }
+        set_node_val_str(word, "\"$@\"");
+        add_child_node(cmd, word);
+
+        /* 'for name;' is the same as 'for name' */
+        if(tok != &eof_token && tok->text[0] == ';' && tok->text_len == 1)
+        {
+            free_token(tok);
+            tok = tokenize_skip_newlines(src);
+        }
+    }
+
+    if(tok == &eof_token || strcmp(tok->text, "do") != 0)
+    {
+        goto syntax_error;
+    }
+    free_token(tok);
+
+    struct node_s *list = parse_loop_list(src, "done");
+    if(!list)
+    {
+        free_node_tree(cmd);
+        return NULL;
+    }
+    add_child_node(cmd, list);
+
+    if(!parse_cmd_end(src))
+    {
+        free_node_tree(cmd);
+        return NULL;
+    }
+
+    return cmd;
+
+syntax_error:
+    if(tok == &eof_token)
+    {
+        fprintf(stderr, "error: syntax error: unexpected end of input in for loop\n");
+    }
+    else
+    {
+        fprintf(stderr, "error: syntax error near token: %s\n",
+                (tok->text[0] == '\n') ? "newline" : tok->text);
+        free_token(tok);
+    }
+    free_node_tree(cmd);
+    return NULL;
+}
+
+
+/*
+ * parse a while or until loop in the form:
+ *
+ *     while list; do list; done
+ *     until list; do list; done
+ *
+ * the node's children are the list of commands that make the condition,
+ * followed by the loop's body.
+ */
+struct node_s *parse_while_loop(struct token_s *tok)
+{
+    struct source_s *src = tok->src;
+    enum node_type_e type = (strcmp(tok->text, "while") == 0) ? NODE_WHILE : NODE_UNTIL;
+
+    free_token(tok);
+
+    struct node_s *cmd = new_node(type);
+    if(!cmd)
+    {
+        return NULL;
+    }
+
+    struct node_s *cond = parse_loop_list(src, "do");
+    if(!cond)
+    {
+        free_node_tree(cmd);
+        return NULL;
+    }
+    add_child_node(cmd, cond);
+
+    struct node_s *body = parse_loop_list(src, "done");
+    if(!body)
+    {
+        free_node_tree(cmd);
+        return NULL;
+    }
+    add_child_node(cmd, body);
+
+    if(!parse_cmd_end(src))
+    {
+        free_node_tree(cmd);
+        return NULL;
+    }
+
+    return cmd;
+}
+
+
+/*
+ * the words of a conditional expression, and our position in them, as we
+ * parse the expression.
+ */
+struct cond_words_s
+{
+    char **words;
+    int    count, i;
+};
+
+struct node_s *parse_cond_or(struct cond_words_s *cw);
+
+
+/*
+ * check if the current word of the expression is the given one.
+ */
+static inline int cond_word_is(struct cond_words_s *cw, int i, char *word)
+{
+    return i < cw->count && strcmp(cw->words[i], word) == 0;
+}
+
+
+/*
+ * check if the given word can be an operand, i.e. it's not one of the
+ * operators that separate expressions.
+ */
+static inline int cond_is_operand(struct cond_words_s *cw, int i)
+{
+    return i < cw->count && !cond_word_is(cw, i, "&&") &&
+           !cond_word_is(cw, i, "||") && !cond_word_is(cw, i, ")");
+}
+
+
+/*
+ * create a node for an operator of the conditional expression.
+ */
+struct node_s *new_cond_op(enum cond_op_e op)
+{
+    struct node_s *node = new_node(NODE_COND_OP);
+    if(node)
+    {
+        node->val_type = VAL_SINT;
+        node->val.sint = op;
+    }
+    return node;
+}
+
+
+/*
+ * create a node for a word of the conditional expression and add it to the
+ * given operator node.
+ *
+ * returns 1 on success, 0 if insufficient memory.
+ */
+int add_cond_word(struct node_s *op, char *word)
+{
+    struct node_s *node = new_node(NODE_VAR);
+    if(!node)
+    {
+        return 0;
+    }
+    set_node_val_str(node, word);
+    add_child_node(op, node);
+    return 1;
+}
+
+
+/*
+ * parse a primary conditional expression, which is a parenthesized
+ * expression, a unary or binary operator with its operands, or a word.
+ */
+struct node_s *parse_cond_primary(struct cond_words_s *cw)
+{
+    struct node_s *node;
+    enum cond_op_e op;
+    int i = cw->i;
+
+    if(i >= cw->count)
+    {
+        return NULL;
+    }
+
+    if(cond_word_is(cw, i, "("))
+    {
+        cw->i++;
+        if(!(node = parse_cond_or(cw)))
+        {
+            return NULL;
+        }
+        if(!cond_word_is(cw, cw->i, ")"))
+        {
+            free_node_tree(node);
+            return NULL;
+        }
+        cw->i++;
+        return node;
+    }
+
+    if(!cond_is_operand(cw, i))
+    {
+        return NULL;
+    }
+
+    /* unary operator */
+    if((op = get_cond_op(cw->words[i], COND_UNARY)) && cond_is_operand(cw, i+1))
+    {
+        if(!(node = new_cond_op(op)) || !add_cond_word(node, cw->words[i+1]))
+        {
+            free_node_tree(node);
+            return NULL;
+        }
+        cw->i += 2;
+        return node;
+    }
+
+    /* binary operator */
+    if(i+2 < cw->count && (op = get_cond_op(cw->words[i+1], COND_BINARY)))
+    {
+        if(!(node = new_cond_op(op)) || !add_cond_word(node, cw->words[i]) ||
+           !add_cond_word(node, cw->words[i+2]))
+        {
+            free_node_tree(node);
+            return NULL;
+        }
+        cw->i += 3;
+        return node;
+    }
+
+    /* a lone word is true if its expansion is not empty */
+    if(!(node = new_node(NODE_VAR)))
+    {
+        return NULL;
+    }
+    set_node_val_str(node, cw->words[i]);
+    cw->i++;
+    return node;
+}
+
+
+/*
+ * parse a negation, or a primary expression.
+ */
+struct node_s *parse_cond_not(struct cond_words_s *cw)
+{
+    if(cond_word_is(cw, cw->i, "!"))
+    {
+        cw->i++;
+        struct node_s *node = parse_cond_not(cw);
+        struct node_s *op   = node ? new_cond_op(COND_NOT) : NULL;
+        if(!op)
+        {
+            free_node_tree(node);
+            return NULL;
+        }
+        add_child_node(op, node);
+        return op;
+    }
+    return parse_cond_primary(cw);
+}
+
+
+/*
+ * parse a list of expressions joined by the given operator, each parsed by
+ * the given function.
+ */
+struct node_s *parse_cond_list(struct cond_words_s *cw, char *opname, enum cond_op_e op,
+                               struct node_s *(*func)(struct cond_words_s *))
+{
+    struct node_s *node = func(cw);
+
+    while(node && cond_word_is(cw, cw->i, opname))
+    {
+        cw->i++;
+        struct node_s *node2 = func(cw);
+        struct node_s *op2   = node2 ? new_cond_op(op) : NULL;
+        if(!op2)
+        {
+            free_node_tree(node);
+            free_node_tree(node2);
+            return NULL;
+        }
+        add_child_node(op2, node);
+        add_child_node(op2, node2);
+        node = op2;
+    }
+    return node;
+}
+
+
+struct node_s *parse_cond_and(struct cond_words_s *cw)
+{
+    return parse_cond_list(cw, "&&", COND_AND, parse_cond_not);
+}
+
+
+struct node_s *parse_cond_or(struct cond_words_s *cw)
+{
+    return parse_cond_list(cw, "||", COND_OR, parse_cond_and);
+}
+
+
+/*
+ * parse a conditional command in the form [[ expr ]].. the expression is
+ * parsed into a tree of operator nodes, whose leaves are the (unexpanded)
+ * words.. the operand of the =~ operator is read as a regex, which can
+ * contain unquoted parentheses and '|' chars.
+ */
+struct node_s *parse_cond_command(struct token_s *tok)
+{
+    struct source_s *src = tok->src;
+    struct cond_words_s cw = { .words = NULL, .count = 0, .i = 0 };
+    struct node_s *cmd = NULL, *expr = NULL;
+    int size = 0, regex = 0;
+
+    free_token(tok);
+
+    /* collect the words up to the closing ']]' */
+    while(1)
+    {
+        tok = regex ? tokenize_regex(src) : tokenize_skip_newlines(src);
+        if(tok == &eof_token)
+        {
+            fprintf(stderr, "error: syntax error: unexpected end of input in conditional command\n");
+            goto end;
+        }
+        if(tok->text[0] == '\n' || (!regex && strcmp(tok->text, "]]") == 0))
+        {
+            free_token(tok);
+            break;
+        }
+        regex = (strcmp(tok->text, "=~") == 0);
+        if(!check_buffer_bounds(&cw.count, &size, &cw.words))
+        {
+            free_token(tok);
+            goto end;
+        }
+        cw.words[cw.count++] = tok->text;
+        tok->text = NULL;
+        free_token(tok);
+    }
+
+    if(!(expr = parse_cond_or(&cw)) || cw.i < cw.count)
+    {
+        fprintf(stderr, "error: syntax error in conditional expression near token: %s\n",
+                (cw.i < cw.count) ? cw.words[cw.i] : "]]");
+        free_node_tree(expr);
+        goto end;
+    }
+
+    if(!(cmd = new_node(NODE_COND)))
+    {
+        free_node_tree(expr);
+        goto end;
+    }
+    add_child_node(cmd, expr);
+
+    if(!parse_cmd_end(src))
+    {
+        free_node_tree(cmd);
+        cmd = NULL;
+    }
+
+end:
+    free_buffer(cw.count, cw.words);
+    return cmd;
+}
 
 
 struct node_s *parse_simple_command(struct token_s *tok)
@@ -45,12 +901,20 @@ struct node_s *parse_simple_command(struct token_s *tok)
     
     do
     {
-        if(tok->text[0] == '\n')
+        /* a newline or ';' ends the command */
+        if(tok->text[0] == '\n' || (tok->text[0] == ';' && tok->text_len == 1))
         {
             free_token(tok);
             break;
         }
 
+        /* other operators are left for the caller */
+        if(is_operator(tok))
+        {
+            unget_token(tok);
+            break;
+        }
+
         struct node_s *word = new_node(NODE_VAR);
         if(!word)
         {
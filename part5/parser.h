@@ -25,6 +25,16 @@
 #include "scanner.h"    /* struct token_s */
 #include "source.h"     /* struct source_s */
 
+struct node_s *parse_command(struct token_s *tok);
 struct node_s *parse_simple_command(struct token_s *tok);
+struct node_s *parse_arithm_command(struct token_s *tok);
+struct node_s *parse_case_clause(struct token_s *tok);
+struct node_s *parse_cond_command(struct token_s *tok);
+struct node_s *parse_for_loop(struct token_s *tok);
+struct node_s *parse_while_loop(struct token_s *tok);
+struct node_s *parse_loop_list(struct source_s *src, char *keyword);
+int    is_operator(struct token_s *tok);
+int    parse_cmd_end(struct source_s *src);
+struct token_s *tokenize_more(struct source_s *src);
 
 #endif
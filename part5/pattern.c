@@ -33,8 +33,13 @@
 #include <fnmatch.h>
 #include <locale.h>
 #include <glob.h>
+#include <stdint.h>
+#include <wctype.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include "shell.h"
+#include "symtab/symtab.h"
 
 
 /*
@@ -73,125 +78,2147 @@ int has_glob_chars(char *p, size_t len)
 
 
 /*
- * find the shortest or longest prefix of str that matches
- * pattern, depending on the value of longest.
- * return value is the index of 1 after the last character
- * in the prefix, i.e. where you should put a '\0' to get 
- * the prefix.
+ * glob patterns are compiled into a bit-parallel automaton (the shift-and
+ * algorithm, extended to handle '*'): each pattern element (a char, a '?', a
+ * bracket expression, or a '*') is one bit in a word, and bit j of the state
+ * is set if the first j elements match the chars we've seen so far.. for each
+ * char, the table entry accept[c] tells which (non-star) elements accept c.
+ * this allows us to find the shortest or longest anchored match in one pass
+ * over the string.. the suffix table is the same automaton built for the
+ * reversed pattern, which we run backwards from the end of the string.
+ *
+ * patterns with more elements than we can fit in a word are matched by
+ * calling fnmatch() (the slow way).
  */
-int match_prefix(char *pattern, char *str, int longest)
+#define GLOB_MAX_ELEMS      63
+
+struct glob_pat_s
 {
-    if(!pattern || !str)
+    char    *text;                      /* the pattern's text */
+    unsigned int hash;                  /* hash of the pattern's text */
+    int      refs;                      /* reference count */
+    int      nelems;                    /* number of pattern elements, -1 if too many */
+    uint64_t accept[256];               /* elements accepting each char (forward) */
+    uint64_t raccept[256];              /* the same, for the reversed pattern */
+    uint64_t star, rstar;               /* the '*' elements (forward and reversed) */
+    uint64_t final, rfinal;             /* the accepting state bit */
+    struct   glob_pat_s *next;          /* next pattern in the hash bucket */
+};
+
+
+/*
+ * parse a bracket expression, starting at the char after the '['.. the chars
+ * matched by the expression are marked in the set array.
+ *
+ * returns a pointer to the char after the closing ']', or NULL if the
+ * expression is not terminated (in which case the '[' is a literal char).
+ */
+char *parse_bracket_expr(char *p, char set[256])
+{
+    int neg = 0, c, first = 1;
+
+    memset(set, 0, 256);
+    if(*p == '!' || *p == '^')
     {
-        return 0;
+        neg = 1;
+        p++;
     }
-    char *s = str+1;
-    char  c = *s;
-    char *smatch = NULL;
-    char *lmatch = NULL;
-    while(c)
+
+    while(*p && (*p != ']' || first))
     {
-        *s = '\0';
-        if(fnmatch(pattern, str, 0) == 0)
+        first = 0;
+
+        /* character class, such as [:alpha:] */
+        if(p[0] == '[' && p[1] == ':')
         {
-            if(!smatch)
+            char *end = strstr(p+2, ":]");
+            if(end)
             {
-                if(!longest)
+                char name[end-p-1];
+                strncpy(name, p+2, end-p-2);
+                name[end-p-2] = '\0';
+                wctype_t type = wctype(name);
+                for(c = 1; c < 256; c++)
                 {
-                    *s = c;
-                    return s-str;
+                    if(type && iswctype(c, type))
+                    {
+                        set[c] = 1;
+                    }
                 }
-                smatch = s;
+                p = end+2;
+                continue;
+            }
+        }
+
+        if(*p == '\\' && p[1])
+        {
+            p++;
+        }
+        c = (unsigned char)*p++;
+
+        /* range, such as a-z */
+        if(p[0] == '-' && p[1] && p[1] != ']')
+        {
+            int c2;
+            p++;
+            if(*p == '\\' && p[1])
+            {
+                p++;
+            }
+            c2 = (unsigned char)*p++;
+            for( ; c <= c2; c++)
+            {
+                set[c] = 1;
             }
-            lmatch = s;
         }
-        *s = c;
-        c = *(++s);
+        else
+        {
+            set[c] = 1;
+        }
     }
-    /* check the result of the comparison */
-    if(lmatch)
+
+    if(*p != ']')
     {
-        return lmatch-str;
+        return NULL;
     }
-    if(smatch)
+
+    if(neg)
     {
-        return smatch-str;
+        for(c = 1; c < 256; c++)
+        {
+            set[c] = !set[c];
+        }
     }
-    return 0;
+    set[0] = 0;
+    return p+1;
 }
 
 
 /*
- * find the shortest or longest suffix of str that matches
- * pattern, depending on the value of longest.
- * return value is the index of the first character in the
- * matched suffix.
+ * compile the given glob pattern.
+ *
+ * returns the compiled pattern (with a reference count of 1), or NULL if
+ * insufficient memory.
  */
-int match_suffix(char *pattern, char *str, int longest)
+struct glob_pat_s *compile_glob(char *pattern, unsigned int hash)
 {
-    if(!pattern || !str)
+    struct glob_pat_s *pat = malloc(sizeof(struct glob_pat_s));
+    if(!pat)
     {
-        return 0;
+        return NULL;
+    }
+    memset(pat, 0, sizeof(struct glob_pat_s));
+
+    if(!(pat->text = malloc(strlen(pattern)+1)))
+    {
+        free(pat);
+        return NULL;
     }
-    char *s = str+strlen(str)-1;
-    char *smatch = NULL;
-    char *lmatch = NULL;
-    while(s > str)
+    strcpy(pat->text, pattern);
+    pat->hash = hash;
+    pat->refs = 1;
+
+    /* the chars accepted by each element */
+    char sets[GLOB_MAX_ELEMS][256];
+    int  stars[GLOB_MAX_ELEMS];
+    int  n = 0, c;
+    char *p = pattern, *p2;
+
+    while(*p)
     {
-        if(fnmatch(pattern, str, 0) == 0)
+        if(n >= GLOB_MAX_ELEMS)
         {
-            if(!smatch)
-            {
-                if(!longest)
+            /* too many elements. we'll use fnmatch() */
+            pat->nelems = -1;
+            return pat;
+        }
+
+        stars[n] = 0;
+        switch(*p)
+        {
+            case '*':
+                /* consecutive stars are the same as one star */
+                while(*p == '*')
+                {
+                    p++;
+                }
+                stars[n++] = 1;
+                continue;
+
+            case '?':
+                memset(sets[n], 1, 256);
+                sets[n][0] = 0;
+                p++;
+                break;
+
+            case '[':
+                if((p2 = parse_bracket_expr(p+1, sets[n])))
+                {
+                    p = p2;
+                    break;
+                }
+                /* unterminated bracket expression. fall through to match a '[' */
+                __attribute__((fallthrough));
+
+            default:
+                if(*p == '\\' && p[1])
                 {
-                    return s-str;
+                    p++;
                 }
-                smatch = s;
+                memset(sets[n], 0, 256);
+                sets[n][(unsigned char)*p++] = 1;
+                break;
+        }
+        n++;
+    }
+
+    /* build the forward and the reversed automata */
+    int j;
+    pat->nelems = n;
+    for(j = 0; j < n; j++)
+    {
+        uint64_t bit  = (uint64_t)1 << j;
+        uint64_t rbit = (uint64_t)1 << (n-1-j);
+        if(stars[j])
+        {
+            pat->star  |= bit;
+            pat->rstar |= rbit;
+            continue;
+        }
+        for(c = 1; c < 256; c++)
+        {
+            if(sets[j][c])
+            {
+                pat->accept [c] |= bit;
+                pat->raccept[c] |= rbit;
             }
-            lmatch = s;
         }
-        s--;
     }
-    /* check the result of the comparison */
-    if(lmatch)
+    pat->final  = (uint64_t)1 << n;
+    pat->rfinal = pat->final;
+    return pat;
+}
+
+
+/*
+ * follow the epsilon transitions from the '*' elements, which can match the
+ * empty string.
+ */
+static inline uint64_t glob_closure(uint64_t state, uint64_t star)
+{
+    return state | ((state & star) << 1);
+}
+
+
+/*
+ * run the automaton over len chars of str, stepping forward (dir == 1) or
+ * backward (dir == -1) from str.. stop at the first match if longest is zero.
+ *
+ * returns the number of chars in the match, or -1 if there is no match.
+ */
+int run_glob(uint64_t *accept, uint64_t star, uint64_t final,
+             char *str, size_t len, int dir, int longest)
+{
+    uint64_t state = glob_closure(1, star);
+    int match = -1;
+    size_t i = 0;
+
+    for(;;)
     {
-        return lmatch-str;
+        if(state & final)
+        {
+            match = i;
+            if(!longest)
+            {
+                break;
+            }
+        }
+
+        if(i == len || !state)
+        {
+            break;
+        }
+
+        unsigned char c = *str;
+        str += dir;
+        i++;
+
+        /* stars stay where they are, other elements advance if they accept c */
+        state = ((state & accept[c]) << 1) | (state & star);
+        state = glob_closure(state, star);
     }
-    if(smatch)
+
+    return match;
+}
+
+
+/*
+ * the compiled patterns cache, which is a small hash table.. when the table is
+ * full, we throw away the patterns in the bucket we are adding to.
+ */
+#define GLOB_CACHE_BUCKETS  64      /* hash table size (power of 2) */
+#define GLOB_CACHE_SIZE     64      /* max. number of cached patterns */
+
+struct glob_pat_s *glob_cache[GLOB_CACHE_BUCKETS];
+int    glob_cache_count = 0;
+
+
+/*
+ * release a reference to a compiled pattern, freeing it when the last
+ * reference is gone.
+ */
+void release_glob_pat(struct glob_pat_s *pat)
+{
+    if(pat && --pat->refs == 0)
     {
-        return smatch-str;
+        free(pat->text);
+        free(pat);
     }
-    return 0;
 }
 
 
 /*
- * perform pathname (or filename) expansion, matching files in the given *dir to the
- * given *path, which is treated as a regex pattern that specifies which filename(s)
- * we should match.
+ * get the compiled form of the given glob pattern, compiling it and adding
+ * it to the cache if it's not already there.
  *
- * returns a char ** pointer to the list of matched filenames, or NULL if nothing matched.
+ * returns the pattern with an extra reference the caller must release by
+ * calling release_glob_pat(), or NULL if insufficient memory.
  */
-char **get_filename_matches(char *pattern, glob_t *matches)
+struct glob_pat_s *get_glob_pat(char *pattern)
 {
-    /* to guard our caller from trying to free an unused struct in case of expansion failure */
-    matches->gl_pathc = 0;
-    matches->gl_pathv = NULL;
+    unsigned int hash = str_hash(pattern);
+    int bucket = hash & (GLOB_CACHE_BUCKETS-1);
+    struct glob_pat_s *pat = glob_cache[bucket];
+    while(pat)
+    {
+        if(pat->hash == hash && strcmp(pat->text, pattern) == 0)
+        {
+            pat->refs++;
+            return pat;
+        }
+        pat = pat->next;
+    }
 
-    if(!pattern)
+    if(!(pat = compile_glob(pattern, hash)))
     {
         return NULL;
     }
 
-    /* perform the match */
-    int res = glob(pattern, 0, NULL, matches);
+    /* make room by emptying the bucket */
+    if(glob_cache_count >= GLOB_CACHE_SIZE)
+    {
+        while(glob_cache[bucket])
+        {
+            struct glob_pat_s *next = glob_cache[bucket]->next;
+            release_glob_pat(glob_cache[bucket]);
+            glob_cache[bucket] = next;
+            glob_cache_count--;
+        }
+    }
+
+    /* one reference for the cache, and one for the caller */
+    pat->refs++;
+    pat->next = glob_cache[bucket];
+    glob_cache[bucket] = pat;
+    glob_cache_count++;
+    return pat;
+}
+
+
+/*
+ * find the shortest or longest prefix of the first len chars of str that
+ * matches the compiled pattern.
+ *
+ * returns the length of the matched prefix, or -1 if no prefix matches.
+ */
+int glob_match_prefix(struct glob_pat_s *pat, char *str, size_t len, int longest)
+{
+    if(pat->nelems >= 0)
+    {
+        return run_glob(pat->accept, pat->star, pat->final, str, len, 1, longest);
+    }
+
+    /* too many elements. try each prefix in a copy of the string */
+    char *s = malloc(len+1);
+    int i, match = -1;
+    if(!s)
+    {
+        return -1;
+    }
+    memcpy(s, str, len);
+    for(i = 0; i <= (int)len; i++)
+    {
+        char c = s[i];
+        s[i] = '\0';
+        if(fnmatch(pat->text, s, 0) == 0)
+        {
+            match = i;
+            if(!longest)
+            {
+                break;
+            }
+        }
+        s[i] = c;
+    }
+    free(s);
+    return match;
+}
+
+
+/*
+ * find the shortest or longest suffix of the first len chars of str that
+ * matches the compiled pattern.
+ *
+ * returns the index of the first char in the matched suffix, or -1 if no
+ * suffix matches.
+ */
+int glob_match_suffix(struct glob_pat_s *pat, char *str, size_t len, int longest)
+{
+    int i, match = -1;
+
+    if(pat->nelems >= 0)
+    {
+        i = run_glob(pat->raccept, pat->rstar, pat->rfinal, str+len-1, len, -1, longest);
+        return (i < 0) ? -1 : (int)len-i;
+    }
+
+    /* too many elements. try each suffix */
+    char *s = malloc(len+1);
+    if(!s)
+    {
+        return -1;
+    }
+    memcpy(s, str, len);
+    s[len] = '\0';
+    for(i = len; i >= 0; i--)
+    {
+        if(fnmatch(pat->text, s+i, 0) == 0)
+        {
+            match = i;
+            if(!longest)
+            {
+                break;
+            }
+        }
+    }
+    free(s);
+    return match;
+}
+
+
+/*
+ * check if the whole of str matches the compiled pattern.
+ *
+ * returns 1 if str matches, 0 otherwise.
+ */
+int glob_match(struct glob_pat_s *pat, char *str)
+{
+    if(pat->nelems < 0)
+    {
+        return fnmatch(pat->text, str, 0) == 0;
+    }
+
+    uint64_t state = glob_closure(1, pat->star);
+    while(*str && state)
+    {
+        state = ((state & pat->accept[(unsigned char)*str++]) << 1) | (state & pat->star);
+        state = glob_closure(state, pat->star);
+    }
+    return !*str && (state & pat->final);
+}
+
+
+/*
+ * find the shortest or longest prefix of str that matches
+ * pattern, depending on the value of longest.
+ * return value is the length of the matched prefix, i.e. the index
+ * of the first char after the prefix (0 if no prefix matches).
+ */
+int match_prefix(char *pattern, char *str, int longest)
+{
+    if(!pattern || !str)
+    {
+        return 0;
+    }
+    struct glob_pat_s *pat = get_glob_pat(pattern);
+    if(!pat)
+    {
+        return 0;
+    }
+    int i = glob_match_prefix(pat, str, strlen(str), longest);
+    release_glob_pat(pat);
+    return (i < 0) ? 0 : i;
+}
+
+
+/*
+ * find the shortest or longest suffix of str that matches
+ * pattern, depending on the value of longest.
+ * return value is the index of the first character in the
+ * matched suffix (the length of str if no suffix matches).
+ */
+int match_suffix(char *pattern, char *str, int longest)
+{
+    if(!pattern || !str)
+    {
+        return 0;
+    }
+    int len = strlen(str);
+    struct glob_pat_s *pat = get_glob_pat(pattern);
+    if(!pat)
+    {
+        return len;
+    }
+    int i = glob_match_suffix(pat, str, len, longest);
+    release_glob_pat(pat);
+    return (i < 0) ? len : i;
+}
+
+
+/*
+ * mark the positions in the first len chars of str where a match of the
+ * compiled pattern starts (starts[len] is for the empty match at the end)..
+ * we run the reversed automaton backwards over the string, adding the start
+ * state before each char, so that the automaton looks for matches ending
+ * anywhere after the current position.. this finds all the match starts in
+ * one pass.
+ */
+void glob_match_starts(struct glob_pat_s *pat, char *str, size_t len, char *starts)
+{
+    uint64_t init  = glob_closure(1, pat->rstar);
+    uint64_t state = 0;
+    size_t i = len;
+
+    starts[len] = !!(init & pat->rfinal);
+    while(i--)
+    {
+        state |= init;
+        state  = ((state & pat->raccept[(unsigned char)str[i]]) << 1) | (state & pat->rstar);
+        state  = glob_closure(state, pat->rstar);
+        starts[i] = !!(state & pat->rfinal);
+    }
+}
+
+
+/*
+ * replace the longest match of pattern in str with rep.. mode is '/' to
+ * replace all the matches, '#' to replace a match at the start of str, '%' to
+ * replace a match at the end of str, or 0 to replace the first match.
+ *
+ * matches are found from left to right, and we don't look for another match
+ * inside the one we have replaced, so replacing all the matches is one pass
+ * over str (after the pass that finds where the matches start, see
+ * glob_match_starts() above).
+ *
+ * returns the malloc'd result, or NULL if insufficient memory.
+ */
+char *replace_match(char *pattern, char *str, char *rep, int mode)
+{
+    size_t len = strlen(str), replen = strlen(rep);
+    size_t size = len+replen+1, n = 0, i = 0;
+    char  *res = NULL, *starts = NULL;
+    int    m;
 
-    /* return the result */
-    if(res != 0)
+    struct glob_pat_s *pat = get_glob_pat(pattern);
+    if(!pat || !(res = malloc(size)))
     {
-        globfree(matches);
+        release_glob_pat(pat);
         return NULL;
     }
 
-    return matches->gl_pathv;
+    if(mode == '#')
+    {
+        m = glob_match_prefix(pat, str, len, 1);
+        i = (m < 0) ? 0 : (size_t)m;
+    }
+    else if(mode == '%')
+    {
+        m = glob_match_suffix(pat, str, len, 1);
+        n = (m < 0) ? len : (size_t)m;
+        i = len;
+    }
+    else
+    {
+        /* too many elements for the automaton. try a match at each position */
+        if(!(starts = malloc(len+1)))
+        {
+            release_glob_pat(pat);
+            free(res);
+            return NULL;
+        }
+        if(pat->nelems >= 0)
+        {
+            glob_match_starts(pat, str, len, starts);
+        }
+        else
+        {
+            memset(starts, 1, len+1);
+        }
+        m = -1;
+    }
+
+    /* the part before the match */
+    memcpy(res, str, n);
+
+    while(starts && i < len)
+    {
+        m = starts[i] ? glob_match_prefix(pat, str+i, len-i, 1) : -1;
+        if(m < 0)
+        {
+            res[n++] = str[i++];
+            continue;
+        }
+
+        /* make room for the replacement and the rest of the string */
+        if(n+replen+len-i+1 > size)
+        {
+            size_t size2 = 2*size+replen;
+            char *res2 = realloc(res, size2);
+            if(!res2)
+            {
+                free(res);
+                free(starts);
+                release_glob_pat(pat);
+                return NULL;
+            }
+            res  = res2;
+            size = size2;
+        }
+        memcpy(res+n, rep, replen);
+        n += replen;
+
+        /* an empty match doesn't consume any chars */
+        i += m ? (size_t)m : 0;
+        if(!m)
+        {
+            res[n++] = str[i++];
+        }
+
+        if(mode != '/')
+        {
+            break;
+        }
+    }
+
+    if(!starts && m >= 0)
+    {
+        memcpy(res+n, rep, replen);
+        n += replen;
+    }
+
+    /* the part after the (last) match */
+    memcpy(res+n, str+i, len-i);
+    n += len-i;
+    res[n] = '\0';
+
+    free(starts);
+    release_glob_pat(pat);
+    return res;
+}
+
+
+/*
+ * the directory listings cache.. pathname expansion reads each directory at
+ * most once per command: the listing is kept in memory, keyed by the
+ * directory's device and inode numbers, and reused as long as the directory's
+ * modification time doesn't change.. the cache is flushed before each command
+ * is executed, by calling flush_dir_cache().
+ */
+struct dir_ent_s
+{
+    size_t        name;                 /* offset of the name in the names buffer */
+    unsigned char type;                 /* the d_type of the entry */
+};
+
+struct dir_listing_s
+{
+    dev_t    dev;                       /* the directory's device number */
+    ino_t    ino;                       /* the directory's inode number */
+    struct   timespec mtime;            /* the directory's modification time */
+    struct   dir_ent_s *entries;        /* the directory's entries */
+    int      count;                     /* number of entries */
+    char    *names;                     /* the entries' names */
+    struct   dir_listing_s *next;       /* next listing in the cache */
+};
+
+struct dir_listing_s *dir_cache = NULL;
+
+
+/*
+ * free the memory used by a directory listing.
+ */
+void free_dir_listing(struct dir_listing_s *listing)
+{
+    free(listing->entries);
+    free(listing->names);
+    free(listing);
+}
+
+
+/*
+ * empty the directory listings cache.
+ */
+void flush_dir_cache(void)
+{
+    while(dir_cache)
+    {
+        struct dir_listing_s *next = dir_cache->next;
+        free_dir_listing(dir_cache);
+        dir_cache = next;
+    }
+}
+
+
+/*
+ * read the entries of the given open directory, skipping the . and .. entries.
+ * st is the result of calling stat() on the directory.
+ *
+ * returns the listing, or NULL if insufficient memory.
+ */
+struct dir_listing_s *read_dir_listing(DIR *dir, struct stat *st)
+{
+    struct dir_listing_s *listing = malloc(sizeof(struct dir_listing_s));
+    if(!listing)
+    {
+        return NULL;
+    }
+    memset(listing, 0, sizeof(struct dir_listing_s));
+    listing->dev   = st->st_dev;
+    listing->ino   = st->st_ino;
+    listing->mtime = st->st_mtim;
+
+    struct dirent *ent;
+    int    size = 0;
+    size_t names_len = 0, names_size = 0;
+    while((ent = readdir(dir)))
+    {
+        char *name = ent->d_name;
+        if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+        {
+            continue;
+        }
+
+        size_t len = strlen(name)+1;
+        if(names_len+len > names_size)
+        {
+            size_t newsize = names_size ? names_size*2 : 4096;
+            while(newsize < names_len+len)
+            {
+                newsize *= 2;
+            }
+            char *names = realloc(listing->names, newsize);
+            if(!names)
+            {
+                break;
+            }
+            listing->names = names;
+            names_size = newsize;
+        }
+
+        if(listing->count >= size)
+        {
+            int newsize = size ? size*2 : 64;
+            struct dir_ent_s *entries = realloc(listing->entries,
+                                                newsize*sizeof(struct dir_ent_s));
+            if(!entries)
+            {
+                break;
+            }
+            listing->entries = entries;
+            size = newsize;
+        }
+
+        memcpy(listing->names+names_len, name, len);
+        listing->entries[listing->count].name = names_len;
+        listing->entries[listing->count].type = ent->d_type;
+        listing->count++;
+        names_len += len;
+    }
+
+    return listing;
+}
+
+
+/*
+ * add a listing we've read to the cache.. if the cache already has a listing
+ * of the same directory, we keep the old one.
+ *
+ * returns the cached listing.
+ */
+struct dir_listing_s *cache_dir_listing(struct dir_listing_s *listing)
+{
+    struct dir_listing_s *l = dir_cache;
+    while(l)
+    {
+        if(l->dev == listing->dev && l->ino == listing->ino &&
+           l->mtime.tv_sec  == listing->mtime.tv_sec &&
+           l->mtime.tv_nsec == listing->mtime.tv_nsec)
+        {
+            free_dir_listing(listing);
+            return l;
+        }
+        l = l->next;
+    }
+    listing->next = dir_cache;
+    dir_cache = listing;
+    return listing;
+}
+
+
+/*
+ * get the listing of the given directory, from the cache if we've read the
+ * directory before and it hasn't changed since.
+ *
+ * returns the listing, or NULL if the directory can't be read.
+ */
+struct dir_listing_s *get_dir_listing(char *path)
+{
+    struct stat st;
+    if(stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+    {
+        return NULL;
+    }
+
+    struct dir_listing_s *listing = dir_cache;
+    while(listing)
+    {
+        if(listing->dev == st.st_dev && listing->ino == st.st_ino)
+        {
+            if(listing->mtime.tv_sec  == st.st_mtim.tv_sec &&
+               listing->mtime.tv_nsec == st.st_mtim.tv_nsec)
+            {
+                return listing;
+            }
+            /*
+             * the directory has changed. we'll read it again, but keep the old
+             * listing until the cache is flushed, as our caller might still be
+             * using it.
+             */
+        }
+        listing = listing->next;
+    }
+
+    DIR *dir = opendir(path);
+    if(!dir)
+    {
+        return NULL;
+    }
+    if((listing = read_dir_listing(dir, &st)))
+    {
+        listing->next = dir_cache;
+        dir_cache = listing;
+    }
+    closedir(dir);
+    return listing;
+}
+
+
+/*
+ * one component of a pathname pattern, i.e. the part between two slashes.
+ */
+struct glob_seg_s
+{
+    char   *pattern;                    /* the component, with quoted chars escaped */
+    char   *literal;                    /* the component, unquoted and unescaped */
+    struct  glob_pat_s *pat;            /* the compiled pattern, NULL if literal */
+    int     globbing;                   /* 1 if the component has unquoted glob chars */
+    int     recursive;                  /* 1 if the component is '**' */
+    int     match_dot;                  /* 1 if the pattern starts with a literal '.' */
+};
+
+/*
+ * the state of a pathname expansion.
+ */
+struct glob_state_s
+{
+    struct glob_seg_s *segs;            /* the pattern's components */
+    int     nsegs;                      /* number of components */
+    char   *path;                       /* the path we are matching */
+    size_t  path_size;                  /* alloc'd size of the path buffer */
+    char  **matches;                    /* the matched pathnames */
+    int     count, size;                /* used and alloc'd size of the matches list */
+};
+
+
+/*
+ * split the given pathname pattern into components, which are turned into
+ * patterns by word_to_glob(), so that their quoted chars are matched literally.
+ *
+ * returns the number of components, or -1 if insufficient memory.. if no
+ * component contains unquoted glob chars, we return 0.
+ */
+int split_glob_pattern(char *pattern, struct glob_seg_s **segs)
+{
+    size_t len = strlen(pattern);
+    int    nsegs = 1, globbing = 0, i;
+    char  *p;
+
+    for(p = pattern; *p; p++)
+    {
+        if(*p == '/')
+        {
+            nsegs++;
+        }
+    }
+
+    /*
+     * one buffer for the segments, followed by their patterns and literals,
+     * and room for a copy of the component we're working on.
+     */
+    char *buf = malloc(nsegs*sizeof(struct glob_seg_s) + 4*(len+1));
+    if(!buf)
+    {
+        return -1;
+    }
+    struct glob_seg_s *seg = (struct glob_seg_s *)buf;
+    char *pat  = buf + nsegs*sizeof(struct glob_seg_s);
+    char *lit  = pat + 2*(len+1);
+    char *word = lit + (len+1);
+    char *start = pattern;
+    char quote = 0, reopen = 0;
+
+    *segs = seg;
+    memset(seg, 0, sizeof(struct glob_seg_s));
+    seg->pattern   = pat;
+    seg->literal   = lit;
+    for(p = pattern; ; p++)
+    {
+        char c = *p;
+        if(c == '\0' || c == '/')
+        {
+            /*
+             * the component's quoted chars are escaped the same way as in other
+             * patterns.. a quoted slash still ends the component (a name can't
+             * have one), and the quotes go on in the next component.
+             */
+            size_t n = 0;
+            if(reopen)
+            {
+                word[n++] = reopen;
+            }
+            memcpy(word+n, start, p-start);
+            word[n+(p-start)] = '\0';
+            reopen = quote;
+            seg->globbing  = word_to_glob(word, pat, lit);
+            seg->match_dot = (lit[0] == '.');
+            pat += strlen(pat)+1;
+            lit += strlen(lit)+1;
+            if(!c)
+            {
+                break;
+            }
+            seg++;
+            memset(seg, 0, sizeof(struct glob_seg_s));
+            seg->pattern   = pat;
+            seg->literal   = lit;
+            start = p+1;
+            continue;
+        }
+
+        /* skip the quoted parts, so that we don't split them */
+        if(quote)
+        {
+            if(c == quote)
+            {
+                quote = 0;
+            }
+            else if(c == '\\' && quote == '"' && p[1])
+            {
+                p++;
+            }
+        }
+        else if(c == '\'' || c == '"')
+        {
+            quote = c;
+        }
+        else if(c == '\\' && p[1])
+        {
+            p++;
+        }
+    }
+
+    /* compile the components that need it */
+    for(i = 0; i < nsegs; i++)
+    {
+        seg = &(*segs)[i];
+        /* an unquoted '**' matches any number of directories */
+        if(seg->globbing && strcmp(seg->pattern, "**") == 0)
+        {
+            seg->recursive = 1;
+            globbing = 1;
+        }
+        else if(seg->globbing)
+        {
+            /* if we're out of memory, the component is treated as literal */
+            seg->pat = get_glob_pat(seg->pattern);
+            globbing = 1;
+        }
+    }
+
+    return globbing ? nsegs : 0;
+}
+
+
+/*
+ * make sure the path buffer can hold len chars (plus the terminating NUL).
+ *
+ * returns 1 on success, 0 if insufficient memory.
+ */
+int check_path_bounds(struct glob_state_s *state, size_t len)
+{
+    if(len+1 <= state->path_size)
+    {
+        return 1;
+    }
+    size_t newsize = state->path_size ? state->path_size : 256;
+    while(newsize < len+1)
+    {
+        newsize *= 2;
+    }
+    char *path = realloc(state->path, newsize);
+    if(!path)
+    {
+        return 0;
+    }
+    state->path = path;
+    state->path_size = newsize;
+    return 1;
+}
+
+
+/*
+ * add the current path to the list of matches.
+ */
+void add_glob_match(struct glob_state_s *state, size_t len)
+{
+    char *match = malloc(len+1);
+    if(!match)
+    {
+        return;
+    }
+    memcpy(match, state->path, len);
+    match[len] = '\0';
+    if(!check_buffer_bounds(&state->count, &state->size, &state->matches))
+    {
+        free(match);
+        return;
+    }
+    state->matches[state->count++] = match;
+}
+
+
+/*
+ * check if the entry whose path is in the path buffer is a directory.. we
+ * only call stat() if the directory entry's type doesn't tell us.
+ */
+int is_dir_entry(struct glob_state_s *state, unsigned char type)
+{
+    struct stat st;
+    if(type == DT_DIR)
+    {
+        return 1;
+    }
+    if(type != DT_LNK && type != DT_UNKNOWN)
+    {
+        return 0;
+    }
+    return stat(state->path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+
+/*
+ * recursive globbing.. a '**' component matches the directory it is in and
+ * all the directories below it (except hidden ones, and without following
+ * symbolic links).. we read the directory tree on a pool of worker threads:
+ * each directory is opened with openat() relative to its parent's fd, and the
+ * listings the workers read are added to the directory listings cache, so that
+ * the rest of the pattern is matched without reading the directories again.
+ *
+ * the number of threads is taken from the GLOBTHREADS shell variable, and
+ * defaults to the number of online processors.
+ */
+#define MAX_GLOB_THREADS    64
+
+void glob_dir(struct glob_state_s *state, size_t len, int seg);
+
+struct walk_dir_s
+{
+    struct walk_dir_s    *parent;       /* the parent directory */
+    char                 *path;         /* the path, ending in '/' (except the root) */
+    size_t                name;         /* offset of the name in the path */
+    DIR                  *dir;          /* the open directory */
+    int                   refs;         /* ourselves + children that haven't been opened */
+    struct dir_listing_s *listing;      /* the directory's entries */
+    struct walk_dir_s    *next;         /* next directory in the queue or the done list */
+};
+
+struct walk_pool_s
+{
+    pthread_mutex_t       lock;
+    pthread_cond_t        cond;
+    struct walk_dir_s    *queue;        /* directories waiting to be read */
+    struct walk_dir_s    *done;         /* directories we've read (or failed to) */
+    int                   pending;      /* directories queued or being read */
+};
+
+
+/*
+ * release a reference to a walked directory, closing it when no more children
+ * need its fd.. must be called with the pool's lock held.
+ */
+void release_walk_dir(struct walk_dir_s *wdir)
+{
+    if(--wdir->refs == 0 && wdir->dir)
+    {
+        closedir(wdir->dir);
+        wdir->dir = NULL;
+    }
+}
+
+
+/*
+ * create a walk entry for the directory with the given name in parent, or for
+ * the root of the walk if parent is NULL.
+ *
+ * returns the new entry, or NULL if insufficient memory.
+ */
+struct walk_dir_s *new_walk_dir(struct walk_dir_s *parent, char *name, size_t len)
+{
+    size_t plen = parent ? strlen(parent->path) : 0;
+    struct walk_dir_s *wdir = malloc(sizeof(struct walk_dir_s)+plen+len+2);
+    if(!wdir)
+    {
+        return NULL;
+    }
+    memset(wdir, 0, sizeof(struct walk_dir_s));
+    wdir->path   = (char *)(wdir+1);
+    wdir->parent = parent;
+    wdir->name   = plen;
+    wdir->refs   = 1;
+    if(parent)
+    {
+        memcpy(wdir->path, parent->path, plen);
+    }
+    memcpy(wdir->path+plen, name, len);
+    wdir->path[plen+len] = '\0';
+    if(parent)
+    {
+        wdir->path[plen+len  ] = '/';
+        wdir->path[plen+len+1] = '\0';
+    }
+    return wdir;
+}
+
+
+/*
+ * open and read a directory, and queue its subdirectories.. called by the
+ * worker threads, without holding the pool's lock.
+ */
+void walk_one_dir(struct walk_pool_s *pool, struct walk_dir_s *wdir)
+{
+    struct walk_dir_s *first = NULL, *last = NULL;
+    int    count = 0, fd = -1;
+
+    if(wdir->parent)
+    {
+        fd = openat(dirfd(wdir->parent->dir), wdir->path+wdir->name,
+                    O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+        /* too many open files. try the full path */
+        if(fd < 0 && (errno == EMFILE || errno == ENFILE))
+        {
+            fd = open(wdir->path, O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+        }
+    }
+    else
+    {
+        fd = open(wdir->path[0] ? wdir->path : ".", O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    }
+
+    struct stat st;
+    if(fd >= 0 && (fstat(fd, &st) != 0 || !(wdir->dir = fdopendir(fd))))
+    {
+        close(fd);
+    }
+
+    if(wdir->dir && (wdir->listing = read_dir_listing(wdir->dir, &st)))
+    {
+        struct dir_listing_s *listing = wdir->listing;
+        int i;
+        for(i = 0; i < listing->count; i++)
+        {
+            char *name = listing->names+listing->entries[i].name;
+            unsigned char type = listing->entries[i].type;
+            if(name[0] == '.')
+            {
+                continue;
+            }
+            if(type == DT_UNKNOWN)
+            {
+                struct stat st2;
+                if(fstatat(dirfd(wdir->dir), name, &st2, AT_SYMLINK_NOFOLLOW) == 0 &&
+                   S_ISDIR(st2.st_mode))
+                {
+                    type = DT_DIR;
+                }
+            }
+            if(type != DT_DIR)
+            {
+                continue;
+            }
+            struct walk_dir_s *child = new_walk_dir(wdir, name, strlen(name));
+            if(!child)
+            {
+                continue;
+            }
+            if(last)
+            {
+                last->next = child;
+            }
+            else
+            {
+                first = child;
+            }
+            last = child;
+            count++;
+        }
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    if(wdir->parent)
+    {
+        release_walk_dir(wdir->parent);
+    }
+    /* queue the subdirectories (each holds a reference to our fd) */
+    if(first)
+    {
+        wdir->refs += count;
+        last->next  = pool->queue;
+        pool->queue = first;
+        pool->pending += count;
+    }
+    release_walk_dir(wdir);
+    wdir->next = pool->done;
+    pool->done = wdir;
+    if(--pool->pending == 0 || count)
+    {
+        pthread_cond_broadcast(&pool->cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+
+/*
+ * the worker thread's function.. we take directories off the queue (which
+ * works as a stack, so that we walk the tree depth-first and keep the number
+ * of open fds low), until there is nothing more to read.
+ */
+void *walk_worker(void *arg)
+{
+    struct walk_pool_s *pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for(;;)
+    {
+        while(!pool->queue && pool->pending)
+        {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        }
+        if(!pool->queue)
+        {
+            break;
+        }
+        struct walk_dir_s *wdir = pool->queue;
+        pool->queue = wdir->next;
+        wdir->next  = NULL;
+        pthread_mutex_unlock(&pool->lock);
+        walk_one_dir(pool, wdir);
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+
+/*
+ * get the number of threads to use for walking directory trees.
+ */
+int get_glob_threads(void)
+{
+    struct symtab_entry_s *entry = get_symtab_entry("GLOBTHREADS");
+    char *val = entry ? symtab_entry_getval(entry) : NULL;
+    long n = 0;
+
+    if(val && *val)
+    {
+        n = atol(val);
+    }
+    if(n <= 0)
+    {
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if(n <= 0)
+    {
+        n = 1;
+    }
+    return (n > MAX_GLOB_THREADS) ? MAX_GLOB_THREADS : n;
+}
+
+
+/*
+ * match a '**' component (and the components after it) in the directory whose
+ * path (of length len) is in the path buffer.
+ */
+void glob_walk(struct glob_state_s *state, size_t len, int seg)
+{
+    struct walk_pool_s pool;
+    struct walk_dir_s *root = new_walk_dir(NULL, state->path, len);
+    pthread_t threads[MAX_GLOB_THREADS];
+    int nthreads = get_glob_threads(), i, j;
+
+    if(!root)
+    {
+        return;
+    }
+
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.cond, NULL);
+    pool.queue   = root;
+    pool.done    = NULL;
+    pool.pending = 1;
+
+    /* we are a worker too */
+    for(i = 0; i < nthreads-1; i++)
+    {
+        if(pthread_create(&threads[i], NULL, walk_worker, &pool) != 0)
+        {
+            break;
+        }
+    }
+    walk_worker(&pool);
+    for(j = 0; j < i; j++)
+    {
+        pthread_join(threads[j], NULL);
+    }
+    pthread_mutex_destroy(&pool.lock);
+    pthread_cond_destroy(&pool.cond);
+
+    /* match the rest of the pattern in each directory we've found */
+    int last = (seg == state->nsegs-1);
+    struct walk_dir_s *wdir = pool.done;
+    while(wdir)
+    {
+        struct walk_dir_s *next = wdir->next;
+        if(wdir->listing)
+        {
+            struct dir_listing_s *listing = cache_dir_listing(wdir->listing);
+            size_t plen = strlen(wdir->path);
+            if(check_path_bounds(state, plen))
+            {
+                memcpy(state->path, wdir->path, plen+1);
+                if(last)
+                {
+                    /* a trailing '**' matches everything in the tree, and the tree's root */
+                    if(!wdir->parent && plen)
+                    {
+                        add_glob_match(state, plen);
+                    }
+                    for(i = 0; i < listing->count; i++)
+                    {
+                        char *name = listing->names+listing->entries[i].name;
+                        size_t nlen = strlen(name);
+                        if(name[0] == '.' || !check_path_bounds(state, plen+nlen))
+                        {
+                            continue;
+                        }
+                        memcpy(state->path+plen, name, nlen+1);
+                        add_glob_match(state, plen+nlen);
+                    }
+                }
+                else
+                {
+                    glob_dir(state, plen, seg+1);
+                }
+            }
+        }
+        free(wdir);
+        wdir = next;
+    }
+}
+
+
+/*
+ * match the components of the pattern, starting with component seg, in the
+ * directory whose path (of length len) is in the path buffer.
+ */
+void glob_dir(struct glob_state_s *state, size_t len, int seg)
+{
+    struct glob_seg_s *gseg = &state->segs[seg];
+    int last = (seg == state->nsegs-1);
+
+    /* '**' component. walk the directory tree */
+    if(gseg->recursive)
+    {
+        glob_walk(state, len, seg);
+        return;
+    }
+
+    /* literal component. append it to the path */
+    if(!gseg->pat)
+    {
+        size_t llen = strlen(gseg->literal);
+        if(!check_path_bounds(state, len+llen+1))
+        {
+            return;
+        }
+        memcpy(state->path+len, gseg->literal, llen);
+        len += llen;
+        state->path[len] = '\0';
+        if(last)
+        {
+            /* the last component must exist (an empty one means a trailing '/') */
+            struct stat st;
+            if(!llen || lstat(state->path, &st) == 0)
+            {
+                add_glob_match(state, len);
+            }
+            return;
+        }
+        state->path[len++] = '/';
+        state->path[len  ] = '\0';
+        glob_dir(state, len, seg+1);
+        return;
+    }
+
+    /* pattern component. match it against the directory's entries */
+    struct dir_listing_s *listing = get_dir_listing(len ? state->path : ".");
+    if(!listing)
+    {
+        return;
+    }
+
+    int i;
+    for(i = 0; i < listing->count; i++)
+    {
+        char *name = listing->names+listing->entries[i].name;
+        /* names starting with '.' must be matched explicitly */
+        if(name[0] == '.' && !gseg->match_dot)
+        {
+            continue;
+        }
+        if(!glob_match(gseg->pat, name))
+        {
+            continue;
+        }
+
+        size_t nlen = strlen(name);
+        if(!check_path_bounds(state, len+nlen+1))
+        {
+            return;
+        }
+        memcpy(state->path+len, name, nlen+1);
+        if(last)
+        {
+            add_glob_match(state, len+nlen);
+        }
+        else if(is_dir_entry(state, listing->entries[i].type))
+        {
+            state->path[len+nlen  ] = '/';
+            state->path[len+nlen+1] = '\0';
+            glob_dir(state, len+nlen+1, seg+1);
+        }
+    }
+}
+
+
+/*
+ * sorting the matches.. we compare the collation keys of the pathnames (the
+ * pathnames themselves in the C locale, or their strxfrm() transforms in other
+ * locales), which we compute once per pathname instead of calling strcoll()
+ * for every comparison.. the first 8 bytes of each key are kept in the sort
+ * array as a big-endian integer, so that most comparisons are decided without
+ * following the key pointer.
+ */
+struct sort_key_s
+{
+    uint64_t prefix;                    /* the key's first 8 bytes */
+    char    *key;                       /* the collation key */
+    char    *str;                       /* the pathname */
+};
+
+
+/*
+ * compare two sort keys.
+ *
+ * returns < 0, 0 or > 0 if k1 sorts before, the same as, or after k2.
+ */
+static inline int cmp_sort_keys(struct sort_key_s *k1, struct sort_key_s *k2)
+{
+    if(k1->prefix != k2->prefix)
+    {
+        return (k1->prefix < k2->prefix) ? -1 : 1;
+    }
+    /* equal prefixes with a NUL in them mean equal keys */
+    if(!(k1->prefix & 0xff))
+    {
+        return 0;
+    }
+    return strcmp(k1->key+8, k2->key+8);
+}
+
+
+/*
+ * bottom-up merge sort of the keys array, using tmp as scratch space.
+ */
+void merge_sort_keys(struct sort_key_s *keys, struct sort_key_s *tmp, int count)
+{
+    struct sort_key_s *src = keys, *dest = tmp, *t;
+    int width, i;
+
+    for(width = 1; width < count; width *= 2)
+    {
+        for(i = 0; i < count; i += 2*width)
+        {
+            int l = i, lend = (i+width < count) ? i+width : count;
+            int r = lend, rend = (i+2*width < count) ? i+2*width : count;
+            int k = i;
+            while(l < lend && r < rend)
+            {
+                dest[k++] = (cmp_sort_keys(&src[r], &src[l]) < 0) ? src[r++] : src[l++];
+            }
+            while(l < lend)
+            {
+                dest[k++] = src[l++];
+            }
+            while(r < rend)
+            {
+                dest[k++] = src[r++];
+            }
+        }
+        t = src, src = dest, dest = t;
+    }
+
+    if(src != keys)
+    {
+        memcpy(keys, src, count*sizeof(struct sort_key_s));
+    }
+}
+
+
+/*
+ * sort the pathnames resulting from pathname expansion according to the
+ * current collation locale, unless the GLOBSORT shell variable is set to
+ * 'none' (in which case the pathnames are left in directory order).
+ */
+void sort_glob_matches(char **matches, int count)
+{
+    struct symtab_entry_s *entry = get_symtab_entry("GLOBSORT");
+    char *val = entry ? symtab_entry_getval(entry) : NULL;
+    if((val && strcmp(val, "none") == 0) || count < 2)
+    {
+        return;
+    }
+
+    /* the C and POSIX locales collate in byte order */
+    char *locale = setlocale(LC_COLLATE, NULL);
+    int   bytes  = !locale || strcmp(locale, "C") == 0 || strcmp(locale, "POSIX") == 0;
+    struct sort_key_s *keys = malloc(2*count*sizeof(struct sort_key_s));
+    int i, j;
+
+    if(!keys)
+    {
+        return;
+    }
+
+    for(i = 0; i < count; i++)
+    {
+        char *key = matches[i];
+        if(!bytes)
+        {
+            size_t len = strxfrm(NULL, matches[i], 0);
+            if((key = malloc(len+1)))
+            {
+                strxfrm(key, matches[i], len+1);
+            }
+            else
+            {
+                /*
+                 * insufficient memory. byte order keys can't be sorted with
+                 * the collation keys we've got so far, so we free them and
+                 * start over, sorting all the pathnames in byte order.
+                 */
+                while(i--)
+                {
+                    free(keys[i].key);
+                }
+                bytes = 1;
+                continue;
+            }
+        }
+
+        /* pad short keys with zeroes */
+        uint64_t prefix = 0;
+        int end = 0;
+        for(j = 0; j < 8; j++)
+        {
+            if(!end && !key[j])
+            {
+                end = 1;
+            }
+            prefix = (prefix << 8) | (end ? 0 : (unsigned char)key[j]);
+        }
+        keys[i].prefix = prefix;
+        keys[i].key    = key;
+        keys[i].str    = matches[i];
+    }
+
+    merge_sort_keys(keys, keys+count, count);
+
+    for(i = 0; i < count; i++)
+    {
+        matches[i] = keys[i].str;
+        if(keys[i].key != keys[i].str)
+        {
+            free(keys[i].key);
+        }
+    }
+    free(keys);
+}
+
+
+/*
+ * perform pathname (or filename) expansion, matching files against the given
+ * pattern, which can contain glob chars in any of its components.
+ *
+ * returns the sorted list of matched pathnames, or NULL if nothing matched..
+ * the number of matches is stored in *count.. the caller should free the
+ * list by calling free_buffer().
+ */
+char **get_filename_matches(char *pattern, int *count)
+{
+    struct glob_state_s state;
+    int i;
+
+    *count = 0;
+    if(!pattern)
+    {
+        return NULL;
+    }
+
+    memset(&state, 0, sizeof(struct glob_state_s));
+    if((state.nsegs = split_glob_pattern(pattern, &state.segs)) <= 0)
+    {
+        if(state.nsegs == 0)
+        {
+            free(state.segs);
+        }
+        return NULL;
+    }
+
+    if(check_path_bounds(&state, 0))
+    {
+        state.path[0] = '\0';
+        glob_dir(&state, 0, 0);
+    }
+
+    for(i = 0; i < state.nsegs; i++)
+    {
+        release_glob_pat(state.segs[i].pat);
+    }
+    free(state.segs);
+    free(state.path);
+
+    if(!state.count)
+    {
+        free(state.matches);
+        return NULL;
+    }
+
+    sort_glob_matches(state.matches, state.count);
+    *count = state.count;
+    return state.matches;
+}
+
+
+/*
+ * convert a word that hasn't gone through quote removal to a glob pattern, in
+ * which the quoted chars are escaped with backslashes so that they are matched
+ * literally.. the pattern is stored in pat (which should have room for twice
+ * the length of the word, plus one), and the word after quote removal is
+ * stored in lit (which should have room for the word's length, plus one).
+ *
+ * returns 1 if the word contains unquoted glob chars, 0 otherwise.
+ */
+int word_to_glob(char *word, char *pat, char *lit)
+{
+    int  globbing = 0;
+    char quote = 0;
+    char *p;
+
+    for(p = word; *p; p++)
+    {
+        char c = *p;
+        if(quote)
+        {
+            if(c == quote)
+            {
+                quote = 0;
+                continue;
+            }
+            if(c == '\\' && quote == '"' && p[1] && strchr("$`\"\\", p[1]))
+            {
+                c = *++p;
+            }
+        }
+        else if(c == '\'' || c == '"')
+        {
+            quote = c;
+            continue;
+        }
+        else if(c == '\\' && p[1])
+        {
+            c = *++p;
+        }
+        else
+        {
+            if(c == '*' || c == '?' || c == '[')
+            {
+                globbing = 1;
+            }
+            *pat++ = c;
+            *lit++ = c;
+            continue;
+        }
+
+        /* quoted char. escape it if it's special to the pattern matcher */
+        if(c == '*' || c == '?' || c == '[' || c == ']' || c == '\\')
+        {
+            *pat++ = '\\';
+        }
+        *pat++ = c;
+        *lit++ = c;
+    }
+
+    *pat = '\0';
+    *lit = '\0';
+    return globbing;
+}
+
+
+/*
+ * the dispatch table of a case clause.. the patterns that are plain strings
+ * (after quote removal) go into a hash table, which maps each string to the
+ * first case item that has it.. the glob patterns are compiled once, and are
+ * kept (along with the patterns that need to be expanded each time the clause
+ * is executed) in a list ordered by case item.. to find the matching item, we
+ * look up the word in the hash table, then try the patterns in the list that
+ * come before the item we've found (if any).
+ */
+struct case_lit_s
+{
+    char         *str;                  /* the string */
+    unsigned int  hash;                 /* its hash value */
+    int           item;                 /* the first item with this string */
+    struct case_lit_s *next;            /* next string in the hash bucket */
+};
+
+struct case_alt_s
+{
+    int    item;                        /* the case item of this pattern */
+    char  *word;                        /* pattern that needs expansion, or NULL */
+    struct glob_pat_s *pat;             /* the compiled pattern, or NULL */
+};
+
+struct case_table_s
+{
+    struct case_lit_s **buckets;        /* the strings hash table */
+    int    nbuckets, nlits;             /* table size and number of strings */
+    struct case_alt_s *alts;            /* the patterns list */
+    int    nalts, alts_size;            /* used and alloc'd size of the list */
+};
+
+
+/*
+ * create a new, empty case dispatch table.
+ *
+ * returns the malloc'd table, or NULL if insufficient memory.
+ */
+struct case_table_s *new_case_table(void)
+{
+    struct case_table_s *table = malloc(sizeof(struct case_table_s));
+    if(!table)
+    {
+        return NULL;
+    }
+    memset(table, 0, sizeof(struct case_table_s));
+    table->nbuckets = 16;
+    table->buckets  = calloc(table->nbuckets, sizeof(struct case_lit_s *));
+    if(!table->buckets)
+    {
+        free(table);
+        return NULL;
+    }
+    return table;
+}
+
+
+/*
+ * free the memory used by a case dispatch table.
+ */
+void free_case_table(struct case_table_s *table)
+{
+    int i;
+
+    if(!table)
+    {
+        return;
+    }
+
+    for(i = 0; i < table->nbuckets; i++)
+    {
+        struct case_lit_s *lit = table->buckets[i];
+        while(lit)
+        {
+            struct case_lit_s *next = lit->next;
+            free(lit);
+            lit = next;
+        }
+    }
+    for(i = 0; i < table->nalts; i++)
+    {
+        free(table->alts[i].word);
+        release_glob_pat(table->alts[i].pat);
+    }
+    free(table->buckets);
+    free(table->alts);
+    free(table);
+}
+
+
+/*
+ * add a string to the hash table, doubling the table when it gets half full.
+ *
+ * returns 1 on success, 0 if insufficient memory.
+ */
+int case_table_add_lit(struct case_table_s *table, char *str, int item)
+{
+    unsigned int hash = str_hash(str);
+    struct case_lit_s *lit;
+    int i;
+
+    for(lit = table->buckets[hash & (table->nbuckets-1)]; lit; lit = lit->next)
+    {
+        /* only the first item with this string can ever match */
+        if(lit->hash == hash && strcmp(lit->str, str) == 0)
+        {
+            return 1;
+        }
+    }
+
+    if(table->nlits >= table->nbuckets/2)
+    {
+        int nbuckets = table->nbuckets*2;
+        struct case_lit_s **buckets = calloc(nbuckets, sizeof(struct case_lit_s *));
+        if(!buckets)
+        {
+            return 0;
+        }
+        for(i = 0; i < table->nbuckets; i++)
+        {
+            while((lit = table->buckets[i]))
+            {
+                table->buckets[i] = lit->next;
+                lit->next = buckets[lit->hash & (nbuckets-1)];
+                buckets[lit->hash & (nbuckets-1)] = lit;
+            }
+        }
+        free(table->buckets);
+        table->buckets  = buckets;
+        table->nbuckets = nbuckets;
+    }
+
+    /* the string is kept in the same memory block */
+    if(!(lit = malloc(sizeof(struct case_lit_s)+strlen(str)+1)))
+    {
+        return 0;
+    }
+    lit->str  = (char *)(lit+1);
+    strcpy(lit->str, str);
+    lit->hash = hash;
+    lit->item = item;
+    lit->next = table->buckets[hash & (table->nbuckets-1)];
+    table->buckets[hash & (table->nbuckets-1)] = lit;
+    table->nlits++;
+    return 1;
+}
+
+
+/*
+ * add the given pattern (a word from the source, which hasn't undergone any
+ * expansion) of the given case item to a case dispatch table.. items should
+ * be added in order.
+ *
+ * returns 1 on success, 0 if insufficient memory.
+ */
+int case_table_add(struct case_table_s *table, char *word, int item)
+{
+    struct case_alt_s alt = { .item = item, .word = NULL, .pat = NULL };
+    size_t len = strlen(word);
+
+    /* the pattern has to be expanded every time the clause is executed */
+    if(*word == '~' || strchr_any(word, "$`"))
+    {
+        if(!(alt.word = malloc(len+1)))
+        {
+            return 0;
+        }
+        strcpy(alt.word, word);
+    }
+    else
+    {
+        char pat[2*len+1], lit[len+1];
+        if(!word_to_glob(word, pat, lit))
+        {
+            return case_table_add_lit(table, lit, item);
+        }
+        if(!(alt.pat = get_glob_pat(pat)))
+        {
+            return 0;
+        }
+    }
+
+    if(table->nalts >= table->alts_size)
+    {
+        int size = table->alts_size ? table->alts_size*2 : 8;
+        struct case_alt_s *alts = realloc(table->alts, size*sizeof(struct case_alt_s));
+        if(!alts)
+        {
+            free(alt.word);
+            release_glob_pat(alt.pat);
+            return 0;
+        }
+        table->alts      = alts;
+        table->alts_size = size;
+    }
+    table->alts[table->nalts++] = alt;
+    return 1;
+}
+
+
+/*
+ * check if str matches a case pattern that needs expansion.
+ *
+ * returns 1 if str matches, 0 otherwise.
+ */
+int case_alt_match(char *word, char *str)
+{
+    char *pat = word_expand_pattern(word, "*?[]\\");
+    int  res = 0;
+
+    if(!pat)
+    {
+        return 0;
+    }
+
+    struct glob_pat_s *gpat = get_glob_pat(pat);
+    if(gpat)
+    {
+        res = glob_match(gpat, str);
+        release_glob_pat(gpat);
+    }
+    free(pat);
+    return res;
+}
+
+
+/*
+ * find the first case item with a pattern that matches str.
+ *
+ * returns the item's index, or -1 if no pattern matches.
+ */
+int case_table_lookup(struct case_table_s *table, char *str)
+{
+    unsigned int hash = str_hash(str);
+    struct case_lit_s *lit;
+    int item = -1, i;
+
+    for(lit = table->buckets[hash & (table->nbuckets-1)]; lit; lit = lit->next)
+    {
+        if(lit->hash == hash && strcmp(lit->str, str) == 0)
+        {
+            item = lit->item;
+            break;
+        }
+    }
+
+    for(i = 0; i < table->nalts; i++)
+    {
+        struct case_alt_s *alt = &table->alts[i];
+        if(item >= 0 && alt->item >= item)
+        {
+            break;
+        }
+        if(alt->pat ? glob_match(alt->pat, str) : case_alt_match(alt->word, str))
+        {
+            return alt->item;
+        }
+    }
+
+    return item;
+}
+
+
+/*
+ * the compiled regular expressions cache.. compiled regexes are kept in a hash
+ * table keyed by the regex text and the compilation flags, and in a list that
+ * is kept in least-recently-used order.. when the cache is full, we throw away
+ * the least recently used regex.
+ */
+#define REGEX_CACHE_BUCKETS 64      /* hash table size (power of 2) */
+#define REGEX_CACHE_SIZE    32      /* max. number of cached regexes */
+
+struct regex_s
+{
+    char         *text;                 /* the regex text */
+    int           flags;                /* the regcomp() flags */
+    unsigned int  hash;                 /* hash of the regex text */
+    regex_t       re;                   /* the compiled regex */
+    struct regex_s *lru_prev, *lru_next;/* the LRU list links */
+    struct regex_s *next;               /* next regex in the hash bucket */
+};
+
+struct regex_s *regex_cache[REGEX_CACHE_BUCKETS];
+struct regex_s *regex_lru_first = NULL; /* most recently used */
+struct regex_s *regex_lru_last  = NULL; /* least recently used */
+int    regex_cache_count = 0;
+
+
+/*
+ * remove a regex from the LRU list.
+ */
+static inline void regex_lru_unlink(struct regex_s *r)
+{
+    if(r->lru_prev)
+    {
+        r->lru_prev->lru_next = r->lru_next;
+    }
+    else
+    {
+        regex_lru_first = r->lru_next;
+    }
+    if(r->lru_next)
+    {
+        r->lru_next->lru_prev = r->lru_prev;
+    }
+    else
+    {
+        regex_lru_last = r->lru_prev;
+    }
+}
+
+
+/*
+ * add a regex to the head of the LRU list.
+ */
+static inline void regex_lru_push(struct regex_s *r)
+{
+    r->lru_prev = NULL;
+    r->lru_next = regex_lru_first;
+    if(regex_lru_first)
+    {
+        regex_lru_first->lru_prev = r;
+    }
+    else
+    {
+        regex_lru_last = r;
+    }
+    regex_lru_first = r;
+}
+
+
+/*
+ * remove the least recently used regex from the cache and free it.
+ */
+void regex_cache_evict(void)
+{
+    struct regex_s *r = regex_lru_last;
+    if(!r)
+    {
+        return;
+    }
+
+    struct regex_s **pr = &regex_cache[r->hash & (REGEX_CACHE_BUCKETS-1)];
+    while(*pr != r)
+    {
+        pr = &(*pr)->next;
+    }
+    *pr = r->next;
+    regex_lru_unlink(r);
+    regfree(&r->re);
+    free(r->text);
+    free(r);
+    regex_cache_count--;
+}
+
+
+/*
+ * get the compiled form of the given extended regular expression, compiling
+ * it and adding it to the cache if it's not already there.. an invalid regex
+ * is reported to stderr.
+ *
+ * returns the compiled regex, which is valid until the next call, or NULL on
+ * error.
+ */
+regex_t *get_regex(char *pattern, int flags)
+{
+    unsigned int hash = str_hash(pattern);
+    int bucket = hash & (REGEX_CACHE_BUCKETS-1);
+    struct regex_s *r;
+
+    for(r = regex_cache[bucket]; r; r = r->next)
+    {
+        if(r->hash == hash && r->flags == flags && strcmp(r->text, pattern) == 0)
+        {
+            if(r != regex_lru_first)
+            {
+                regex_lru_unlink(r);
+                regex_lru_push(r);
+            }
+            return &r->re;
+        }
+    }
+
+    if(!(r = malloc(sizeof(struct regex_s))))
+    {
+        return NULL;
+    }
+    if(!(r->text = malloc(strlen(pattern)+1)))
+    {
+        free(r);
+        return NULL;
+    }
+    strcpy(r->text, pattern);
+
+    int err = regcomp(&r->re, pattern, flags);
+    if(err)
+    {
+        char msg[128];
+        regerror(err, &r->re, msg, sizeof(msg));
+        fprintf(stderr, "error: invalid regular expression: %s: %s\n", pattern, msg);
+        free(r->text);
+        free(r);
+        return NULL;
+    }
+
+    if(regex_cache_count >= REGEX_CACHE_SIZE)
+    {
+        regex_cache_evict();
+    }
+
+    r->flags = flags;
+    r->hash  = hash;
+    r->next  = regex_cache[bucket];
+    regex_cache[bucket] = r;
+    regex_lru_push(r);
+    regex_cache_count++;
+    return &r->re;
 }
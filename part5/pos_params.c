@@ -0,0 +1,379 @@
+/*
+ *    Programmed By: Mohammed Isam [mohammed_isam1984@yahoo.com]
+ *    Copyright 2020 (c)
+ *
+ *    file: pos_params.c
+ *    This file is part of the "Let's Build a Linux Shell" tutorial.
+ *
+ *    This tutorial is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This tutorial is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this tutorial.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shell.h"
+
+
+/*
+ * the positional parameters ($1, $2, ...) are kept as a counted array of
+ * strings.. $1 is params[start], so shift only moves the start forward and
+ * doesn't touch the strings.. each function call (or anything else that gets
+ * its own parameters) pushes a frame that points to its arguments without
+ * copying them, and pops it when it returns.. only set (which makes new
+ * parameters) copies the strings, and the frame owns them from then on.
+ */
+struct pos_params_s
+{
+    char  **params;                     /* the parameter strings */
+    size_t  start;                      /* index of $1 in params */
+    size_t  count;                      /* number of params, starting at start */
+    int     owned;                      /* do we free params when we're done? */
+    struct  pos_params_s *prev;         /* the frame we were pushed on top of */
+};
+
+/* the bottom frame (the shell's own arguments) */
+struct pos_params_s shell_params = { 0 };
+
+/* the current frame */
+struct pos_params_s *pos_params = &shell_params;
+
+/* the value of $0 */
+char *shell_name = "shell";
+
+
+/*
+ * free the parameter strings of the frame, if it owns them.
+ */
+void free_pos_params(struct pos_params_s *frame)
+{
+    if(frame->owned)
+    {
+        size_t i;
+        for(i = 0; i < frame->start+frame->count; i++)
+        {
+            free(frame->params[i]);
+        }
+        free(frame->params);
+    }
+    frame->params = NULL;
+    frame->start  = 0;
+    frame->count  = 0;
+    frame->owned  = 0;
+}
+
+
+/*
+ * set $0 and the shell's positional parameters from its command line
+ * arguments.. the strings are used in place, as they last as long as the
+ * shell does.
+ */
+void init_pos_params(char *name, int count, char **params)
+{
+    shell_name = name;
+    shell_params.params = params;
+    shell_params.start  = 0;
+    shell_params.count  = count;
+    shell_params.owned  = 0;
+}
+
+
+/*
+ * replace the positional parameters of the current frame with copies of the
+ * given strings.
+ *
+ * returns 1 on success, 0 if insufficient memory.
+ */
+int set_pos_params(int count, char **params)
+{
+    char **copy = malloc((count+1)*sizeof(char *));
+    int i;
+
+    if(!copy)
+    {
+        fprintf(stderr, "error: insufficient memory for positional parameters\n");
+        return 0;
+    }
+
+    for(i = 0; i < count; i++)
+    {
+        if(!(copy[i] = get_malloced_str(params[i])))
+        {
+            fprintf(stderr, "error: insufficient memory for positional parameters\n");
+            while(i--)
+            {
+                free(copy[i]);
+            }
+            free(copy);
+            return 0;
+        }
+    }
+    copy[count] = NULL;
+
+    free_pos_params(pos_params);
+    pos_params->params = copy;
+    pos_params->count  = count;
+    pos_params->owned  = 1;
+    return 1;
+}
+
+
+/*
+ * push a new frame with the given parameters, which must stay around until
+ * the frame is popped.
+ *
+ * returns 1 on success, 0 if insufficient memory.
+ */
+int push_pos_params(int count, char **params)
+{
+    struct pos_params_s *frame = malloc(sizeof(struct pos_params_s));
+    if(!frame)
+    {
+        fprintf(stderr, "error: insufficient memory for positional parameters\n");
+        return 0;
+    }
+
+    frame->params = params;
+    frame->start  = 0;
+    frame->count  = count;
+    frame->owned  = 0;
+    frame->prev   = pos_params;
+    pos_params    = frame;
+    return 1;
+}
+
+
+/*
+ * pop the current frame, restoring the parameters it was pushed on top of.
+ */
+void pop_pos_params(void)
+{
+    struct pos_params_s *frame = pos_params;
+    if(frame == &shell_params)
+    {
+        return;
+    }
+
+    pos_params = frame->prev;
+    free_pos_params(frame);
+    free(frame);
+}
+
+
+/*
+ * shift the positional parameters to the left by n.
+ *
+ * returns 1 on success, 0 if we have less than n parameters.
+ */
+int shift_pos_params(size_t n)
+{
+    if(n > pos_params->count)
+    {
+        return 0;
+    }
+    pos_params->start += n;
+    pos_params->count -= n;
+    return 1;
+}
+
+
+/*
+ * return the number of positional parameters ($#).
+ */
+size_t pos_params_count(void)
+{
+    return pos_params->count;
+}
+
+
+/*
+ * return the n-th positional parameter (n is 1-based, $0 being the shell's
+ * name), or NULL if it is not set.
+ */
+char *get_pos_param(size_t n)
+{
+    if(n == 0)
+    {
+        return shell_name;
+    }
+    if(n > pos_params->count)
+    {
+        return NULL;
+    }
+    return pos_params->params[pos_params->start+n-1];
+}
+
+
+/*
+ * join count positional parameters into one string, separated by sep, starting
+ * with the start-th one ($0 being the 0-th, and $1 the first).. if quote is
+ * non-zero, the parameters are escaped so that they can appear inside double
+ * quotes.
+ *
+ * returns the malloc'd string, or NULL if insufficient memory.
+ */
+char *pos_params_join(size_t start, size_t count, char *sep, int quote)
+{
+    char **p = pos_params->params+pos_params->start;
+    size_t seplen = strlen(sep), len = 0, i;
+    char *res, *s;
+
+    /* we only have $0 to $# */
+    if(start > pos_params->count)
+    {
+        count = 0;
+    }
+    else if(count > pos_params->count+1-start)
+    {
+        count = pos_params->count+1-start;
+    }
+
+    /* find the length of the result first, so we only alloc once */
+    for(i = start; i < start+count; i++)
+    {
+        char *q = i ? p[i-1] : shell_name;
+        len += (quote ? 2*strlen(q) : strlen(q)) + seplen;
+    }
+
+    if(!(res = malloc(len+1)))
+    {
+        fprintf(stderr, "error: insufficient memory to expand positional parameters\n");
+        return NULL;
+    }
+
+    for(s = res, i = start; i < start+count; i++)
+    {
+        if(i > start)
+        {
+            strcpy(s, sep);
+            s += seplen;
+        }
+
+        char *q = i ? p[i-1] : shell_name;
+        while(*q)
+        {
+            if(quote && strchr("\\\"$`", *q))
+            {
+                *s++ = '\\';
+            }
+            *s++ = *q++;
+        }
+    }
+    *s = '\0';
+    return res;
+}
+
+
+/*
+ * make a word list of the positional parameters, one word per parameter, for
+ * a "$@" word.. the parameters are not joined and split again, so they come
+ * out exactly as they are, whatever they contain.
+ *
+ * returns the word list, which is NULL if we have no parameters (or if
+ * insufficient memory).
+ */
+struct word_s *pos_params_words(void)
+{
+    struct word_s *head = NULL, *tail = NULL;
+    char **p = pos_params->params+pos_params->start;
+    size_t i;
+
+    for(i = 0; i < pos_params->count; i++)
+    {
+        struct word_s *w = make_word(p[i]);
+        if(!w)
+        {
+            fprintf(stderr, "error: insufficient memory to expand positional parameters\n");
+            free_all_words(head);
+            return NULL;
+        }
+
+        if(tail)
+        {
+            tail->next = w;
+        }
+        else
+        {
+            head = w;
+        }
+        tail = w;
+    }
+    return head;
+}
+
+
+/*
+ * check if name is a positional parameter ($0, $1, ...) or one of the special
+ * parameters that give all of them ($#, $@ and $*).
+ */
+int is_pos_param(char *name)
+{
+    if(strcmp(name, "#") == 0 || strcmp(name, "@") == 0 || strcmp(name, "*") == 0)
+    {
+        return 1;
+    }
+
+    if(!*name)
+    {
+        return 0;
+    }
+    while(*name >= '0' && *name <= '9')
+    {
+        name++;
+    }
+    return !*name;
+}
+
+
+/*
+ * expand $@ or $* (the name is given in tmp, without the $).. inside double
+ * quotes, "$@" gives a separate field for each parameter, so we close and
+ * reopen the double quotes between them and separate them with an $IFS char
+ * (this is only needed when "$@" is part of a bigger word, see word_expand()).
+ * "$*" gives one field, with the parameters separated by the first char of
+ * $IFS.
+ *
+ * returns the malloc'd expansion, or NULL if insufficient memory.
+ */
+char *pos_params_expand(char *tmp, int in_double_quotes)
+{
+    return pos_params_slice(tmp, in_double_quotes, 1, pos_params->count);
+}
+
+
+/*
+ * expand count parameters of $@ or $*, starting with the start-th one ($0
+ * being the 0-th).. this is ${@:offset:length}, which gives the same fields
+ * as $@ would if it only had the parameters in the range.
+ *
+ * returns the malloc'd expansion, or NULL if insufficient memory.
+ */
+char *pos_params_slice(char *tmp, int in_double_quotes, size_t start, size_t count)
+{
+    char c = get_IFS_sep();
+
+    if(*tmp == '*')
+    {
+        char sep[2] = { c, '\0' };
+        return pos_params_join(start, count, sep, 0);
+    }
+
+    if(in_double_quotes)
+    {
+        char sep[4] = { '"', c ? c : ' ', '"', '\0' };
+        return pos_params_join(start, count, sep, 1);
+    }
+
+    char sep[2] = { c ? c : ' ', '\0' };
+    return pos_params_join(start, count, sep, 0);
+}
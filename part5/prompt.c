@@ -23,33 +23,48 @@
 #include "shell.h"
 #include "symtab/symtab.h"
 
+/* do we print prompts? (not when we run a script file) */
+int interactive = 1;
+
 
 void print_prompt1(void)
 {
+    if(!interactive)
+    {
+        return;
+    }
+
     struct symtab_entry_s *entry = get_symtab_entry("PS1");
 
-    if(entry && entry->val)
+    if(entry && symtab_entry_getval(entry))
     {
-        fprintf(stderr, "%s", entry->val);
+        fprintf(stderr, "%s", symtab_entry_getval(entry));
     }
     else
     {
         fprintf(stderr, "$ ");
     }
+    flush_output();
 }
 
 
 void print_prompt2(void)
 {
+    if(!interactive)
+    {
+        return;
+    }
+
     struct symtab_entry_s *entry = get_symtab_entry("PS2");
 
-    if(entry && entry->val)
+    if(entry && symtab_entry_getval(entry))
     {
-        fprintf(stderr, "%s", entry->val);
+        fprintf(stderr, "%s", symtab_entry_getval(entry));
     }
     else
     {
         fprintf(stderr, "> ");
     }
+    flush_output();
 }
 
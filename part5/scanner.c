@@ -32,6 +32,9 @@ char *tok_buf = NULL;
 int   tok_bufsize  = 0;
 int   tok_bufindex = -1;
 
+/* a token pushed back by the parser, to be returned by tokenize() */
+struct token_s *pushed_tok = NULL;
+
 /* special token to indicate end of input */
 struct token_s eof_token = 
 {
@@ -96,10 +99,175 @@ void free_token(struct token_s *tok)
 }
 
 
+/*
+ * push back a token, so that the next call to tokenize() returns it.. passing
+ * NULL discards any pushed back token.
+ */
+void unget_token(struct token_s *tok)
+{
+    if(pushed_tok && pushed_tok != tok)
+    {
+        free_token(pushed_tok);
+    }
+    pushed_tok = tok;
+}
+
+
+/*
+ * get the regex operand of the =~ operator in a [[ ]] command.. unlike other
+ * words, a regex can contain unquoted '(', ')' and '|' chars (and whitespace
+ * inside parentheses), so it ends at the first unquoted whitespace char that
+ * is not inside parentheses.
+ */
+struct token_s *tokenize_regex(struct source_s *src)
+{
+    int depth = 0, endloop = 0, i;
+    char nc;
+
+    if(!tok_buf)
+    {
+        return tokenize(src);
+    }
+
+    skip_white_spaces(src);
+    tok_bufindex = 0;
+
+    while(!endloop && (nc = next_char(src)) != EOF && nc != ERRCHAR)
+    {
+        switch(nc)
+        {
+            case  '"':
+            case '\'':
+                add_to_buf(nc);
+                i = find_closing_quote(src->buffer+src->curpos);
+                if(!i)
+                {
+                    src->curpos = src->bufsize;
+                    fprintf(stderr, "error: missing closing quote '%c'\n", nc);
+                    return &eof_token;
+                }
+                while(i--)
+                {
+                    add_to_buf(next_char(src));
+                }
+                break;
+
+            case '\\':
+                add_to_buf(nc);
+                if((nc = next_char(src)) > 0)
+                {
+                    add_to_buf(nc);
+                }
+                break;
+
+            case '$':
+                add_to_buf(nc);
+                nc = peek_char(src);
+                if(nc == '{' || nc == '(')
+                {
+                    i = find_closing_brace(src->buffer+src->curpos+1);
+                    if(!i)
+                    {
+                        src->curpos = src->bufsize;
+                        fprintf(stderr, "error: missing closing brace '%c'\n", nc);
+                        return &eof_token;
+                    }
+                    /* the closing brace too, so it isn't taken as a paren of the regex */
+                    i++;
+                    while(i--)
+                    {
+                        add_to_buf(next_char(src));
+                    }
+                }
+                break;
+
+            case '(':
+                depth++;
+                add_to_buf(nc);
+                break;
+
+            case ')':
+                if(depth)
+                {
+                    depth--;
+                }
+                add_to_buf(nc);
+                break;
+
+            case '\n':
+                /*
+                 * the regex ends at the end of the line, even inside parens..
+                 * otherwise an unbalanced '(' would swallow the ']]' and the
+                 * lines after it.
+                 */
+                if(depth)
+                {
+                    src->curpos = src->bufsize;
+                    fprintf(stderr, "error: missing closing paren ')' in regex\n");
+                    return &eof_token;
+                }
+                unget_char(src);
+                endloop = 1;
+                break;
+
+            case ' ':
+            case '\t':
+                if(depth)
+                {
+                    add_to_buf(nc);
+                }
+                else
+                {
+                    endloop = 1;
+                }
+                break;
+
+            default:
+                add_to_buf(nc);
+                break;
+        }
+    }
+
+    if(depth)
+    {
+        fprintf(stderr, "error: missing closing paren ')' in regex\n");
+        return &eof_token;
+    }
+
+    if(tok_bufindex == 0)
+    {
+        return &eof_token;
+    }
+
+    if(tok_bufindex >= tok_bufsize)
+    {
+        tok_bufindex--;
+    }
+    tok_buf[tok_bufindex] = '\0';
+
+    struct token_s *tok = create_token(tok_buf);
+    if(!tok)
+    {
+        fprintf(stderr, "error: failed to alloc buffer: %s\n", strerror(errno));
+        return &eof_token;
+    }
+
+    tok->src = src;
+    return tok;
+}
+
+
 struct token_s *tokenize(struct source_s *src)
 {
     int  endloop = 0;
 
+    if(pushed_tok && pushed_tok->src == src)
+    {
+        struct token_s *tok = pushed_tok;
+        pushed_tok = NULL;
+        return tok;
+    }
+
     if(!src || !src->buffer || !src->bufsize)
     {
         errno = ENODATA;
@@ -201,6 +369,12 @@ struct token_s *tokenize(struct source_s *src)
                         return &eof_token;
                     }
 
+                    /*
+                     * add everything up to and including the closing brace..
+                     * a ')' must not end the word, as it does when it's an
+                     * operator.
+                     */
+                    i++;
 		    while(i--)
                     {
                         add_to_buf(next_char(src));
@@ -217,6 +391,84 @@ struct token_s *tokenize(struct source_s *src)
                 }
                 break;
 
+            case ';':
+            case '|':
+            case ')':
+                /* operators end the current word, and are tokens of their own */
+                if(tok_bufindex > 0)
+                {
+                    unget_char(src);
+                    endloop = 1;
+                    break;
+                }
+                add_to_buf(nc);
+                /* the two-char operators ';;' and '||' */
+                if(nc != ')' && peek_char(src) == nc)
+                {
+                    add_to_buf(next_char(src));
+                }
+                endloop = 1;
+                break;
+
+            case '(':
+                if(tok_bufindex > 0)
+                {
+                    /* an array assignment name=(...) is one word */
+                    tok_buf[tok_bufindex] = '\0';
+                    if(tok_buf[tok_bufindex-1] == '=' &&
+                       is_assignment(tok_buf) == (size_t)tok_bufindex-1)
+                    {
+                        add_to_buf(nc);
+                        i = find_closing_brace(src->buffer+src->curpos);
+                        if(!i)
+                        {
+                            /* failed to find matching brace. return error token */
+                            src->curpos = src->bufsize;
+                            fprintf(stderr, "error: missing closing brace '%c'\n", nc);
+                            return &eof_token;
+                        }
+
+                        while(i--)
+                        {
+                            add_to_buf(next_char(src));
+                        }
+                        break;
+                    }
+
+                    unget_char(src);
+                    endloop = 1;
+                    break;
+                }
+                add_to_buf(nc);
+                /*
+                 * a word starting with '((' is an arithmetic command.. add
+                 * everything up to the matching '))' to the token buffer, so
+                 * that the expression is kept in one piece.. a single '(' is
+                 * an operator.
+                 */
+                if(peek_char(src) != '(')
+                {
+                    endloop = 1;
+                }
+                else
+                {
+                    i = find_closing_brace(src->buffer+src->curpos);
+
+                    if(!i)
+                    {
+                        /* failed to find matching brace. return error token */
+                        src->curpos = src->bufsize;
+                        fprintf(stderr, "error: missing closing brace '%c'\n", nc);
+                        return &eof_token;
+                    }
+
+                    while(i--)
+                    {
+                        add_to_buf(next_char(src));
+                    }
+                }
+                break;
+
             case ' ':
             case '\t':
                 if(tok_bufindex > 0)
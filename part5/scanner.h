@@ -34,5 +34,7 @@ extern struct token_s eof_token;
 
 struct token_s *tokenize(struct source_s *src);
 void free_token(struct token_s *tok);
+void unget_token(struct token_s *tok);
+struct token_s *tokenize_regex(struct source_s *src);
 
 #endif
@@ -23,18 +23,36 @@
 #define SHELL_H
 
 #include <stddef.h>     /* size_t */
-#include <glob.h>
+#include <regex.h>      /* regex_t */
 #include "source.h"
 
+/* do we print prompts? (not when we run a script file) */
+extern int interactive;
+
 void print_prompt1(void);
 void print_prompt2(void);
 char *read_cmd(void);
+int  read_more_input(struct source_s *src);
 int  parse_and_execute(struct source_s *src);
 
 void initsh(void);
 
+/* buffered output (output.c) */
+void init_output(void);
+void flush_output(void);
+
 /* shell builtin utilities */
 int dump(int argc, char **argv);
+int declare(int argc, char **argv);
+int let(int argc, char **argv);
+int test(int argc, char **argv);
+int echo(int argc, char **argv);
+int printf_builtin(int argc, char **argv);
+int read_builtin(int argc, char **argv);
+int mapfile(int argc, char **argv);
+int shift(int argc, char **argv);
+int set(int argc, char **argv);
+int break_builtin(int argc, char **argv);
 
 /* struct for builtin utilities */
 struct builtin_s
@@ -52,15 +70,20 @@ extern int builtins_count;
 /* struct to represent the words resulting from word expansion */
 struct word_s
 {
-    char  *data;
-    int    len;
+    char  *data;                /* an rcstr (see strings.c), maybe shared with others */
+    size_t len;                 /* the length of data, kept up to date by everyone */
     struct word_s *next;
 };
 
 /* word expansion functions */
 struct  word_s *make_word(char *word);
+struct  word_s *make_wordn(char *str, size_t len);
+struct  word_s *make_word_ref(char *str, size_t len);
 void    free_all_words(struct word_s *first);
 
+int     is_name(char *str);
+size_t  is_assignment(char *str);
+char   *skip_subscript(char *str);
 size_t  find_closing_quote(char *data);
 size_t  find_closing_brace(char *data);
 void    delete_char_at(char *str, size_t index);
@@ -68,27 +91,92 @@ char   *substitute_str(char *s1, char *s2, size_t start, size_t end);
 char   *wordlist_to_str(struct word_s *word);
 
 struct  word_s *word_expand(char *orig_word);
+struct  word_s *word_expand_fields(char *orig_word);
+char   *word_expand_raw(char *orig_word, int *_expanded);
+char   *word_expand_single(char *word);
+char   *word_expand_pattern(char *word, char *specials);
 char   *word_expand_to_str(char *word);
 char   *tilde_expand(char *s);
 char   *command_substitute(char *__cmd);
 char   *var_expand(char *__var_name);
 char   *pos_params_expand(char *tmp, int in_double_quotes);
+char   *pos_params_slice(char *tmp, int in_double_quotes, size_t start, size_t count);
+int     is_pos_param(char *name);
 struct  word_s *pathnames_expand(struct word_s *words);
 struct  word_s *field_split(char *str);
+int     get_IFS_chars(char *IFS_space, char *IFS_delim);
+char    get_IFS_sep(void);
+char   *get_var_subscript(char *name);
+char   *array_expand_quoted(char *word, size_t len, size_t *nitems);
+int     substring_range(char *expr, size_t size, int neg_len, size_t *start, size_t *count);
 void    remove_quotes(struct word_s *wordlist);
+void    remove_word_quotes(struct word_s *word);
+
+/* brace expansion (braces.c) */
+char  **brace_expand(char *word, size_t *count);
+
+/* positional parameters (pos_params.c) */
+void    init_pos_params(char *name, int count, char **params);
+int     set_pos_params(int count, char **params);
+int     push_pos_params(int count, char **params);
+void    pop_pos_params(void);
+int     shift_pos_params(size_t n);
+size_t  pos_params_count(void);
+char   *get_pos_param(size_t n);
+char   *pos_params_join(size_t start, size_t count, char *sep, int quote);
+struct  word_s *pos_params_words(void);
 
 char   *arithm_expand(char *__expr);
+int     arithm_eval(char *expr, long *result);
+int     arithm_eval_float(char *expr, double *result);
+int     arithm_cond(char *expr);
+
+/* the exit status of the last command */
+extern int exit_status;
+void    set_exit_status(int status);
+
+/* loop control (see executor.c) */
+extern int loop_depth;
+extern int loop_jump;
+extern int loop_continue;
 
 /* some string manipulation functions */
 char   *strchr_any(char *string, char *chars);
+unsigned int str_hash(char *str);
+char   *get_malloced_str(char *str);
 char   *quote_val(char *val, int add_quotes);
 int     check_buffer_bounds(int *count, int *len, char ***buf);
 void    free_buffer(int len, char **buf);
+double  str_to_double(char *str, char **end);
+int     double_to_str(double val, char *buf, size_t size);
+size_t  expand_escapes(char *str, char *out, int echo_mode, int *stop);
+char   *rcstr_alloc(size_t size);
+char   *rcstr_dup(char *str, size_t len);
+char   *rcstr_ref(char *str);
+void    rcstr_unref(char *str);
+int     rcstr_shared(char *str);
+char   *rcstr_unshare(char *str, size_t len);
 
 /* pattern matching functions */
 int     has_glob_chars(char *p, size_t len);
 int     match_prefix(char *pattern, char *str, int longest);
 int     match_suffix(char *pattern, char *str, int longest);
-char  **get_filename_matches(char *pattern, glob_t *matches);
+char   *replace_match(char *pattern, char *str, char *rep, int mode);
+char  **get_filename_matches(char *pattern, int *count);
+void    flush_dir_cache(void);
+int     word_to_glob(char *word, char *pat, char *lit);
+struct  glob_pat_s;
+struct  glob_pat_s *get_glob_pat(char *pattern);
+void    release_glob_pat(struct glob_pat_s *pat);
+int     glob_match(struct glob_pat_s *pat, char *str);
+char   *convert_case(char *str, int upper, int all, struct glob_pat_s *pat);
+regex_t *get_regex(char *pattern, int flags);
+
+/* case clause dispatch tables */
+struct  case_table_s;
+struct  case_table_s *new_case_table(void);
+void    free_case_table(struct case_table_s *table);
+int     case_table_add(struct case_table_s *table, char *word, int item);
+int     case_table_lookup(struct case_table_s *table, char *str);
 
 #endif
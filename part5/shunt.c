@@ -43,34 +43,343 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <math.h>
 #include "shell.h"
 #include "symtab/symtab.h"
 
-#define MAXOPSTACK          64
-#define MAXNUMSTACK         64
 #define MAXBASE             36
 
+/*
+ * the operator and operand stacks start with this many items, which are kept
+ * inside the evaluation context itself (i.e. on the caller's stack).. deeper
+ * expressions make the stacks grow on the heap as needed.
+ */
+#define ARITHM_STACK_INIT   64
+
+/* maximum nesting level of expressions stored in variables */
+#define MAX_ARITHM_DEPTH    128
+
 struct stack_item_s
 {
 #define ITEM_LONG_INT       1
 #define ITEM_VAR_PTR        2
+#define ITEM_DOUBLE         3
     int  type;
     union
     {
-        long val;
+        long   val;
+        double fval;
         struct symtab_entry_s *ptr;
     };
 };
 
-struct op_s *opstack[MAXOPSTACK];
-int    nopstack  = 0;
+/*
+ * a shell variable referenced by a compiled expression.. the variable is bound
+ * to its symbol table entry the first time it is used, and the binding is
+ * reused for as long as the symbol table stack stays the same (i.e. no entries
+ * were added or removed since we did the lookup).
+ */
+struct arithm_var_s
+{
+    char   *name;                       /* the variable's name */
+    struct  symtab_entry_s *entry;      /* the bound symbol table entry */
+    unsigned long generation;           /* symtab generation at binding time */
+};
+
+/* instruction types of a compiled expression */
+#define INS_PUSH_NUM        1           /* push a numeric constant */
+#define INS_PUSH_VAR        2           /* push a variable reference */
+#define INS_OP              3           /* apply an operator */
+#define INS_JZ              4           /* pop, if zero push 0 and jump (&&) */
+#define INS_JNZ             5           /* pop, if non-zero push 1 and jump (||) */
+#define INS_JFALSE          6           /* pop, if zero jump (?:) */
+#define INS_JMP             7           /* jump unconditionally */
+#define INS_BOOL            8           /* replace the top operand by 0 or 1 */
+#define INS_PUSH_FNUM       9           /* push a floating point constant */
+#define INS_FUNC            10          /* call a math function */
+
+struct arithm_ins_s
+{
+    int type;
+    union
+    {
+        long   val;                     /* INS_PUSH_NUM */
+        double fval;                    /* INS_PUSH_FNUM */
+        struct arithm_func_s *func;     /* INS_FUNC */
+        int    var;                     /* INS_PUSH_VAR (index in the vars list) */
+        struct op_s *op;                /* INS_OP */
+        int    jump;                    /* INS_J* (index of the target instruction) */
+    };
+};
+
+/*
+ * an item on the operator stack.. the &&, || and ? operators remember the
+ * index of the jump instruction we emitted for them, so we can set the jump's
+ * target when the operator is popped and its right operand is complete.
+ */
+struct opstack_item_s
+{
+    struct op_s *op;
+    int          jump;
+    struct arithm_func_s *func;         /* the function, if this '(' starts a call */
+    int          nargs;                 /* number of the function's arguments seen */
+};
+
+/*
+ * a math function we can call in floating point expressions.
+ */
+struct arithm_func_s
+{
+    char   *name;
+    int     nargs;                      /* 1 or 2 */
+    double (*f1)(double);
+    double (*f2)(double, double);
+};
+
+/*
+ * an arithmetic expression, compiled to Reverse Polish Notation (RPN).
+ */
+struct arithm_prog_s
+{
+    char   *expr;                       /* the expression's text */
+    unsigned int hash;                  /* hash of the expression's text */
+    int     refs;                       /* reference count */
+    struct  arithm_ins_s *ins;          /* the instructions */
+    int     nins, ins_size;             /* used and alloc'd instruction count */
+    struct  arithm_var_s *vars;         /* the variables referenced */
+    int     nvars, vars_size;           /* used and alloc'd variable count */
+    int     max_stack;                  /* max. operand stack depth needed */
+    int     fp;                         /* 1 if floating point expression */
+    struct  arithm_prog_s *hash_next;   /* next program in the hash bucket */
+    struct  arithm_prog_s *lru_prev,    /* neighbours in the cache's LRU list */
+                          *lru_next;
+};
+
+/*
+ * the state of one arithmetic compilation or evaluation.. each call gets its
+ * own context, so that nested evaluations (e.g. a variable whose value is
+ * itself an expression) don't clobber the outer evaluation's stacks.
+ */
+struct arithm_ctx_s
+{
+    struct opstack_item_s *opstack;     /* the operator stack */
+    int                   nopstack;     /* number of items on the operator stack */
+    int                   opstack_size; /* alloc'd size of the operator stack */
+    struct stack_item_s  *numstack;     /* the operand stack */
+    int                   nnumstack;    /* number of items on the operand stack */
+    int                   numstack_size;/* alloc'd size of the operand stack */
+    int                   error;        /* set if an error occurred */
+    int                   depth;        /* nesting level of this evaluation */
+    struct arithm_prog_s *prog;         /* the program we are compiling */
+    struct opstack_item_s opstack_buf [ARITHM_STACK_INIT];
+    struct stack_item_s   numstack_buf[ARITHM_STACK_INIT];
+};
+
+int do_arithm_expand(char *expr, int depth, int fp, struct stack_item_s *result);
+
+
+/*
+ * initialize an evaluation context.
+ */
+void init_arithm_ctx(struct arithm_ctx_s *ctx, int depth)
+{
+    ctx->opstack       = ctx->opstack_buf;
+    ctx->nopstack      = 0;
+    ctx->opstack_size  = ARITHM_STACK_INIT;
+    ctx->numstack      = ctx->numstack_buf;
+    ctx->nnumstack     = 0;
+    ctx->numstack_size = ARITHM_STACK_INIT;
+    ctx->error         = 0;
+    ctx->depth         = depth;
+    ctx->prog          = NULL;
+}
+
+
+/*
+ * free the memory used by an evaluation context's stacks, if they have
+ * outgrown the context's internal buffers.
+ */
+void free_arithm_ctx(struct arithm_ctx_s *ctx)
+{
+    if(ctx->opstack != ctx->opstack_buf)
+    {
+        free(ctx->opstack);
+        ctx->opstack = ctx->opstack_buf;
+    }
+
+    if(ctx->numstack != ctx->numstack_buf)
+    {
+        free(ctx->numstack);
+        ctx->numstack = ctx->numstack_buf;
+    }
+}
+
+
+/*
+ * double the size of a stack, moving it to the heap if it is still using
+ * the context's internal buffer.
+ *
+ * returns the new stack, or NULL if insufficient memory.
+ */
+void *grow_stack(void *stack, void *internal_buf, int *size, size_t item_size)
+{
+    int   newsize = (*size) * 2;
+    void *stack2;
+
+    if(stack == internal_buf)
+    {
+        if((stack2 = malloc(newsize*item_size)))
+        {
+            memcpy(stack2, stack, (*size)*item_size);
+        }
+    }
+    else
+    {
+        stack2 = realloc(stack, newsize*item_size);
+    }
+
+    if(stack2)
+    {
+        *size = newsize;
+    }
+
+    return stack2;
+}
+
+
+/*
+ * get the numeric value of a shell variable.. if the value is not a decimal
+ * number, we evaluate it as an arithmetic expression in its own context (this
+ * is what bash and ksh do).
+ */
+long var_long_value(struct arithm_ctx_s *ctx, struct symtab_entry_s *entry)
+{
+    /* the variable already has a native value */
+    if(entry->num_type == VAL_SINT)
+    {
+        return entry->num.sint;
+    }
+    else if(entry->num_type == VAL_FLOAT)
+    {
+        return (long)entry->num.sfloat;
+    }
+
+    char *val = symtab_entry_getval(entry), *end;
+
+    if(!val)
+    {
+        return 0;
+    }
+
+    long num = strtol(val, &end, 10);
+
+    while(isspace(*end))
+    {
+        end++;
+    }
+
+    if(*end == '\0' && end != val)
+    {
+        /* remember the number so we don't have to parse it again */
+        entry->num_type = VAL_SINT;
+        entry->num.sint = num;
+        return num;
+    }
+
+    if(ctx->depth >= MAX_ARITHM_DEPTH)
+    {
+        fprintf(stderr, "error: %s: expression recursion level exceeded\n", entry->name);
+        ctx->error = 1;
+        return 0;
+    }
+
+    struct stack_item_s res;
+    if(!do_arithm_expand(val, ctx->depth+1, 0, &res))
+    {
+        ctx->error = 1;
+        return 0;
+    }
+
+    return res.val;
+}
+
+
+/*
+ * get the floating point value of a shell variable.. similar to the above,
+ * except that a value which is not a number is evaluated as a floating point
+ * expression.
+ */
+double var_double_value(struct arithm_ctx_s *ctx, struct symtab_entry_s *entry)
+{
+    if(entry->num_type == VAL_FLOAT)
+    {
+        return entry->num.sfloat;
+    }
+    else if(entry->num_type == VAL_SINT)
+    {
+        return (double)entry->num.sint;
+    }
+
+    char *val = symtab_entry_getval(entry), *end;
+
+    if(!val)
+    {
+        return 0;
+    }
+
+    /*
+     * remember an integer so we don't have to parse it again, as the integer
+     * mode does.. a floating point number is not remembered, as the integer
+     * mode would then take it (and truncate it) instead of rejecting the
+     * string.
+     */
+    errno = 0;
+    long lnum = strtol(val, &end, 10);
+
+    while(isspace(*end))
+    {
+        end++;
+    }
+
+    if(*end == '\0' && end != val && errno != ERANGE)
+    {
+        entry->num_type = VAL_SINT;
+        entry->num.sint = lnum;
+        return (double)lnum;
+    }
+
+    double num = str_to_double(val, &end);
+
+    while(isspace(*end))
+    {
+        end++;
+    }
+
+    if(*end == '\0' && end != val)
+    {
+        return num;
+    }
+
+    if(ctx->depth >= MAX_ARITHM_DEPTH)
+    {
+        fprintf(stderr, "error: %s: expression recursion level exceeded\n", entry->name);
+        ctx->error = 1;
+        return 0;
+    }
+
+    struct stack_item_s res;
+    if(!do_arithm_expand(val, ctx->depth+1, 1, &res))
+    {
+        ctx->error = 1;
+        return 0;
+    }
 
-struct stack_item_s numstack[MAXNUMSTACK];
-int    nnumstack = 0;
-int    error     = 0;
+    return res.fval;
+}
 
 
-long long_value(struct stack_item_s *a)
+long long_value(struct arithm_ctx_s *ctx, struct stack_item_s *a)
 {
     if(a->type == ITEM_LONG_INT)
     {
@@ -78,112 +387,135 @@ long long_value(struct stack_item_s *a)
     }
     else if(a->type == ITEM_VAR_PTR)
     {
-        if(a->ptr->val)
-        {
-            return atol(a->ptr->val);
-        }
+        return var_long_value(ctx, a->ptr);
+    }
+    else if(a->type == ITEM_DOUBLE)
+    {
+        return (long)a->fval;
     }
     return 0;
 }
 
-long eval_uminus (struct stack_item_s *a1, struct stack_item_s *a2 __attribute__ ((unused)) )
+
+double double_value(struct arithm_ctx_s *ctx, struct stack_item_s *a)
 {
-    return -long_value(a1);
+    if(a->type == ITEM_DOUBLE)
+    {
+        return a->fval;
+    }
+    else if(a->type == ITEM_VAR_PTR)
+    {
+        return var_double_value(ctx, a->ptr);
+    }
+    else if(a->type == ITEM_LONG_INT)
+    {
+        return (double)a->val;
+    }
+    return 0;
 }
 
-long eval_uplus  (struct stack_item_s *a1, struct stack_item_s *a2 __attribute__ ((unused)) )
+long eval_uminus (struct arithm_ctx_s *ctx, struct stack_item_s *a1,
+                  struct stack_item_s *a2 __attribute__ ((unused)) )
 {
-    return  long_value(a1);
+    return -long_value(ctx, a1);
 }
 
-long eval_lognot(struct stack_item_s *a1, struct stack_item_s *a2 __attribute__ ((unused)) )
+long eval_uplus  (struct arithm_ctx_s *ctx, struct stack_item_s *a1,
+                  struct stack_item_s *a2 __attribute__ ((unused)) )
 {
-    return !long_value(a1);
+    return  long_value(ctx, a1);
 }
 
-long eval_bitnot(struct stack_item_s *a1, struct stack_item_s *a2 __attribute__ ((unused)) )
+long eval_lognot(struct arithm_ctx_s *ctx, struct stack_item_s *a1,
+                  struct stack_item_s *a2 __attribute__ ((unused)) )
 {
-    return ~long_value(a1);
+    return !long_value(ctx, a1);
 }
 
-long eval_mult(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_bitnot(struct arithm_ctx_s *ctx, struct stack_item_s *a1,
+                  struct stack_item_s *a2 __attribute__ ((unused)) )
 {
-    return long_value(a1) * long_value(a2);
+    return ~long_value(ctx, a1);
 }
 
-long eval_add(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_mult(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return long_value(a1) + long_value(a2);
+    return long_value(ctx, a1) * long_value(ctx, a2);
 }
 
-long eval_sub(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_add(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return long_value(a1) - long_value(a2);
+    return long_value(ctx, a1) + long_value(ctx, a2);
 }
 
-long eval_lsh(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_sub(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return long_value(a1) << long_value(a2);
+    return long_value(ctx, a1) - long_value(ctx, a2);
 }
 
-long eval_rsh(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_lsh(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return long_value(a1) >> long_value(a2);
+    return long_value(ctx, a1) << long_value(ctx, a2);
 }
 
-long eval_lt(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_rsh(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return long_value(a1) < long_value(a2);
+    return long_value(ctx, a1) >> long_value(ctx, a2);
 }
 
-long eval_le(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_lt(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return long_value(a1) <= long_value(a2);
+    return long_value(ctx, a1) < long_value(ctx, a2);
 }
 
-long eval_gt(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_le(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return long_value(a1) > long_value(a2);
+    return long_value(ctx, a1) <= long_value(ctx, a2);
 }
 
-long eval_ge(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_gt(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return long_value(a1) >= long_value(a2);
+    return long_value(ctx, a1) > long_value(ctx, a2);
 }
 
-long eval_eq(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_ge(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return long_value(a1) == long_value(a2);
+    return long_value(ctx, a1) >= long_value(ctx, a2);
 }
 
-long eval_ne(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_eq(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return long_value(a1) != long_value(a2);
+    return long_value(ctx, a1) == long_value(ctx, a2);
 }
 
-long eval_bitand(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_ne(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return long_value(a1) & long_value(a2);
+    return long_value(ctx, a1) != long_value(ctx, a2);
 }
 
-long eval_bitxor(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_bitand(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return long_value(a1) ^ long_value(a2);
+    return long_value(ctx, a1) & long_value(ctx, a2);
 }
 
-long eval_bitor(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_bitxor(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return long_value(a1) | long_value(a2);
+    return long_value(ctx, a1) ^ long_value(ctx, a2);
 }
 
-long eval_logand(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_bitor(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return long_value(a1) && long_value(a2);
+    return long_value(ctx, a1) | long_value(ctx, a2);
 }
 
-long eval_logor(struct stack_item_s *a1, struct stack_item_s *a2)
+/*
+ * the left operand of the comma operator has already been evaluated (for its
+ * side effects), and its value is discarded.
+ */
+long eval_comma(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return long_value(a1) || long_value(a2);
+    (void)a1;
+    return long_value(ctx, a2);
 }
 
 long do_eval_exp(long a1, long a2)
@@ -191,116 +523,124 @@ long do_eval_exp(long a1, long a2)
     return a2 < 0 ? 0 : (a2 == 0 ? 1 : a1 * do_eval_exp(a1, a2-1));
 }
 
-long eval_exp(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_exp(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return do_eval_exp(long_value(a1), long_value(a2));
+    return do_eval_exp(long_value(ctx, a1), long_value(ctx, a2));
 }
 
-long eval_div(struct stack_item_s *a1, struct stack_item_s *a2) 
+long eval_div(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2) 
 {
-    error = 0;
-    long n2 = long_value(a2);
+    ctx->error = 0;
+    long n2 = long_value(ctx, a2);
     if(!n2)
     {
         fprintf(stderr, "error: Division by zero\n");
-        error = 1;
+        ctx->error = 1;
         return 0;
     }
-    return long_value(a1) / n2;
+    long n1 = long_value(ctx, a1);
+    /* LONG_MIN / -1 overflows (and traps on most machines).. it wraps, like bash */
+    if(n2 == -1)
+    {
+        return (long)(0UL - (unsigned long)n1);
+    }
+    return n1 / n2;
 }
 
-long eval_mod(struct stack_item_s *a1, struct stack_item_s *a2) 
+long eval_mod(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2) 
 {
-    error = 0;
-    long n2 = long_value(a2);
+    ctx->error = 0;
+    long n2 = long_value(ctx, a2);
     if(!n2)
     {
         fprintf(stderr, "error: Division by zero\n");
-        error = 1;
+        ctx->error = 1;
+        return 0;
+    }
+    long n1 = long_value(ctx, a1);
+    /* LONG_MIN % -1 traps too, although the result is always 0 */
+    if(n2 == -1)
+    {
         return 0;
     }
-    return long_value(a1) % n2;
+    return n1 % n2;
 }
 
-long eval_assign(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_assign(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    long val = long_value(a2);
+    long val = long_value(ctx, a2);
     if(a1->type == ITEM_VAR_PTR)
     {
-        char buf[16];
-        sprintf(buf, "%ld", val);
-        symtab_entry_setval(a1->ptr, buf);
+        symtab_entry_setlong(a1->ptr, val);
     }
     return val;
 }
 
-long do_eval_assign_ext(long (*f)(struct stack_item_s *a1, struct stack_item_s *a2),
-            struct stack_item_s *a1, struct stack_item_s *a2)
+long do_eval_assign_ext(long (*f)(struct arithm_ctx_s *ctx, struct stack_item_s *a1,
+                                  struct stack_item_s *a2),
+            struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    long val = f(a1, a2);
+    long val = f(ctx, a1, a2);
     if(a1->type == ITEM_VAR_PTR)
     {
-        char buf[16];
-        sprintf(buf, "%ld", val);
-        symtab_entry_setval(a1->ptr, buf);
+        symtab_entry_setlong(a1->ptr, val);
     }
     return val;
 }
 
-long eval_assign_add(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_assign_add(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return do_eval_assign_ext(eval_add, a1, a2);
+    return do_eval_assign_ext(eval_add, ctx, a1, a2);
 }
 
-long eval_assign_sub(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_assign_sub(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return do_eval_assign_ext(eval_sub, a1, a2);
+    return do_eval_assign_ext(eval_sub, ctx, a1, a2);
 }
 
-long eval_assign_mult(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_assign_mult(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return do_eval_assign_ext(eval_mult, a1, a2);
+    return do_eval_assign_ext(eval_mult, ctx, a1, a2);
 }
 
-long eval_assign_div(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_assign_div(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return do_eval_assign_ext(eval_div, a1, a2);
+    return do_eval_assign_ext(eval_div, ctx, a1, a2);
 }
 
-long eval_assign_mod(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_assign_mod(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return do_eval_assign_ext(eval_mod, a1, a2);
+    return do_eval_assign_ext(eval_mod, ctx, a1, a2);
 }
 
-long eval_assign_lsh(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_assign_lsh(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return do_eval_assign_ext(eval_lsh, a1, a2);
+    return do_eval_assign_ext(eval_lsh, ctx, a1, a2);
 }
 
-long eval_assign_rsh(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_assign_rsh(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return do_eval_assign_ext(eval_rsh, a1, a2);
+    return do_eval_assign_ext(eval_rsh, ctx, a1, a2);
 }
 
-long eval_assign_and(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_assign_and(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return do_eval_assign_ext(eval_bitand, a1, a2);
+    return do_eval_assign_ext(eval_bitand, ctx, a1, a2);
 }
 
-long eval_assign_xor(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_assign_xor(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return do_eval_assign_ext(eval_bitxor, a1, a2);
+    return do_eval_assign_ext(eval_bitxor, ctx, a1, a2);
 }
 
-long eval_assign_or(struct stack_item_s *a1, struct stack_item_s *a2)
+long eval_assign_or(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2)
 {
-    return do_eval_assign_ext(eval_bitor, a1, a2);
+    return do_eval_assign_ext(eval_bitor, ctx, a1, a2);
 }
 
-long do_eval_inc_dec(int pre, int add, struct stack_item_s *a1)
+long do_eval_inc_dec(int pre, int add, struct arithm_ctx_s *ctx, struct stack_item_s *a1)
 {
-    long val = long_value(a1);
-    char buf[16];
+    long val = long_value(ctx, a1);
     if(pre)
     {
         if(add)
@@ -314,8 +654,7 @@ long do_eval_inc_dec(int pre, int add, struct stack_item_s *a1)
         
         if(a1->type == ITEM_VAR_PTR)
         {
-            sprintf(buf, "%ld", val);
-            symtab_entry_setval(a1->ptr, buf);
+            symtab_entry_setlong(a1->ptr, val);
         }
     }
     else
@@ -323,31 +662,34 @@ long do_eval_inc_dec(int pre, int add, struct stack_item_s *a1)
         int diff = add ? 1 : -1;
         if(a1->type == ITEM_VAR_PTR)
         {
-            sprintf(buf, "%ld", val+diff);
-            symtab_entry_setval(a1->ptr, buf);
+            symtab_entry_setlong(a1->ptr, val+diff);
         }
     }
     return val;
 }
 
-long eval_postinc(struct stack_item_s *a1, struct stack_item_s *unused __attribute__((unused)))
+long eval_postinc(struct arithm_ctx_s *ctx, struct stack_item_s *a1,
+                  struct stack_item_s *unused __attribute__((unused)))
 {
-    return do_eval_inc_dec(0, 1, a1);
+    return do_eval_inc_dec(0, 1, ctx, a1);
 }
 
-long eval_postdec(struct stack_item_s *a1, struct stack_item_s *unused __attribute__((unused)))
+long eval_postdec(struct arithm_ctx_s *ctx, struct stack_item_s *a1,
+                  struct stack_item_s *unused __attribute__((unused)))
 {
-    return do_eval_inc_dec(0, 0, a1);
+    return do_eval_inc_dec(0, 0, ctx, a1);
 }
 
-long eval_preinc(struct stack_item_s *a1, struct stack_item_s *unused __attribute__((unused)))
+long eval_preinc(struct arithm_ctx_s *ctx, struct stack_item_s *a1,
+                  struct stack_item_s *unused __attribute__((unused)))
 {
-    return do_eval_inc_dec(1, 1, a1);
+    return do_eval_inc_dec(1, 1, ctx, a1);
 }
 
-long eval_predec(struct stack_item_s *a1, struct stack_item_s *unused __attribute__((unused)))
+long eval_predec(struct arithm_ctx_s *ctx, struct stack_item_s *a1,
+                  struct stack_item_s *unused __attribute__((unused)))
 {
-    return do_eval_inc_dec(1, 0, a1);
+    return do_eval_inc_dec(1, 0, ctx, a1);
 }
 
 
@@ -398,13 +740,13 @@ struct op_s
     int  assoc;
     char unary;
     char chars;
-    long (*eval)(struct stack_item_s *a1, struct stack_item_s *a2);
+    long (*eval)(struct arithm_ctx_s *ctx, struct stack_item_s *a1, struct stack_item_s *a2);
 } arithm_ops[] =
 {
     { CH_POST_INC     , 20, ASSOC_LEFT , 1, 2, eval_postinc       },
     { CH_POST_DEC     , 20, ASSOC_LEFT , 1, 2, eval_postdec       },
-    { CH_PRE_INC      , 19, ASSOC_RIGHT, 1, 2, eval_postinc       },
-    { CH_PRE_DEC      , 19, ASSOC_RIGHT, 1, 2, eval_postdec       },
+    { CH_PRE_INC      , 19, ASSOC_RIGHT, 1, 2, eval_preinc        },
+    { CH_PRE_DEC      , 19, ASSOC_RIGHT, 1, 2, eval_predec        },
     { CH_MINUS        , 19, ASSOC_RIGHT, 1, 1, eval_uminus        },
     { CH_PLUS         , 19, ASSOC_RIGHT, 1, 1, eval_uplus         },
     { '!'             , 19, ASSOC_RIGHT, 1, 1, eval_lognot        },
@@ -426,23 +768,22 @@ struct op_s
     { '&'             , 12, ASSOC_LEFT , 0, 1, eval_bitand        },
     { '^'             , 11, ASSOC_LEFT , 0, 1, eval_bitxor        },
     { '|'             , 10, ASSOC_LEFT , 0, 1, eval_bitor         },
-    { CH_AND          , 9 , ASSOC_LEFT , 0, 2, eval_logand        },
-    { CH_OR           , 8 , ASSOC_LEFT , 0, 2, eval_logor         },
-    { CH_ASSIGN       , 7 , ASSOC_RIGHT, 0, 1, eval_assign        },
-    { CH_ASSIGN_PLUS  , 7 , ASSOC_RIGHT, 0, 2, eval_assign_add    },
-    { CH_ASSIGN_MINUS , 7 , ASSOC_RIGHT, 0, 2, eval_assign_sub    },
-    { CH_ASSIGN_MULT  , 7 , ASSOC_RIGHT, 0, 2, eval_assign_mult   },
-    { CH_ASSIGN_DIV   , 7 , ASSOC_RIGHT, 0, 2, eval_assign_div    },
-    { CH_ASSIGN_MOD   , 7 , ASSOC_RIGHT, 0, 2, eval_assign_mod    },
-    { CH_ASSIGN_LSH   , 7 , ASSOC_RIGHT, 0, 3, eval_assign_lsh    },
-    { CH_ASSIGN_RSH   , 7 , ASSOC_RIGHT, 0, 3, eval_assign_rsh    },
-    { CH_ASSIGN_AND   , 7 , ASSOC_RIGHT, 0, 2, eval_assign_and    },
-    { CH_ASSIGN_XOR   , 7 , ASSOC_RIGHT, 0, 2, eval_assign_xor    },
-    { CH_ASSIGN_OR    , 7 , ASSOC_RIGHT, 0, 2, eval_assign_or     },
-
-    /*
-     * TODO: add the comma ',' and ternary '?:' operators.
-     */
+    { CH_AND          , 9 , ASSOC_LEFT , 0, 2, NULL               },
+    { CH_OR           , 8 , ASSOC_LEFT , 0, 2, NULL               },
+    { '?'             , 7 , ASSOC_RIGHT, 0, 1, NULL               },
+    { ':'             , 7 , ASSOC_RIGHT, 0, 1, NULL               },
+    { CH_ASSIGN       , 6 , ASSOC_RIGHT, 0, 1, eval_assign        },
+    { CH_ASSIGN_PLUS  , 6 , ASSOC_RIGHT, 0, 2, eval_assign_add    },
+    { CH_ASSIGN_MINUS , 6 , ASSOC_RIGHT, 0, 2, eval_assign_sub    },
+    { CH_ASSIGN_MULT  , 6 , ASSOC_RIGHT, 0, 2, eval_assign_mult   },
+    { CH_ASSIGN_DIV   , 6 , ASSOC_RIGHT, 0, 2, eval_assign_div    },
+    { CH_ASSIGN_MOD   , 6 , ASSOC_RIGHT, 0, 2, eval_assign_mod    },
+    { CH_ASSIGN_LSH   , 6 , ASSOC_RIGHT, 0, 3, eval_assign_lsh    },
+    { CH_ASSIGN_RSH   , 6 , ASSOC_RIGHT, 0, 3, eval_assign_rsh    },
+    { CH_ASSIGN_AND   , 6 , ASSOC_RIGHT, 0, 2, eval_assign_and    },
+    { CH_ASSIGN_XOR   , 6 , ASSOC_RIGHT, 0, 2, eval_assign_xor    },
+    { CH_ASSIGN_OR    , 6 , ASSOC_RIGHT, 0, 2, eval_assign_or     },
+    { ','             , 5 , ASSOC_LEFT , 0, 1, eval_comma         },
 
     { '('             , 0 , ASSOC_NONE , 0, 1, NULL               },
     { ')'             , 0 , ASSOC_NONE , 0, 1, NULL               }
@@ -475,19 +816,146 @@ struct op_s *OP_BIT_XOR      = &arithm_ops[23];
 struct op_s *OP_BIT_OR       = &arithm_ops[24];
 struct op_s *OP_LOG_AND      = &arithm_ops[25];
 struct op_s *OP_LOG_OR       = &arithm_ops[26];
-struct op_s *OP_ASSIGN       = &arithm_ops[27];
-struct op_s *OP_ASSIGN_ADD   = &arithm_ops[28];
-struct op_s *OP_ASSIGN_SUB   = &arithm_ops[29];
-struct op_s *OP_ASSIGN_MULT  = &arithm_ops[30];
-struct op_s *OP_ASSIGN_DIV   = &arithm_ops[31];
-struct op_s *OP_ASSIGN_MOD   = &arithm_ops[32];
-struct op_s *OP_ASSIGN_LSH   = &arithm_ops[33];
-struct op_s *OP_ASSIGN_RSH   = &arithm_ops[34];
-struct op_s *OP_ASSIGN_AND   = &arithm_ops[35];
-struct op_s *OP_ASSIGN_XOR   = &arithm_ops[36];
-struct op_s *OP_ASSIGN_OR    = &arithm_ops[37];
-struct op_s *OP_LBRACE       = &arithm_ops[38];
-struct op_s *OP_RBRACE       = &arithm_ops[39];
+struct op_s *OP_COND         = &arithm_ops[27];
+struct op_s *OP_COND_ELSE    = &arithm_ops[28];
+struct op_s *OP_ASSIGN       = &arithm_ops[29];
+struct op_s *OP_ASSIGN_ADD   = &arithm_ops[30];
+struct op_s *OP_ASSIGN_SUB   = &arithm_ops[31];
+struct op_s *OP_ASSIGN_MULT  = &arithm_ops[32];
+struct op_s *OP_ASSIGN_DIV   = &arithm_ops[33];
+struct op_s *OP_ASSIGN_MOD   = &arithm_ops[34];
+struct op_s *OP_ASSIGN_LSH   = &arithm_ops[35];
+struct op_s *OP_ASSIGN_RSH   = &arithm_ops[36];
+struct op_s *OP_ASSIGN_AND   = &arithm_ops[37];
+struct op_s *OP_ASSIGN_XOR   = &arithm_ops[38];
+struct op_s *OP_ASSIGN_OR    = &arithm_ops[39];
+struct op_s *OP_COMMA        = &arithm_ops[40];
+struct op_s *OP_LBRACE       = &arithm_ops[41];
+struct op_s *OP_RBRACE       = &arithm_ops[42];
+
+
+/*
+ * the math functions we support in floating point expressions.
+ */
+struct arithm_func_s arithm_funcs[] =
+{
+    { "sqrt" , 1, sqrt , NULL  },
+    { "log"  , 1, log  , NULL  },
+    { "exp"  , 1, exp  , NULL  },
+    { "floor", 1, floor, NULL  },
+    { "ceil" , 1, ceil , NULL  },
+    { "fabs" , 1, fabs , NULL  },
+    { "pow"  , 2, NULL , pow   },
+};
+
+#define ARITHM_FUNC_COUNT   (sizeof(arithm_funcs)/sizeof(struct arithm_func_s))
+
+
+/*
+ * get the math function with the given name.
+ *
+ * returns the function, or NULL if there is no such function.
+ */
+struct arithm_func_s *get_arithm_func(char *name, int len)
+{
+    size_t i;
+    for(i = 0; i < ARITHM_FUNC_COUNT; i++)
+    {
+        if(strncmp(arithm_funcs[i].name, name, len) == 0 &&
+           arithm_funcs[i].name[len] == '\0')
+        {
+            return &arithm_funcs[i];
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * check if the given operator can be used in floating point expressions.
+ * bitwise operators and shifts only make sense for integers.
+ */
+int is_float_op(struct op_s *op)
+{
+    switch(op->op)
+    {
+        case '~':
+        case '&':
+        case '|':
+        case '^':
+        case CH_LSH:
+        case CH_RSH:
+        case CH_ASSIGN_LSH:
+        case CH_ASSIGN_RSH:
+        case CH_ASSIGN_AND:
+        case CH_ASSIGN_XOR:
+        case CH_ASSIGN_OR:
+            return 0;
+    }
+    return 1;
+}
+
+
+/*
+ * store the result of a floating point assignment in the variable.
+ */
+double float_assign(struct stack_item_s *a1, double val)
+{
+    if(a1->type == ITEM_VAR_PTR)
+    {
+        symtab_entry_setdouble(a1->ptr, val);
+    }
+    return val;
+}
+
+
+/*
+ * apply an operator to floating point operands.. division by zero gives an
+ * infinity (or NaN), like it does in C.
+ *
+ * returns the result.
+ */
+double eval_float_op(struct arithm_ctx_s *ctx, struct op_s *op,
+                     struct stack_item_s *a1, struct stack_item_s *a2)
+{
+    /* a plain assignment doesn't need the variable's old value */
+    double n1 = (op->op == CH_ASSIGN) ? 0 : double_value(ctx, a1);
+    double n2 = a2 ? double_value(ctx, a2) : 0;
+
+    switch(op->op)
+    {
+        case CH_POST_INC    : float_assign(a1, n1+1); return n1;
+        case CH_POST_DEC    : float_assign(a1, n1-1); return n1;
+        case CH_PRE_INC     : return float_assign(a1, n1+1);
+        case CH_PRE_DEC     : return float_assign(a1, n1-1);
+        case CH_MINUS       : return -n1;
+        case CH_PLUS        : return  n1;
+        case '!'            : return !n1;
+        case CH_EXP         : return pow(n1, n2);
+        case '*'            : return n1 * n2;
+        case '/'            : return n1 / n2;
+        case '%'            : return fmod(n1, n2);
+        case '+'            : return n1 + n2;
+        case '-'            : return n1 - n2;
+        case '<'            : return n1 <  n2;
+        case CH_LE          : return n1 <= n2;
+        case '>'            : return n1 >  n2;
+        case CH_GE          : return n1 >= n2;
+        case CH_EQ          : return n1 == n2;
+        case CH_NE          : return n1 != n2;
+        case ','            : return n2;
+        case CH_ASSIGN      : return float_assign(a1, n2);
+        case CH_ASSIGN_PLUS : return float_assign(a1, n1 + n2);
+        case CH_ASSIGN_MINUS: return float_assign(a1, n1 - n2);
+        case CH_ASSIGN_MULT : return float_assign(a1, n1 * n2);
+        case CH_ASSIGN_DIV  : return float_assign(a1, n1 / n2);
+        case CH_ASSIGN_MOD  : return float_assign(a1, fmod(n1, n2));
+    }
+
+    fprintf(stderr, "error: invalid operator in floating point expression\n");
+    ctx->error = 1;
+    return 0;
+}
 
 
 /*
@@ -642,6 +1110,15 @@ struct op_s *get_op(char *expr)
 
         case '~':
             return OP_BIT_NOT;
+
+        case '?':
+            return OP_COND;
+
+        case ':':
+            return OP_COND_ELSE;
+
+        case ',':
+            return OP_COMMA;
             
         case '(':
             return OP_LBRACE ;
@@ -653,203 +1130,460 @@ struct op_s *get_op(char *expr)
 }
 
 
+
+
 /*
  * push an operator on the operator stack.
  */
-void push_opstack(struct op_s *op)
+void push_opstack(struct arithm_ctx_s *ctx, struct op_s *op, int jump)
 {
-    if(nopstack>MAXOPSTACK-1)
+    if(ctx->nopstack >= ctx->opstack_size)
     {
-        fprintf(stderr, "error: Operator stack overflow\n");
-        error = 1;
-        return;
+        struct opstack_item_s *stack = grow_stack(ctx->opstack, ctx->opstack_buf,
+                                                  &ctx->opstack_size,
+                                                  sizeof(struct opstack_item_s));
+        if(!stack)
+        {
+            fprintf(stderr, "error: insufficient memory for the operator stack\n");
+            ctx->error = 1;
+            return;
+        }
+        ctx->opstack = stack;
     }
-    opstack[nopstack++]=op;
+    ctx->opstack[ctx->nopstack].op     = op;
+    ctx->opstack[ctx->nopstack].func   = NULL;
+    ctx->opstack[ctx->nopstack].nargs  = 0;
+    ctx->opstack[ctx->nopstack++].jump = jump;
 }
 
 
 /*
- * pop an operator from the operator stack.
+ * pop an operator from the operator stack.. the returned item is valid until
+ * the next push.
  */
-struct op_s *pop_opstack(void)
+struct opstack_item_s *pop_opstack(struct arithm_ctx_s *ctx)
 {
-    if(!nopstack)
+    if(!ctx->nopstack)
     {
         fprintf(stderr, "error: Operator stack empty\n");
-        error = 1;
+        ctx->error = 1;
         return NULL;
     }
-    return opstack[--nopstack];
+    return &ctx->opstack[--ctx->nopstack];
+}
+
+
+/*
+ * make sure the operand stack can hold at least count items.
+ *
+ * returns 1 if the stack is large enough, 0 if we failed to extend it.
+ */
+int check_numstack_bounds(struct arithm_ctx_s *ctx, int count)
+{
+    while(count > ctx->numstack_size)
+    {
+        struct stack_item_s *stack = grow_stack(ctx->numstack, ctx->numstack_buf,
+                                                &ctx->numstack_size,
+                                                sizeof(struct stack_item_s));
+        if(!stack)
+        {
+            fprintf(stderr, "error: insufficient memory for the number stack\n");
+            ctx->error = 1;
+            return 0;
+        }
+        ctx->numstack = stack;
+    }
+    return 1;
 }
 
 
 /*
  * push a long numeric operand on the operand stack.
  */
-void push_numstackl(long val)
+void push_numstackl(struct arithm_ctx_s *ctx, long val)
+{
+    if(!check_numstack_bounds(ctx, ctx->nnumstack+1))
+    {
+        return;
+    }
+
+    ctx->numstack[ctx->nnumstack].type = ITEM_LONG_INT;
+    ctx->numstack[ctx->nnumstack++].val = val;
+}
+
+
+/*
+ * push a floating point operand on the operand stack.
+ */
+void push_numstackd(struct arithm_ctx_s *ctx, double val)
 {
-    if(nnumstack > MAXNUMSTACK-1)
+    if(!check_numstack_bounds(ctx, ctx->nnumstack+1))
     {
-        fprintf(stderr, "error: Number stack overflow\n");
-        error = 1;
         return;
     }
 
-    numstack[nnumstack].type = ITEM_LONG_INT;
-    numstack[nnumstack++].val = val;
+    ctx->numstack[ctx->nnumstack].type = ITEM_DOUBLE;
+    ctx->numstack[ctx->nnumstack++].fval = val;
 }
 
 
 /*
  * push a shell variable operand on the operand stack.
  */
-void push_numstackv(struct symtab_entry_s *val)
+void push_numstackv(struct arithm_ctx_s *ctx, struct symtab_entry_s *val)
 {
-    if(nnumstack > MAXNUMSTACK-1)
+    if(!check_numstack_bounds(ctx, ctx->nnumstack+1))
     {
-        fprintf(stderr, "error: Number stack overflow\n");
-        error = 1;
         return;
     }
 
-    numstack[nnumstack].type = ITEM_VAR_PTR;
-    numstack[nnumstack++].ptr = val;
+    ctx->numstack[ctx->nnumstack].type = ITEM_VAR_PTR;
+    ctx->numstack[ctx->nnumstack++].ptr = val;
 }
 
 
 /*
  * pop an operand from the operand stack.
  */
-struct stack_item_s pop_numstack(void)
+struct stack_item_s pop_numstack(struct arithm_ctx_s *ctx)
 {
-    if(!nnumstack)
+    if(!ctx->nnumstack)
     {
         fprintf(stderr, "error: Number stack empty\n");
-        error = 1;
+        ctx->error = 1;
         return (struct stack_item_s) { };
     }
-    return numstack[--nnumstack];
+    return ctx->numstack[--ctx->nnumstack];
 }
 
 
 /*
- * perform operator shunting when we have a new operator by popping the operator
- * at the top of the stack and applying it to the operands on the operand stack.
- * we do this if the operator on top of the stack is not a '(' operator and:
- *   - has greater precedence than the new operator, or
- *   - has equal precedence to the new operator, but the top-of-stack one is
- *     left-associative
- * after popping the operator, we push the new operator on the operator stack,
- * and we push the previous top-of-stack operator's result on the operand stack.
+ * add an instruction to the end of the program we are compiling.
+ *
+ * returns a pointer to the new instruction, or NULL on error.
  */
-void shunt_op(struct op_s *op)
+struct arithm_ins_s *emit_ins(struct arithm_ctx_s *ctx, int type)
 {
-    struct op_s *pop;
-    error = 0;
-    if(op->op == '(')
+    struct arithm_prog_s *prog = ctx->prog;
+
+    if(prog->nins >= prog->ins_size)
     {
-        push_opstack(op);
-        return;
+        int newsize = prog->ins_size ? prog->ins_size*2 : 16;
+        struct arithm_ins_s *ins = realloc(prog->ins, newsize*sizeof(struct arithm_ins_s));
+        if(!ins)
+        {
+            fprintf(stderr, "error: insufficient memory for arithmetic expansion\n");
+            ctx->error = 1;
+            return NULL;
+        }
+        prog->ins      = ins;
+        prog->ins_size = newsize;
+    }
+
+    struct arithm_ins_s *ins = &prog->ins[prog->nins++];
+    ins->type = type;
+    return ins;
+}
+
+
+/*
+ * keep track of the operand stack depth the program will need when it runs.
+ * we don't push anything at compile time, we only count the operands.
+ */
+void count_operands(struct arithm_ctx_s *ctx, int count)
+{
+    ctx->nnumstack += count;
+    if(ctx->nnumstack < 0)
+    {
+        fprintf(stderr, "error: Number stack empty\n");
+        ctx->error = 1;
+        return;
+    }
+    if(ctx->nnumstack > ctx->prog->max_stack)
+    {
+        ctx->prog->max_stack = ctx->nnumstack;
+    }
+}
+
+
+/*
+ * emit an instruction to push a numeric constant.
+ */
+void emit_num(struct arithm_ctx_s *ctx, long val)
+{
+    struct arithm_ins_s *ins = emit_ins(ctx, INS_PUSH_NUM);
+    if(ins)
+    {
+        ins->val = val;
+        count_operands(ctx, 1);
+    }
+}
+
+
+/*
+ * emit an instruction to push a floating point constant.
+ */
+void emit_fnum(struct arithm_ctx_s *ctx, double val)
+{
+    struct arithm_ins_s *ins = emit_ins(ctx, INS_PUSH_FNUM);
+    if(ins)
+    {
+        ins->fval = val;
+        count_operands(ctx, 1);
+    }
+}
+
+
+/*
+ * emit an instruction to push the variable at the given index in the
+ * program's variable list.
+ */
+void emit_var(struct arithm_ctx_s *ctx, int var)
+{
+    struct arithm_ins_s *ins = emit_ins(ctx, INS_PUSH_VAR);
+    if(ins)
+    {
+        ins->var = var;
+        count_operands(ctx, 1);
+    }
+}
+
+
+/*
+ * emit a jump instruction.. the jump's target is set later, when we know it.
+ *
+ * returns the index of the instruction, or -1 on error.
+ */
+int emit_jump(struct arithm_ctx_s *ctx, int type)
+{
+    struct arithm_ins_s *ins = emit_ins(ctx, type);
+    if(!ins)
+    {
+        return -1;
+    }
+    ins->jump = -1;
+    return ctx->prog->nins-1;
+}
+
+
+/*
+ * make the given jump instruction jump to the next instruction we'll emit.
+ */
+void patch_jump(struct arithm_ctx_s *ctx, int jump)
+{
+    ctx->prog->ins[jump].jump = ctx->prog->nins;
+}
+
+
+/*
+ * emit an instruction to apply the operator popped off the operator stack to
+ * the operand(s) on top of the operand stack.. the operand(s) of &&, || and
+ * ?: are complete now, so we point the jump we emitted for them here.
+ */
+void emit_op(struct arithm_ctx_s *ctx, struct opstack_item_s *item)
+{
+    struct op_s *op = item->op;
+
+    if(op == OP_LOG_AND || op == OP_LOG_OR)
+    {
+        /*
+         * we only get here if the left operand didn't decide the result, so
+         * the result is the truth value of the right operand.
+         */
+        if(emit_ins(ctx, INS_BOOL))
+        {
+            patch_jump(ctx, item->jump);
+        }
+        return;
+    }
+    else if(op == OP_COND_ELSE)
+    {
+        patch_jump(ctx, item->jump);
+        return;
+    }
+    else if(op == OP_COND)
+    {
+        fprintf(stderr, "error: expected \':\' for conditional expression\n");
+        ctx->error = 1;
+        return;
+    }
+
+    struct arithm_ins_s *ins = emit_ins(ctx, INS_OP);
+    if(ins)
+    {
+        ins->op = op;
+        /* unary ops pop one operand, binary ops pop two, and both push one */
+        count_operands(ctx, op->unary ? -1 : -2);
+        if(!ctx->error)
+        {
+            count_operands(ctx, 1);
+        }
+    }
+}
+
+
+/*
+ * pop operators off the operator stack and emit them to the output program,
+ * until we reach a '(' operator or an operator with the given char.
+ */
+void reduce_opstack(struct arithm_ctx_s *ctx, char op)
+{
+    while(ctx->nopstack > 0)
+    {
+        struct op_s *top = ctx->opstack[ctx->nopstack-1].op;
+        if(top->op == '(' || top->op == op)
+        {
+            break;
+        }
+        emit_op(ctx, pop_opstack(ctx));
+        if(ctx->error)
+        {
+            return;
+        }
+    }
+}
+
+
+/*
+ * perform operator shunting when we have a new operator by popping the operator
+ * at the top of the stack and emitting it to the output program.
+ * we do this if the operator on top of the stack is not a '(' or '?' operator and:
+ *   - has greater precedence than the new operator, or
+ *   - has equal precedence to the new operator, but the top-of-stack one is
+ *     left-associative
+ * after popping the operator(s), we push the new operator on the operator stack.
+ *
+ * the &&, || and ? operators emit a conditional jump over their right (or
+ * middle) operand as soon as their left operand is complete, so that the
+ * operand that doesn't need to be evaluated is skipped at runtime:
+ *
+ *     a && b      =>   a JZ(L) b BOOL L:
+ *     a || b      =>   a JNZ(L) b BOOL L:
+ *     a ? b : c   =>   a JFALSE(L1) b JMP(L2) L1: c L2:
+ */
+void shunt_op(struct arithm_ctx_s *ctx, struct op_s *op)
+{
+    struct opstack_item_s *pop;
+    int jump = -1;
+    ctx->error = 0;
+    if(op->op == '(')
+    {
+        push_opstack(ctx, op, -1);
+        return;
     }
     else if(op->op == ')')
     {
-        while(nopstack > 0 && opstack[nopstack-1]->op != '(')
+        reduce_opstack(ctx, 0);
+        if(ctx->error)
         {
-            pop = pop_opstack();
-            if(error)
-            {
-                return;
-            }
-            struct stack_item_s n1 = pop_numstack();
-            if(error)
+            return;
+        }
+        if(!(pop = pop_opstack(ctx)) || pop->op->op != '(')
+        {
+            fprintf(stderr, "error: Stack error. No matching \'(\'\n");
+            ctx->error = 1;
+            return;
+        }
+        /* the end of a function call's argument list */
+        if(pop->func)
+        {
+            struct arithm_func_s *func = pop->func;
+            struct arithm_ins_s *ins;
+            if(pop->nargs != func->nargs)
             {
+                fprintf(stderr, "error: %s: expected %d argument(s)\n", func->name, func->nargs);
+                ctx->error = 1;
                 return;
             }
-            if(pop->unary)
+            if((ins = emit_ins(ctx, INS_FUNC)))
             {
-                push_numstackl(pop->eval(&n1, 0));
-            }
-            else
-            {
-                struct stack_item_s n2 = pop_numstack();
-                if(error)
-                {
-                    return;
-                }
-                push_numstackl(pop->eval(&n2, &n1));
-                if(error)
+                ins->func = func;
+                count_operands(ctx, -func->nargs);
+                if(!ctx->error)
                 {
-                    return;
+                    count_operands(ctx, 1);
                 }
             }
         }
-        if(!(pop = pop_opstack()) || pop->op != '(')
+        return;
+    }
+    else if(op == OP_COMMA)
+    {
+        /* a comma inside a function call's parens separates the arguments */
+        reduce_opstack(ctx, '?');
+        if(ctx->error)
+        {
+            return;
+        }
+        if(ctx->nopstack && ctx->opstack[ctx->nopstack-1].func)
         {
-            fprintf(stderr, "error: Stack error. No matching \'(\'\n");
-            error = 1;
+            ctx->opstack[ctx->nopstack-1].nargs++;
+            return;
+        }
+    }
+    else if(op == OP_COND_ELSE)
+    {
+        /* the middle operand is complete. find the matching '?' */
+        reduce_opstack(ctx, '?');
+        if(ctx->error)
+        {
+            return;
+        }
+        if(!ctx->nopstack || ctx->opstack[ctx->nopstack-1].op != OP_COND)
+        {
+            fprintf(stderr, "error: \':\' without matching \'?\'\n");
+            ctx->error = 1;
+            return;
+        }
+        /* jump over the third operand, and make the '?' jump to it */
+        if((jump = emit_jump(ctx, INS_JMP)) < 0)
+        {
+            return;
         }
+        pop = pop_opstack(ctx);
+        patch_jump(ctx, pop->jump);
+        /* only one of the two operands will be on the stack at runtime */
+        count_operands(ctx, -1);
+        push_opstack(ctx, op, jump);
         return;
     }
 
-    if(op->assoc == ASSOC_RIGHT)
+    while(ctx->nopstack)
     {
-        while(nopstack && op->prec < opstack[nopstack-1]->prec)
+        struct op_s *top = ctx->opstack[ctx->nopstack-1].op;
+        /* the middle operand of ?: behaves as if it were parenthesized */
+        if(top == OP_COND)
         {
-            pop = pop_opstack();
-            if(error)
-            {
-                return;
-            }
-            struct stack_item_s n1 = pop_numstack();
-            if(pop->unary)
-            {
-                push_numstackl(pop->eval(&n1, 0));
-            }
-            else
-            {
-                struct stack_item_s n2 = pop_numstack();
-                if(error)
-                {
-                    return;
-                }
-                push_numstackl(pop->eval(&n2, &n1));
-            }
-            if(error)
-            {
-                return;
-            }
+            break;
+        }
+        if(op->assoc == ASSOC_RIGHT ? op->prec >= top->prec : op->prec > top->prec)
+        {
+            break;
+        }
+        emit_op(ctx, pop_opstack(ctx));
+        if(ctx->error)
+        {
+            return;
         }
     }
-    else
+
+    /* the left operand is complete. jump over the right operand if needed */
+    if(op == OP_LOG_AND || op == OP_LOG_OR || op == OP_COND)
     {
-        while(nopstack && op->prec <= opstack[nopstack-1]->prec)
+        jump = emit_jump(ctx, (op == OP_LOG_AND) ? INS_JZ :
+                              (op == OP_LOG_OR ) ? INS_JNZ : INS_JFALSE);
+        if(jump < 0)
         {
-            pop = pop_opstack();
-            if(error)
-            {
-                return;
-            }
-            struct stack_item_s n1 = pop_numstack();
-            if(pop->unary)
-            {
-                push_numstackl(pop->eval(&n1, 0));
-            }
-            else
-            {
-                struct stack_item_s n2 = pop_numstack();
-                if(error)
-                {
-                    return;
-                }
-                push_numstackl(pop->eval(&n2, &n1));
-            }
-            if(error)
-            {
-                return;
-            }
+            return;
+        }
+        /* the jump pops the left operand */
+        count_operands(ctx, -1);
+        if(ctx->error)
+        {
+            return;
         }
     }
-    push_opstack(op);
+    push_opstack(ctx, op, jump);
 }
 
 
@@ -862,7 +1596,7 @@ void shunt_op(struct op_s *op)
  * the result is place in the *result field, and 1 is returned.. otherwise
  * zero is returned.
  */
-int get_ndigit(char c, int base, int *result)
+int get_ndigit(struct arithm_ctx_s *ctx, char c, int base, int *result)
 {
     /* invalid char */
     if(!isalnum(c) && c != '@' && c != '_')
@@ -943,7 +1677,7 @@ int get_ndigit(char c, int base, int *result)
 invalid:
     /* invalid digit */
     fprintf(stderr, "error: digit %c exceeds the value of the base %d\n", c, base);
-    error = 1;
+    ctx->error = 1;
     return 0;
 }
 
@@ -955,7 +1689,7 @@ invalid:
  * the number of characters used to get the number is stored in *char_count,
  * while the number itself is return as a long int.
  */
-long get_num(char *s, int *char_count)
+long get_num(struct arithm_ctx_s *ctx, char *s, int *char_count)
 {
     char *s2 = s;
     long num = 0;
@@ -986,14 +1720,14 @@ long get_num(char *s, int *char_count)
     }
 
     /* get the number according to the given base (use base 10 if none) */
-    while(get_ndigit(*s2, base, &num2))
+    while(get_ndigit(ctx, *s2, base, &num2))
     {
         num = (num*base) + num2;
         s2++;
     }
 
     /* check we didn't encounter an invalid digit */
-    if(error)
+    if(ctx->error)
     {
         return 0;
     }
@@ -1016,13 +1750,13 @@ long get_num(char *s, int *char_count)
         base = num;
         num  = 0;
         s2++;
-        while(get_ndigit(*s2, base, &num2))
+        while(get_ndigit(ctx, *s2, base, &num2))
         {
             num = (num*base) + num2;
             s2++;
         }
         /* check we didn't encounter an invalid digit */
-        if(error)
+        if(ctx->error)
         {
             return 0;
         }
@@ -1032,46 +1766,188 @@ long get_num(char *s, int *char_count)
 }
 
 
+
+
 /*
- * extract a shell variable name operand from the beginning of chars.
+ * extract a shell variable name operand from the beginning of chars and add
+ * it to the variable list of the program we are compiling.
+ *
+ * returns the index of the variable in the program's list, -1 on error.
  */
-struct symtab_entry_s *get_var(char *s, int *char_count)
+int get_var(struct arithm_ctx_s *ctx, char *s, int *char_count)
 {
+    struct arithm_prog_s *prog = ctx->prog;
     char *ss = s;
     if(*ss == '$')
     {
         ss++;        /* var names can begin with '$'. skip it */
     }
     char *s2 = ss;
-    while(*s2 && valid_name_char(*s2))
+    /*
+     * special parameters ($?, $#, ...) are one char long.. this also stops us
+     * from mistaking a '?' after a variable name for a part of the name.
+     */
+    if(*s2 && !isalnum(*s2) && *s2 != '_')
     {
         s2++;
     }
+    else
+    {
+        while(*s2 && (isalnum(*s2) || *s2 == '_'))
+        {
+            s2++;
+        }
+    }
     int len = s2-ss;
+    /* get the real length, including leading '$' if present */
+    (*char_count) = s2-s;
     /* empty var name */
     if(len == 0)
     {
-        (*char_count) = s2-s;
-        return NULL;
+        return -1;
+    }
+    /* reuse the entry if the variable appears more than once in the expression */
+    int i;
+    for(i = 0; i < prog->nvars; i++)
+    {
+        if(strncmp(prog->vars[i].name, ss, len) == 0 && prog->vars[i].name[len] == '\0')
+        {
+            return i;
+        }
+    }
+    /* extend the variable list if needed */
+    if(prog->nvars >= prog->vars_size)
+    {
+        int newsize = prog->vars_size ? prog->vars_size*2 : 4;
+        struct arithm_var_s *vars = realloc(prog->vars, newsize*sizeof(struct arithm_var_s));
+        if(!vars)
+        {
+            return -1;
+        }
+        prog->vars      = vars;
+        prog->vars_size = newsize;
     }
     /* copy the name */
-    char name[len+1];
+    char *name = malloc(len+1);
+    if(!name)
+    {
+        return -1;
+    }
     strncpy(name, ss, len);
     name[len] = '\0';
-    /* get the symbol table entry for that var */
-    struct symtab_entry_s *e = get_symtab_entry(name);
+    /* the variable will be bound to its symbol table entry when first used */
+    struct arithm_var_s *var = &prog->vars[prog->nvars];
+    var->name       = name;
+    var->entry      = NULL;
+    var->generation = 0;
+    return prog->nvars++;
+}
+
+
+/*
+ * get the symbol table entry a compiled variable reference refers to.. the
+ * lookup is only performed if the symbol table stack has changed since the
+ * last time we bound this variable.. if the variable is not defined, we add
+ * it to the local symbol table.
+ */
+struct symtab_entry_s *bind_var(struct arithm_var_s *var)
+{
+    if(var->entry && var->generation == get_symtab_generation())
+    {
+        return var->entry;
+    }
+
+    struct symtab_entry_s *e = get_symtab_entry(var->name);
     if(!e)
     {
-        e = add_to_symtab(name);
+        e = add_to_symtab(var->name);
     }
-    /* get the real length, including leading '$' if present */
-    (*char_count) = s2-s;
+
+    var->entry      = e;
+    var->generation = get_symtab_generation();
     return e;
 }
 
 
 /*
- * Reverse Polish Notation (RPN) calculator.
+ * free the memory used by a compiled expression.
+ */
+void free_arithm_prog(struct arithm_prog_s *prog)
+{
+    int i;
+    for(i = 0; i < prog->nvars; i++)
+    {
+        free(prog->vars[i].name);
+    }
+    free(prog->vars);
+    free(prog->ins);
+    free(prog->expr);
+    free(prog);
+}
+
+
+/*
+ * release a reference to a compiled expression, freeing it when the last
+ * reference is gone.
+ */
+void release_arithm_prog(struct arithm_prog_s *prog)
+{
+    if(--prog->refs == 0)
+    {
+        free_arithm_prog(prog);
+    }
+}
+
+
+/*
+ * check if the last thing we've seen in the expression is an operand, i.e. a
+ * number, a variable, a closing brace, or a post-increment/decrement operator.
+ * lastop is NULL if we've just seen a number or a variable.
+ */
+int follows_operand(struct op_s *lastop, struct op_s *startop)
+{
+    if(!lastop)
+    {
+        return 1;
+    }
+    if(lastop == startop)
+    {
+        return 0;
+    }
+    return (lastop->op == ')' || lastop == OP_POST_INC || lastop == OP_POST_DEC);
+}
+
+
+/*
+ * check if the given string starts with a math function call, i.e. a function
+ * name followed by '('.. the function is stored in *func, and the number of
+ * chars up to and including the '(' is stored in *char_count.
+ *
+ * returns the string if it starts with a function call, NULL otherwise.
+ */
+char *is_func_call(char *s, struct arithm_func_s **func, int *char_count)
+{
+    char *s2 = s;
+    while(isalnum(*s2) || *s2 == '_')
+    {
+        s2++;
+    }
+    int len = s2-s;
+    while(isspace(*s2))
+    {
+        s2++;
+    }
+    if(*s2 != '(' || !len || !isalpha(*s) || !(*func = get_arithm_func(s, len)))
+    {
+        return NULL;
+    }
+    (*char_count) = s2-s+1;
+    return s;
+}
+
+
+/*
+ * Reverse Polish Notation (RPN) compiler.
  * 
  * POSIX note about arithmetic expansion:
  *   The shell shall expand all tokens in the expression for parameter expansion, 
@@ -1086,55 +1962,54 @@ struct symtab_entry_s *get_var(char *s, int *char_count)
  *     required.
  *   - Selection, iteration, and jump statements are not supported.
  * 
- * TODO: we should implement the functionality for math functions.
- *       this, of course, means we will need to compile our shell against
- *       libmath (by passing the -lm option to gcc).
+ * if fp is non-zero, the expression is evaluated in floating point, and may
+ * call the math functions in arithm_funcs[] (that is why we link against
+ * libmath, by passing the -lm option to gcc).
  * 
- * TODO: other operators to implement (not required by POSIX):
- *       - the ternary operator (exprt ? expr : expr)
+ * other operators we implement (not required by POSIX):
+ *       - the ternary operator (expr ? expr : expr)
  *       - the comma operator (expr, expr)
+ *
+ * we run the shunting-yard algorithm once on the expression, emitting
+ * operands and operators to a program we can run as many times as we want,
+ * without having to parse the expression again.
+ *
+ * returns the compiled program (with a reference count of 1), or NULL on error.
  */
-
-char *arithm_expand(char *orig_expr)
+struct arithm_prog_s *compile_arithm(char *baseexp, unsigned int hash, int fp)
 {
     char   *expr;
     char   *tstart       = NULL;
     struct  op_s startop = { 'X', 0, ASSOC_NONE, 0, 0, NULL };    /* Dummy operator to mark start */
     struct  op_s *op     = NULL;
-    int     n1, n2;
+    long    n1;
+    int     n2;
     struct  op_s *lastop = &startop;
-    /*
-     * get a copy of orig_expr without the $(( and )), or the $[ and ]
-     * if we're given the obsolete arithmetic expansion operator.
-     */
-    int baseexp_len = strlen(orig_expr);
-    char *baseexp = malloc(baseexp_len+1);
-    if(!baseexp)
+    struct  arithm_ctx_s ctx_buf, *ctx = &ctx_buf;
+    struct  arithm_func_s *func;
+
+    struct arithm_prog_s *prog = malloc(sizeof(struct arithm_prog_s));
+    if(!prog)
     {
         fprintf(stderr, "error: insufficient memory for arithmetic expansion\n");
         return NULL;
     }
-    /* lose the $(( */
-    if(orig_expr[0] == '$' && orig_expr[1] == '(' && orig_expr[2] == '(')
+    memset(prog, 0, sizeof(struct arithm_prog_s));
+    prog->refs = 1;
+    prog->hash = hash;
+    prog->fp   = fp;
+    prog->expr = malloc(strlen(baseexp)+1);
+    if(!prog->expr)
     {
-        strcpy(baseexp, orig_expr+3);
-        baseexp_len -= 3;
-        /* and the )) */
-        if(baseexp[baseexp_len-1] == ')' && baseexp[baseexp_len-2] == ')')
-        {
-            baseexp[baseexp_len-2] = '\0';
-        }
-    }
-    else
-    {
-        strcpy(baseexp, orig_expr);
+        fprintf(stderr, "error: insufficient memory for arithmetic expansion\n");
+        free(prog);
+        return NULL;
     }
+    strcpy(prog->expr, baseexp);
 
-    /* init our stacks */
-    nopstack = 0;
-    nnumstack = 0;
-    /* clear the error flag */
-    error = 0;
+    /* init our stacks and clear the error flag */
+    init_arithm_ctx(ctx, 0);
+    ctx->prog = prog;
     expr = baseexp;
     
     /* and go ... */
@@ -1142,9 +2017,51 @@ char *arithm_expand(char *orig_expr)
     {
        if(!tstart)
         {
-            if((op = get_op(expr)))
+            /* floating point constant */
+            if(fp && (isdigit(*expr) || (*expr == '.' && isdigit(expr[1]))))
+            {
+                char *end;
+                double d = str_to_double(expr, &end);
+                /* numbers in the base#n format are integers */
+                if(*end == '#')
+                {
+                    ctx->error = 0;
+                    d = get_num(ctx, expr, &n2);
+                    if(ctx->error)
+                    {
+                        goto err;
+                    }
+                    end = expr+n2;
+                }
+                emit_fnum(ctx, d);
+                if(ctx->error)
+                {
+                    goto err;
+                }
+                lastop = NULL;
+                expr = end;
+            }
+            /* math function call */
+            else if(fp && is_func_call(expr, &func, &n2))
             {
-                if(lastop && (lastop == &startop || lastop->op != ')'))
+                shunt_op(ctx, OP_LBRACE);
+                if(ctx->error)
+                {
+                    goto err;
+                }
+                ctx->opstack[ctx->nopstack-1].func  = func;
+                ctx->opstack[ctx->nopstack-1].nargs = 1;
+                lastop = OP_LBRACE;
+                expr += n2;
+            }
+            else if((op = get_op(expr)))
+            {
+                if(fp && !is_float_op(op))
+                {
+                    fprintf(stderr, "error: invalid operator in floating point expression: %s\n", expr);
+                    goto err;
+                }
+                if(!follows_operand(lastop, &startop))
                 {
                     /* take care of unary plus and minus */
                     if(op->op == '-')
@@ -1164,8 +2081,8 @@ char *arithm_expand(char *orig_expr)
                 /* fix the pre-post ++/-- dilemma */
                 if(op->op == CH_POST_INC || op->op == CH_POST_DEC)
                 {
-                    /* post ++/-- has higher precedence over pre ++/-- */
-                    if(expr < baseexp+2 || !valid_name_char(expr[-2]))
+                    /* post ++/-- follow an operand, pre ++/-- precede one */
+                    if(!follows_operand(lastop, &startop))
                     {
                         if(op == OP_POST_INC)
                         {
@@ -1177,9 +2094,9 @@ char *arithm_expand(char *orig_expr)
                         }
                     }
                 }
-                error = 0;
-                shunt_op(op);
-                if(error)
+                ctx->error = 0;
+                shunt_op(ctx, op);
+                if(ctx->error)
                 {
                     goto err;
                 }
@@ -1208,14 +2125,14 @@ char *arithm_expand(char *orig_expr)
             }
             else if(isdigit(*expr))
             {
-                error = 0;
-                n1 = get_num(tstart, &n2);
-                if(error)
+                ctx->error = 0;
+                n1 = get_num(ctx, tstart, &n2);
+                if(ctx->error)
                 {
                     goto err;
                 }
-                push_numstackl(n1);
-                if(error)
+                emit_num(ctx, n1);
+                if(ctx->error)
                 {
                     goto err;
                 }
@@ -1225,15 +2142,15 @@ char *arithm_expand(char *orig_expr)
             }
             else if(valid_name_char(*expr))
             {
-                struct symtab_entry_s *n1 = get_var(tstart, &n2);
-                if(!n1)
+                int var = get_var(ctx, tstart, &n2);
+                if(var < 0)
                 {
                     fprintf(stderr, "error: Failed to add symbol near: %s\n", tstart);
                     goto err;
                 }
-                error = 0;
-                push_numstackv(n1);
-                if(error)
+                ctx->error = 0;
+                emit_var(ctx, var);
+                if(ctx->error)
                 {
                     goto err;
                 }
@@ -1243,38 +2160,22 @@ char *arithm_expand(char *orig_expr)
             }
             else if((op = get_op(expr)))
             {
-                error = 0;
-                n1 = get_num(tstart, &n2);
-                if(error)
+                ctx->error = 0;
+                n1 = get_num(ctx, tstart, &n2);
+                if(ctx->error)
                 {
                     goto err;
                 }
-                push_numstackl(n1);
-                if(error)
+                emit_num(ctx, n1);
+                if(ctx->error)
                 {
                     goto err;
                 }
                 tstart = NULL;
 
-                /* fix the pre-post ++/-- dilemma */
-                if(op->op == CH_POST_INC || op->op == CH_POST_DEC)
-                {
-                    /* post ++/-- has higher precedence over pre ++/-- */
-                    if(expr < baseexp+2 || !valid_name_char(expr[-2]))
-                    {
-                        if(op == OP_POST_INC)
-                        {
-                            op = OP_PRE_INC;
-                        }
-                        else
-                        {
-                            op = OP_PRE_DEC;
-                        }
-                    }
-                }
-
-                shunt_op(op);
-                if(error)
+                /* ++/-- following a number are post ++/-- */
+                shunt_op(ctx, op);
+                if(ctx->error)
                 {
                     goto err;
                 }
@@ -1291,89 +2192,534 @@ char *arithm_expand(char *orig_expr)
 
     if(tstart)
     {
-        error = 0;
+        ctx->error = 0;
         if(isdigit(*tstart))
         {
-            n1 = get_num(tstart, &n2);
-            if(error)
+            n1 = get_num(ctx, tstart, &n2);
+            if(ctx->error)
             {
                 goto err;
             }
-            push_numstackl(n1);
+            emit_num(ctx, n1);
         }
         else if(valid_name_char(*tstart))
         {
-            push_numstackv(get_var(tstart, &n2));
+            int var = get_var(ctx, tstart, &n2);
+            if(var < 0)
+            {
+                fprintf(stderr, "error: Failed to add symbol near: %s\n", tstart);
+                goto err;
+            }
+            emit_var(ctx, var);
         }
-        if(error)
+        if(ctx->error)
         {
             goto err;
         }
     }
 
-    while(nopstack)
+    while(ctx->nopstack)
     {
-        error = 0;
-        op = pop_opstack();
-        if(error)
+        ctx->error = 0;
+        struct opstack_item_s *item = pop_opstack(ctx);
+        if(item->op->op == '(')
         {
+            fprintf(stderr, "error: Stack error. No matching \')\'\n");
             goto err;
         }
-        struct stack_item_s n1 = pop_numstack();
-        if(error)
+        emit_op(ctx, item);
+        if(ctx->error)
         {
             goto err;
         }
-        if(op->unary)
-        {
-            push_numstackl(op->eval(&n1, 0));
-        }
-        else
+    }
+
+    /* we must have at most 1 item on the stack when the program finishes */
+    if(ctx->nnumstack > 1)
+    {
+        fprintf(stderr, "error: Number stack has %d elements after evaluation. Should be 1.\n", ctx->nnumstack);
+        goto err;
+    }
+
+    free_arithm_ctx(ctx);
+    return prog;
+
+err:
+    free_arithm_ctx(ctx);
+    free_arithm_prog(prog);
+    return NULL;
+}
+
+
+/*
+ * the compiled expressions cache.. compiled programs are kept in a hash table
+ * keyed by the expression's text, and in a doubly-linked list ordered by use,
+ * so that the least recently used program is the first to go when the cache
+ * is full.
+ */
+#define ARITHM_CACHE_SIZE       64      /* max. number of cached programs */
+#define ARITHM_CACHE_BUCKETS    64      /* hash table size (power of 2) */
+
+struct arithm_prog_s *arithm_cache[ARITHM_CACHE_BUCKETS];
+struct arithm_prog_s *arithm_lru_first = NULL,  /* most recently used */
+                     *arithm_lru_last  = NULL;  /* least recently used */
+int    arithm_cache_count = 0;
+
+
+/*
+ * calculate the hash value of the given expression text.
+ */
+unsigned int arithm_hash(char *expr)
+{
+    unsigned int hash = 5381;
+    while(*expr)
+    {
+        hash = ((hash << 5) + hash) + (unsigned char)*expr++;
+    }
+    return hash;
+}
+
+
+/*
+ * remove a program from the LRU list.
+ */
+void arithm_lru_unlink(struct arithm_prog_s *prog)
+{
+    if(prog->lru_prev)
+    {
+        prog->lru_prev->lru_next = prog->lru_next;
+    }
+    else
+    {
+        arithm_lru_first = prog->lru_next;
+    }
+
+    if(prog->lru_next)
+    {
+        prog->lru_next->lru_prev = prog->lru_prev;
+    }
+    else
+    {
+        arithm_lru_last = prog->lru_prev;
+    }
+    prog->lru_prev = NULL;
+    prog->lru_next = NULL;
+}
+
+
+/*
+ * add a program to the head of the LRU list.
+ */
+void arithm_lru_push(struct arithm_prog_s *prog)
+{
+    prog->lru_prev = NULL;
+    prog->lru_next = arithm_lru_first;
+    if(arithm_lru_first)
+    {
+        arithm_lru_first->lru_prev = prog;
+    }
+    else
+    {
+        arithm_lru_last = prog;
+    }
+    arithm_lru_first = prog;
+}
+
+
+/*
+ * remove the least recently used program from the cache.. the program is
+ * freed now, or when the last evaluation using it finishes.
+ */
+void arithm_cache_evict(void)
+{
+    struct arithm_prog_s *prog = arithm_lru_last;
+    if(!prog)
+    {
+        return;
+    }
+
+    struct arithm_prog_s **pp = &arithm_cache[prog->hash & (ARITHM_CACHE_BUCKETS-1)];
+    while(*pp && *pp != prog)
+    {
+        pp = &(*pp)->hash_next;
+    }
+    if(*pp)
+    {
+        *pp = prog->hash_next;
+    }
+
+    arithm_lru_unlink(prog);
+    arithm_cache_count--;
+    release_arithm_prog(prog);
+}
+
+
+/*
+ * get the compiled program of the given expression, compiling it and adding
+ * it to the cache if it's not already there.
+ *
+ * returns the program with an extra reference the caller must release, or
+ * NULL if the expression couldn't be compiled.
+ */
+struct arithm_prog_s *get_arithm_prog(char *expr, int fp)
+{
+    unsigned int hash = arithm_hash(expr);
+    int bucket = hash & (ARITHM_CACHE_BUCKETS-1);
+    struct arithm_prog_s *prog = arithm_cache[bucket];
+
+    while(prog)
+    {
+        if(prog->hash == hash && prog->fp == fp && strcmp(prog->expr, expr) == 0)
         {
-            struct stack_item_s n2 = pop_numstack();
-            if(error)
+            /* move to the head of the LRU list */
+            if(prog != arithm_lru_first)
             {
-                goto err;
+                arithm_lru_unlink(prog);
+                arithm_lru_push(prog);
             }
-            push_numstackl(op->eval(&n2, &n1));
+            prog->refs++;
+            return prog;
+        }
+        prog = prog->hash_next;
+    }
+
+    if(!(prog = compile_arithm(expr, hash, fp)))
+    {
+        return NULL;
+    }
+
+    if(arithm_cache_count >= ARITHM_CACHE_SIZE)
+    {
+        arithm_cache_evict();
+    }
+
+    /* one reference for the cache, and one for the caller */
+    prog->refs++;
+    prog->hash_next = arithm_cache[bucket];
+    arithm_cache[bucket] = prog;
+    arithm_lru_push(prog);
+    arithm_cache_count++;
+    return prog;
+}
+
+
+/*
+ * get the truth value of an operand.
+ */
+int is_true(struct arithm_ctx_s *ctx, struct stack_item_s *a)
+{
+    if(ctx->prog->fp)
+    {
+        return double_value(ctx, a) != 0;
+    }
+    return long_value(ctx, a) != 0;
+}
+
+
+/*
+ * push a truth value (0 or 1) on the operand stack.
+ */
+void push_bool(struct arithm_ctx_s *ctx, int val)
+{
+    if(ctx->prog->fp)
+    {
+        push_numstackd(ctx, val);
+    }
+    else
+    {
+        push_numstackl(ctx, val);
+    }
+}
+
+
+/*
+ * run a compiled expression in its own context, so this function can be
+ * called recursively.. depth is the nesting level of the evaluation (zero
+ * for the topmost expression).
+ *
+ * returns 1 and stores the result in *result on success, 0 on error.. the
+ * result is a double if the expression is a floating point one, a long
+ * otherwise.
+ */
+int run_arithm_prog(struct arithm_prog_s *prog, int depth, struct stack_item_s *result)
+{
+    struct arithm_ctx_s ctx_buf, *ctx = &ctx_buf;
+    struct arithm_ins_s *ins = prog->ins, *end = prog->ins+prog->nins;
+    struct stack_item_s n1, n2;
+    int val;
+
+    init_arithm_ctx(ctx, depth);
+    ctx->prog = prog;
+
+    /* the compiler told us how deep the operand stack will go */
+    if(!check_numstack_bounds(ctx, prog->max_stack))
+    {
+        return 0;
+    }
+
+    while(ins < end)
+    {
+        switch(ins->type)
+        {
+            case INS_PUSH_NUM:
+                push_numstackl(ctx, ins->val);
+                break;
+
+            case INS_PUSH_FNUM:
+                push_numstackd(ctx, ins->fval);
+                break;
+
+            case INS_PUSH_VAR:
+                push_numstackv(ctx, bind_var(&prog->vars[ins->var]));
+                break;
+
+            case INS_OP:
+                n1 = pop_numstack(ctx);
+                if(ins->op->unary)
+                {
+                    if(prog->fp)
+                    {
+                        push_numstackd(ctx, eval_float_op(ctx, ins->op, &n1, NULL));
+                    }
+                    else
+                    {
+                        push_numstackl(ctx, ins->op->eval(ctx, &n1, 0));
+                    }
+                }
+                else
+                {
+                    n2 = pop_numstack(ctx);
+                    if(prog->fp)
+                    {
+                        push_numstackd(ctx, eval_float_op(ctx, ins->op, &n2, &n1));
+                    }
+                    else
+                    {
+                        push_numstackl(ctx, ins->op->eval(ctx, &n2, &n1));
+                    }
+                }
+                break;
+
+            case INS_FUNC:
+                n1 = pop_numstack(ctx);
+                if(ins->func->nargs == 1)
+                {
+                    push_numstackd(ctx, ins->func->f1(double_value(ctx, &n1)));
+                }
+                else
+                {
+                    n2 = pop_numstack(ctx);
+                    push_numstackd(ctx, ins->func->f2(double_value(ctx, &n2),
+                                                      double_value(ctx, &n1)));
+                }
+                break;
+
+            case INS_JZ:
+            case INS_JNZ:
+                n1  = pop_numstack(ctx);
+                val = is_true(ctx, &n1);
+                if((ins->type == INS_JZ) ? !val : val)
+                {
+                    push_bool(ctx, val);
+                    ins = prog->ins+ins->jump;
+                    goto next;
+                }
+                break;
+
+            case INS_JFALSE:
+                n1 = pop_numstack(ctx);
+                if(!is_true(ctx, &n1))
+                {
+                    ins = prog->ins+ins->jump;
+                    goto next;
+                }
+                break;
+
+            case INS_JMP:
+                ins = prog->ins+ins->jump;
+                goto next;
+
+            case INS_BOOL:
+                n1 = pop_numstack(ctx);
+                push_bool(ctx, is_true(ctx, &n1));
+                break;
         }
-        if(error)
+        ins++;
+
+next:
+        if(ctx->error)
         {
-            goto err;
+            free_arithm_ctx(ctx);
+            return 0;
         }
     }
 
-    /* empty arithmetic expression result */
-    if(!nnumstack)
+    /* empty arithmetic expression evaluates to zero */
+    if(prog->fp)
     {
-        /*return false as the result */
-        free(baseexp);
-        return NULL;
+        result->type = ITEM_DOUBLE;
+        result->fval = ctx->nnumstack ? double_value(ctx, &ctx->numstack[0]) : 0;
     }
+    else
+    {
+        result->type = ITEM_LONG_INT;
+        result->val  = ctx->nnumstack ? long_value(ctx, &ctx->numstack[0]) : 0;
+    }
+
+    free_arithm_ctx(ctx);
+    return !ctx->error;
+}
 
-    /* we must have only 1 item on the stack now */
-    if(nnumstack != 1)
+
+/*
+ * evaluate the arithmetic expression in expr.. depth is the nesting level of
+ * the evaluation (zero for the topmost expression), and fp is non-zero for
+ * floating point expressions.
+ *
+ * returns 1 and stores the result in *result on success, 0 on error.
+ */
+int do_arithm_expand(char *expr, int depth, int fp, struct stack_item_s *result)
+{
+    struct arithm_prog_s *prog = get_arithm_prog(expr, fp);
+    if(!prog)
     {
-        fprintf(stderr, "error: Number stack has %d elements after evaluation. Should be 1.\n", nnumstack);
-        goto err;
+        return 0;
+    }
+
+    int res = run_arithm_prog(prog, depth, result);
+    release_arithm_prog(prog);
+    return res;
+}
+
+
+/*
+ * evaluate the arithmetic expression in expr, without the $(( and )).
+ *
+ * returns 1 and stores the result in *result on success, 0 on error.
+ */
+int arithm_eval(char *expr, long *result)
+{
+    struct stack_item_s res;
+    if(!do_arithm_expand(expr, 0, 0, &res))
+    {
+        return 0;
+    }
+    *result = res.val;
+    return 1;
+}
+
+
+/*
+ * evaluate the floating point expression in expr, without the $((# and )).
+ *
+ * returns 1 and stores the result in *result on success, 0 on error.
+ */
+int arithm_eval_float(char *expr, double *result)
+{
+    struct stack_item_s res;
+    if(!do_arithm_expand(expr, 0, 1, &res))
+    {
+        return 0;
+    }
+    *result = res.fval;
+    return 1;
+}
+
+
+/*
+ * evaluate the arithmetic expression in expr as a condition, as we do for the
+ * ((expr)) command and the let builtin.. the expression is evaluated in
+ * floating point if it starts with '#'.
+ *
+ * returns 0 if the result is non-zero, 1 if it is zero or if an error
+ * occurred (this is the exit status of the command).
+ */
+int arithm_cond(char *expr)
+{
+    struct stack_item_s res;
+    int fp = 0;
+
+    while(isspace(*expr))
+    {
+        expr++;
+    }
+    if(*expr == '#')
+    {
+        expr++;
+        fp = 1;
+    }
+
+    if(!do_arithm_expand(expr, 0, fp, &res))
+    {
+        return 1;
+    }
+
+    return fp ? (res.fval == 0) : (res.val == 0);
+}
+
+
+/*
+ * perform arithmetic expansion.. if the expression starts with '#', as in
+ * $((# 1.5 * x)), it is evaluated in floating point.
+ *
+ * returns the malloc'd result of evaluating the expression, or NULL on error.
+ */
+char *arithm_expand(char *orig_expr)
+{
+    /*
+     * get a copy of orig_expr without the $(( and )), or the $[ and ]
+     * if we're given the obsolete arithmetic expansion operator.
+     */
+    int baseexp_len = strlen(orig_expr);
+    char baseexp[baseexp_len+1];
+
+    /* lose the $(( */
+    if(orig_expr[0] == '$' && orig_expr[1] == '(' && orig_expr[2] == '(')
+    {
+        strcpy(baseexp, orig_expr+3);
+        baseexp_len -= 3;
+        /* and the )) */
+        if(baseexp[baseexp_len-1] == ')' && baseexp[baseexp_len-2] == ')')
+        {
+            baseexp[baseexp_len-2] = '\0';
+        }
+    }
+    else
+    {
+        strcpy(baseexp, orig_expr);
+    }
+
+    char *expr = baseexp;
+    int fp = 0;
+    while(isspace(*expr))
+    {
+        expr++;
+    }
+    if(*expr == '#')
+    {
+        expr++;
+        fp = 1;
+    }
+
+    struct stack_item_s val;
+    if(!do_arithm_expand(expr, 0, fp, &val))
+    {
+        return NULL;
     }
 
     char res[64];
-    sprintf(res, "%ld", numstack[0].val);
+    if(fp)
+    {
+        double_to_str(val.fval, res, sizeof(res));
+    }
+    else
+    {
+        sprintf(res, "%ld", val.val);
+    }
     char *res2 = malloc(strlen(res)+1);
     if(res2)
     {
         strcpy(res2, res);
     }
-    /*
-     * invert the exit status for callers who use our value to test for true/false exit status,
-     * which is inverted, i.e. non-zero result is true (or zero exit status) and vice versa.
-     * this is what bash does with the (( expr )) compound command.
-     */
-    free(baseexp);
     return res2;
-
-err:
-    free(baseexp);
-    return NULL;
 }
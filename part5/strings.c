@@ -19,8 +19,16 @@
  *    along with this tutorial.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
+#include <locale.h>
+#include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
+#include <wchar.h>
+#include <wctype.h>
 #include "shell.h"
 
 
@@ -54,6 +62,37 @@ char *strchr_any(char *string, char *chars)
 }
 
 
+/*
+ * calculate the hash value of the given string.
+ */
+unsigned int str_hash(char *str)
+{
+    unsigned int hash = 5381;
+    while(*str)
+    {
+        hash = ((hash << 5) + hash) + (unsigned char)*str++;
+    }
+    return hash;
+}
+
+
+/*
+ * get a malloc'd copy of the given string.
+ *
+ * returns the copy, or NULL if insufficient memory.
+ */
+char *get_malloced_str(char *str)
+{
+    char *str2 = malloc(strlen(str)+1);
+    if(!str2)
+    {
+        return NULL;
+    }
+    strcpy(str2, str);
+    return str2;
+}
+
+
 /*
  * return the passed string value, quoted in a format that can
  * be used for reinput to the shell.
@@ -74,7 +113,7 @@ char *quote_val(char *val, int add_quotes)
         strcpy(res, add_quotes ? "\"\"" : "");
         return res;
     }
-    /* count the number of quotes needed */
+    /* count the chars, and the number of quotes needed */
     len = 0;
     char *v = val, *p;
     while(*v)
@@ -90,7 +129,7 @@ char *quote_val(char *val, int add_quotes)
         }
         v++;
     }
-    len += strlen(val);
+    len += v-val;
     /* add two for the opening and closing quotes (optional) */
     if(add_quotes)
     {
@@ -196,3 +235,389 @@ void free_buffer(int len, char **buf)
     }
     free(buf);
 }
+
+
+/*
+ * reference-counted strings.. the count is kept in a header just before the
+ * string's chars, and we pass around pointers to the chars, so that an rcstr
+ * can go anywhere a normal string can.. an rcstr can be shared by taking more
+ * references to it, in which case it must not be changed (use rcstr_unshare()
+ * to get a copy we can change).. it is freed by rcstr_unref(), not free().
+ */
+struct rcstr_s
+{
+    size_t refs;
+    char   str[];
+};
+
+#define RCSTR(s)        ((struct rcstr_s *)((s)-offsetof(struct rcstr_s, str)))
+
+
+/*
+ * alloc an rcstr with room for size chars (including the terminating '\0'),
+ * and one reference to it.
+ *
+ * returns the rcstr, or NULL if insufficient memory.
+ */
+char *rcstr_alloc(size_t size)
+{
+    struct rcstr_s *rc = malloc(sizeof(struct rcstr_s)+size);
+    if(!rc)
+    {
+        return NULL;
+    }
+    rc->refs = 1;
+    return rc->str;
+}
+
+
+/*
+ * make an rcstr from the first len chars of str.
+ *
+ * returns the rcstr, or NULL if insufficient memory.
+ */
+char *rcstr_dup(char *str, size_t len)
+{
+    char *s = rcstr_alloc(len+1);
+    if(s)
+    {
+        memcpy(s, str, len);
+        s[len] = '\0';
+    }
+    return s;
+}
+
+
+/*
+ * take another reference to the rcstr.
+ */
+char *rcstr_ref(char *str)
+{
+    RCSTR(str)->refs++;
+    return str;
+}
+
+
+/*
+ * give back a reference to the rcstr, freeing it if it was the last one.
+ */
+void rcstr_unref(char *str)
+{
+    if(str && --RCSTR(str)->refs == 0)
+    {
+        free(RCSTR(str));
+    }
+}
+
+
+/*
+ * check if the rcstr has other references than ours.
+ */
+int rcstr_shared(char *str)
+{
+    return RCSTR(str)->refs > 1;
+}
+
+
+/*
+ * get an rcstr we can change, which is the given one (whose length is len) if
+ * no one else has a reference to it, or a copy of it otherwise.. either way,
+ * our reference to the given rcstr goes to the result.
+ *
+ * returns the rcstr, or NULL if insufficient memory (our reference to the
+ * given rcstr is kept in this case).
+ */
+char *rcstr_unshare(char *str, size_t len)
+{
+    if(!rcstr_shared(str))
+    {
+        return str;
+    }
+
+    char *s = rcstr_dup(str, len);
+    if(s)
+    {
+        RCSTR(str)->refs--;
+    }
+    return s;
+}
+
+
+/*
+ * floating point numbers are always read and written in the "C" locale, so
+ * that the decimal point is '.' no matter what the user's locale says (the
+ * shell would otherwise produce numbers it can't read back).
+ */
+locale_t c_numeric_locale = (locale_t)0;
+
+locale_t get_c_numeric_locale(void)
+{
+    if(c_numeric_locale == (locale_t)0)
+    {
+        c_numeric_locale = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0);
+    }
+    return c_numeric_locale;
+}
+
+
+/*
+ * convert the floating point number at the beginning of str, which must use
+ * '.' as the decimal point.. a pointer to the first char after the number is
+ * stored in *end.
+ *
+ * returns the number.
+ */
+double str_to_double(char *str, char **end)
+{
+    locale_t loc = get_c_numeric_locale();
+    locale_t old = loc ? uselocale(loc) : (locale_t)0;
+    double val = strtod(str, end);
+    if(loc)
+    {
+        uselocale(old);
+    }
+    return val;
+}
+
+
+/*
+ * format the given floating point number into buf (which should be at least
+ * 32 bytes long).. we use the least number of significant digits (from 15
+ * to 17) that gives us the same number when read back, so that 0.1 is printed as 0.1,
+ * not 0.10000000000000001.
+ *
+ * returns the length of the formatted number.
+ */
+int double_to_str(double val, char *buf, size_t size)
+{
+    locale_t loc = get_c_numeric_locale();
+    locale_t old = loc ? uselocale(loc) : (locale_t)0;
+    int prec, len = 0;
+    for(prec = 15; prec <= 17; prec++)
+    {
+        len = snprintf(buf, size, "%.*g", prec, val);
+        if(strtod(buf, NULL) == val)
+        {
+            break;
+        }
+    }
+    if(loc)
+    {
+        uselocale(old);
+    }
+    return len;
+}
+
+
+/*
+ * convert the backslash escape sequences in str, as understood by the echo
+ * and printf builtins, storing the result in out (which should be at least as
+ * long as str, as escapes never expand).. in echo mode, octal escapes are in
+ * the form \0nnn, otherwise they are in the form \nnn.. the \c escape stops
+ * the output, and we set *stop to 1 when we find it.. if stop is NULL (as it
+ * is for printf's format), \c is not an escape and is kept as is.
+ *
+ * returns the length of the result, which can contain NUL chars.
+ */
+size_t expand_escapes(char *str, char *out, int echo_mode, int *stop)
+{
+    char *o = out;
+    int   i, n;
+
+    while(*str)
+    {
+        if(*str != '\\' || !str[1])
+        {
+            *o++ = *str++;
+            continue;
+        }
+
+        str++;
+        switch(*str)
+        {
+            case 'a': *o++ = '\a'; str++; break;
+            case 'b': *o++ = '\b'; str++; break;
+            case 'e':
+            case 'E': *o++ = 033 ; str++; break;
+            case 'f': *o++ = '\f'; str++; break;
+            case 'n': *o++ = '\n'; str++; break;
+            case 'r': *o++ = '\r'; str++; break;
+            case 't': *o++ = '\t'; str++; break;
+            case 'v': *o++ = '\v'; str++; break;
+
+            case '\\':
+                *o++ = '\\';
+                str++;
+                break;
+
+            case '"':
+            case '\'':
+                /* printf understands escaped quotes, echo doesn't */
+                if(!echo_mode)
+                {
+                    *o++ = *str++;
+                    break;
+                }
+                *o++ = '\\';
+                break;
+
+            case 'c':
+                /* printf's format keeps \c as is, only %b arguments stop at it */
+                if(!stop)
+                {
+                    *o++ = '\\';
+                    break;
+                }
+                *stop = 1;
+                return o-out;
+
+            case 'x':
+                /* one or two hex digits */
+                for(i = 0, n = 0; i < 2 && isxdigit(str[i+1]); i++)
+                {
+                    n = n*16 + (isdigit(str[i+1]) ? str[i+1]-'0' : tolower(str[i+1])-'a'+10);
+                }
+                if(!i)
+                {
+                    *o++ = '\\';
+                    break;
+                }
+                *o++ = n;
+                str += i+1;
+                break;
+
+            default:
+                /* up to three octal digits, after a 0 in echo mode */
+                if(*str >= '0' && *str <= '7' && (!echo_mode || *str == '0'))
+                {
+                    if(echo_mode)
+                    {
+                        str++;
+                    }
+                    for(i = 0, n = 0; i < 3 && *str >= '0' && *str <= '7'; i++)
+                    {
+                        n = n*8 + (*str++ - '0');
+                    }
+                    *o++ = n;
+                    break;
+                }
+                /* not an escape sequence. keep the backslash */
+                *o++ = '\\';
+                break;
+        }
+    }
+
+    return o-out;
+}
+
+
+/*
+ * convert the ASCII letters in the 8 bytes of x to upper case (or to lower
+ * case), all at once: the high bit of each byte of ge_a is set if the byte is
+ * >= 'a', and that of gt_z if the byte is > 'z'.. the bytes with the first
+ * bit set and the second bit clear are letters, and we flip their 0x20 bit..
+ * all the bytes must be ASCII, so that the additions don't carry into the
+ * next byte.
+ */
+#define ONES        0x0101010101010101ULL
+#define HIGH_BITS   0x8080808080808080ULL
+
+static inline uint64_t convert_case_ascii8(uint64_t x, int upper)
+{
+    uint64_t ge_a = x + ONES*(0x80 - (upper ? 'a' : 'A'));
+    uint64_t gt_z = x + ONES*(0x80 - (upper ? 'z' : 'Z') - 1);
+    uint64_t mask = (ge_a & ~gt_z) & HIGH_BITS;
+    return x ^ (mask >> 2);
+}
+
+
+/*
+ * convert the case of the letters in str.. if all is zero, only the first
+ * char is converted.. if pat is not NULL, only the chars matching the pattern
+ * are converted.
+ *
+ * plain ASCII strings (the common case) are converted 8 bytes at a time..
+ * once we see a non-ASCII byte, we convert the rest of the string one
+ * (possibly multibyte) char at a time, using the current locale's case
+ * mappings.
+ *
+ * returns the malloc'd result, or NULL if insufficient memory.
+ */
+char *convert_case(char *str, int upper, int all, struct glob_pat_s *pat)
+{
+    size_t len = strlen(str), i = 0, n = 0;
+    char  *res = malloc(len+1);
+    uint64_t x;
+
+    if(!res)
+    {
+        return NULL;
+    }
+
+    if(all && !pat)
+    {
+        while(i+8 <= len)
+        {
+            memcpy(&x, str+i, 8);
+            if(x & HIGH_BITS)
+            {
+                break;
+            }
+            x = convert_case_ascii8(x, upper);
+            memcpy(res+i, &x, 8);
+            i += 8;
+        }
+        n = i;
+    }
+
+    mbstate_t ps;
+    memset(&ps, 0, sizeof(ps));
+    while(i < len)
+    {
+        wchar_t wc;
+        size_t clen = mbrtowc(&wc, str+i, len-i, &ps);
+
+        /* invalid or incomplete char. copy the byte as-is */
+        if(clen == (size_t)-1 || clen == (size_t)-2 || clen == 0)
+        {
+            memset(&ps, 0, sizeof(ps));
+            res[n++] = str[i++];
+            continue;
+        }
+
+        int convert = 1;
+        if(pat)
+        {
+            char c[clen+1];
+            memcpy(c, str+i, clen);
+            c[clen] = '\0';
+            convert = glob_match(pat, c);
+        }
+
+        wint_t wc2 = convert ? (upper ? towupper(wc) : towlower(wc)) : (wint_t)wc;
+        char   mb[MB_LEN_MAX];
+        size_t clen2;
+        if(wc2 == (wint_t)wc || (clen2 = wcrtomb(mb, wc2, NULL)) == (size_t)-1 ||
+           clen2 > clen)
+        {
+            /* no change (or the new char is longer than the old one) */
+            memcpy(res+n, str+i, clen);
+            n += clen;
+        }
+        else
+        {
+            memcpy(res+n, mb, clen2);
+            n += clen2;
+        }
+        i += clen;
+
+        if(!all)
+        {
+            memcpy(res+n, str+i, len-i);
+            n += len-i;
+            break;
+        }
+    }
+    res[n] = '\0';
+    return res;
+}
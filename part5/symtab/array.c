@@ -0,0 +1,816 @@
+/*
+ *    Programmed By: Mohammed Isam [mohammed_isam1984@yahoo.com]
+ *    Copyright 2020 (c)
+ *
+ *    file: array.c
+ *    This file is part of the "Let's Build a Linux Shell" tutorial.
+ *
+ *    This tutorial is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This tutorial is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this tutorial.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "../shell.h"
+#include "symtab.h"
+
+
+/*
+ * indexed arrays keep their values in one contiguous vector, indexed by the
+ * subscript.. unset elements are NULL slots.. the vector grows by doubling,
+ * so that adding elements one after the other (as mapfile does) costs an
+ * amortized constant time per element.
+ *
+ * an array with a few elements at far apart subscripts (say, a[0] and
+ * a[1000000]) would waste a lot of memory that way, so when an element is set
+ * far past the end of a mostly empty vector, the array switches to a sparse
+ * form, where the elements are kept in a vector of (subscript, value) pairs,
+ * sorted by subscript.
+ */
+#define ARRAY_SPARSE_MIN    1024    /* don't bother with small vectors */
+
+
+/*
+ * create a new, empty array.
+ *
+ * returns the new array, or NULL if insufficient memory.
+ */
+struct symtab_array_s *new_array(void)
+{
+    struct symtab_array_s *arr = malloc(sizeof(struct symtab_array_s));
+    if(!arr)
+    {
+        fprintf(stderr, "error: no memory for array\n");
+        return NULL;
+    }
+    memset(arr, 0, sizeof(struct symtab_array_s));
+    return arr;
+}
+
+
+/*
+ * remove all the elements of the array.. the array goes back to the
+ * contiguous form.
+ */
+void array_clear(struct symtab_array_s *arr)
+{
+    size_t i;
+    if(arr->elems)
+    {
+        for(i = 0; i < arr->count; i++)
+        {
+            free(arr->elems[i].val);
+        }
+        free(arr->elems);
+        arr->elems = NULL;
+        arr->alloc = 0;
+    }
+    else
+    {
+        for(i = 0; i < arr->size; i++)
+        {
+            free(arr->vals[i]);
+            arr->vals[i] = NULL;
+        }
+    }
+    arr->size  = 0;
+    arr->count = 0;
+}
+
+
+/*
+ * free the memory used by the array.
+ */
+void free_array(struct symtab_array_s *arr)
+{
+    if(!arr)
+    {
+        return;
+    }
+    array_clear(arr);
+    free(arr->vals);
+    free(arr);
+}
+
+
+/*
+ * make sure the array has room for elements with subscripts up to (but not
+ * including) the given size.. for sparse arrays, make sure there's room for
+ * size elements.
+ *
+ * returns 1 on success, 0 if insufficient memory.
+ */
+int array_reserve(struct symtab_array_s *arr, size_t size)
+{
+    if(size <= arr->alloc)
+    {
+        return 1;
+    }
+
+    size_t alloc = arr->alloc ? arr->alloc : 8;
+    while(alloc < size)
+    {
+        alloc *= 2;
+    }
+
+    if(arr->elems)
+    {
+        struct array_elem_s *elems = realloc(arr->elems, alloc*sizeof(struct array_elem_s));
+        if(!elems)
+        {
+            fprintf(stderr, "error: no memory for array elements\n");
+            return 0;
+        }
+        arr->elems = elems;
+        arr->alloc = alloc;
+        return 1;
+    }
+
+    char **vals = realloc(arr->vals, alloc*sizeof(char *));
+    if(!vals)
+    {
+        fprintf(stderr, "error: no memory for array elements\n");
+        return 0;
+    }
+    memset(vals+arr->alloc, 0, (alloc-arr->alloc)*sizeof(char *));
+    arr->vals  = vals;
+    arr->alloc = alloc;
+    return 1;
+}
+
+
+/*
+ * convert a contiguous array to the sparse form.
+ *
+ * returns 1 on success, 0 if insufficient memory.
+ */
+int array_make_sparse(struct symtab_array_s *arr)
+{
+    size_t alloc = arr->count ? arr->count*2 : 8, i, j;
+    struct array_elem_s *elems = malloc(alloc*sizeof(struct array_elem_s));
+    if(!elems)
+    {
+        fprintf(stderr, "error: no memory for array elements\n");
+        return 0;
+    }
+
+    for(i = 0, j = 0; i < arr->size; i++)
+    {
+        if(arr->vals[i])
+        {
+            elems[j].index = i;
+            elems[j++].val = arr->vals[i];
+        }
+    }
+
+    free(arr->vals);
+    arr->vals  = NULL;
+    arr->elems = elems;
+    arr->alloc = alloc;
+    return 1;
+}
+
+
+/*
+ * find the element with the given subscript in a sparse array.
+ *
+ * returns the position of the element in the elems vector, or the position
+ * where it should be inserted if it's not there (and sets *found accordingly).
+ */
+size_t array_find_sparse(struct symtab_array_s *arr, size_t index, int *found)
+{
+    size_t lo = 0, hi = arr->count;
+
+    /* appending is the common case */
+    if(hi && arr->elems[hi-1].index < index)
+    {
+        *found = 0;
+        return hi;
+    }
+
+    while(lo < hi)
+    {
+        size_t mid = lo + (hi-lo)/2;
+        if(arr->elems[mid].index < index)
+        {
+            lo = mid+1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    *found = (lo < arr->count && arr->elems[lo].index == index);
+    return lo;
+}
+
+
+/*
+ * set the element with the given subscript to a copy of the first len chars
+ * of str.
+ *
+ * returns 1 on success, 0 if insufficient memory.
+ */
+int array_setn(struct symtab_array_s *arr, size_t index, char *str, size_t len)
+{
+    /* is the vector going to be mostly empty? */
+    if(!arr->elems && index >= ARRAY_SPARSE_MIN && index >= arr->alloc &&
+       index/4 > arr->count && !array_make_sparse(arr))
+    {
+        return 0;
+    }
+
+    char *val = malloc(len+1);
+    if(!val)
+    {
+        return 0;
+    }
+    memcpy(val, str, len);
+    val[len] = '\0';
+
+    if(arr->elems)
+    {
+        int found;
+        size_t i = array_find_sparse(arr, index, &found);
+        if(found)
+        {
+            free(arr->elems[i].val);
+            arr->elems[i].val = val;
+            return 1;
+        }
+
+        if(!array_reserve(arr, arr->count+1))
+        {
+            free(val);
+            return 0;
+        }
+        memmove(&arr->elems[i+1], &arr->elems[i], (arr->count-i)*sizeof(struct array_elem_s));
+        arr->elems[i].index = index;
+        arr->elems[i].val   = val;
+        arr->count++;
+    }
+    else
+    {
+        if(!array_reserve(arr, index+1))
+        {
+            free(val);
+            return 0;
+        }
+
+        if(arr->vals[index])
+        {
+            free(arr->vals[index]);
+        }
+        else
+        {
+            arr->count++;
+        }
+        arr->vals[index] = val;
+    }
+
+    if(index >= arr->size)
+    {
+        arr->size = index+1;
+    }
+    return 1;
+}
+
+
+/*
+ * set the element with the given subscript to a copy of str.
+ *
+ * returns 1 on success, 0 if insufficient memory.
+ */
+int array_set(struct symtab_array_s *arr, size_t index, char *str)
+{
+    return array_setn(arr, index, str, strlen(str));
+}
+
+
+/*
+ * get the element with the given subscript.
+ *
+ * returns the element's value, or NULL if the element is not set.
+ */
+char *array_get(struct symtab_array_s *arr, size_t index)
+{
+    if(index >= arr->size)
+    {
+        return NULL;
+    }
+
+    if(arr->elems)
+    {
+        int found;
+        size_t i = array_find_sparse(arr, index, &found);
+        return found ? arr->elems[i].val : NULL;
+    }
+    return arr->vals[index];
+}
+
+
+/*
+ * unset the element with the given subscript.
+ */
+void array_unset(struct symtab_array_s *arr, size_t index)
+{
+    if(index >= arr->size)
+    {
+        return;
+    }
+
+    if(arr->elems)
+    {
+        int found;
+        size_t i = array_find_sparse(arr, index, &found);
+        if(!found)
+        {
+            return;
+        }
+        free(arr->elems[i].val);
+        arr->count--;
+        memmove(&arr->elems[i], &arr->elems[i+1], (arr->count-i)*sizeof(struct array_elem_s));
+        arr->size = arr->count ? arr->elems[arr->count-1].index+1 : 0;
+        return;
+    }
+
+    if(!arr->vals[index])
+    {
+        return;
+    }
+    free(arr->vals[index]);
+    arr->vals[index] = NULL;
+    arr->count--;
+
+    /* the array ends at its last set element */
+    while(arr->size && !arr->vals[arr->size-1])
+    {
+        arr->size--;
+    }
+}
+
+
+/*
+ * get the next set element of the array, in subscript order.. *pos should be
+ * zero for the first call.
+ *
+ * returns 1 and sets *index and *val if there's a next element, 0 otherwise.
+ */
+int array_next(struct symtab_array_s *arr, size_t *pos, size_t *index, char **val)
+{
+    if(arr->elems)
+    {
+        if(*pos >= arr->count)
+        {
+            return 0;
+        }
+        *index = arr->elems[*pos].index;
+        *val   = arr->elems[(*pos)++].val;
+        return 1;
+    }
+
+    while(*pos < arr->size && !arr->vals[*pos])
+    {
+        (*pos)++;
+    }
+    if(*pos >= arr->size)
+    {
+        return 0;
+    }
+    *index = *pos;
+    *val   = arr->vals[(*pos)++];
+    return 1;
+}
+
+
+/*
+ * associative arrays are open addressing hash tables with linear probing..
+ * removed keys leave a tombstone behind, so that the probe sequences of the
+ * other keys are not broken.. the table is rebuilt (dropping the tombstones)
+ * when the used slots reach 3/4 of the table.
+ */
+static char assoc_tombstone;
+#define ASSOC_DELETED   (&assoc_tombstone)
+
+
+/*
+ * create a new, empty associative array.
+ *
+ * returns the new array, or NULL if insufficient memory.
+ */
+struct symtab_assoc_s *new_assoc(void)
+{
+    struct symtab_assoc_s *assoc = malloc(sizeof(struct symtab_assoc_s));
+    if(!assoc)
+    {
+        fprintf(stderr, "error: no memory for array\n");
+        return NULL;
+    }
+    memset(assoc, 0, sizeof(struct symtab_assoc_s));
+    return assoc;
+}
+
+
+/*
+ * remove all the elements of the associative array.
+ */
+void assoc_clear(struct symtab_assoc_s *assoc)
+{
+    size_t i;
+    for(i = 0; i < assoc->nslots; i++)
+    {
+        struct assoc_slot_s *slot = &assoc->slots[i];
+        if(slot->key && slot->key != ASSOC_DELETED)
+        {
+            free(slot->key);
+            free(slot->val);
+        }
+    }
+    free(assoc->slots);
+    assoc->slots  = NULL;
+    assoc->nslots = 0;
+    assoc->count  = 0;
+    assoc->used   = 0;
+}
+
+
+/*
+ * free the memory used by the associative array.
+ */
+void free_assoc(struct symtab_assoc_s *assoc)
+{
+    if(!assoc)
+    {
+        return;
+    }
+    assoc_clear(assoc);
+    free(assoc);
+}
+
+
+/*
+ * find the slot of the given key.
+ *
+ * returns the key's slot, or the slot where the key should be added if it's
+ * not in the table (NULL if the table is empty).
+ */
+struct assoc_slot_s *assoc_find(struct symtab_assoc_s *assoc, char *key, unsigned int hash)
+{
+    struct assoc_slot_s *free_slot = NULL;
+
+    if(!assoc->nslots)
+    {
+        return NULL;
+    }
+
+    size_t i = hash & (assoc->nslots-1);
+    while(assoc->slots[i].key)
+    {
+        struct assoc_slot_s *slot = &assoc->slots[i];
+        if(slot->key == ASSOC_DELETED)
+        {
+            if(!free_slot)
+            {
+                free_slot = slot;
+            }
+        }
+        else if(slot->hash == hash && strcmp(slot->key, key) == 0)
+        {
+            return slot;
+        }
+        i = (i+1) & (assoc->nslots-1);
+    }
+    return free_slot ? free_slot : &assoc->slots[i];
+}
+
+
+/*
+ * rebuild the table with the given number of slots (a power of 2).
+ *
+ * returns 1 on success, 0 if insufficient memory.
+ */
+int assoc_rehash(struct symtab_assoc_s *assoc, size_t nslots)
+{
+    struct assoc_slot_s *slots = calloc(nslots, sizeof(struct assoc_slot_s));
+    struct assoc_slot_s *old   = assoc->slots;
+    size_t i, nold = assoc->nslots;
+
+    if(!slots)
+    {
+        fprintf(stderr, "error: no memory for array elements\n");
+        return 0;
+    }
+
+    assoc->slots  = slots;
+    assoc->nslots = nslots;
+    assoc->used   = assoc->count;
+    for(i = 0; i < nold; i++)
+    {
+        if(old[i].key && old[i].key != ASSOC_DELETED)
+        {
+            *assoc_find(assoc, old[i].key, old[i].hash) = old[i];
+        }
+    }
+    free(old);
+    return 1;
+}
+
+
+/*
+ * set the element with the given key to a copy of val.
+ *
+ * returns 1 on success, 0 if insufficient memory.
+ */
+int assoc_set(struct symtab_assoc_s *assoc, char *key, char *val)
+{
+    if((assoc->used+1)*4 > assoc->nslots*3)
+    {
+        /* grow the table, unless it's full of tombstones */
+        size_t nslots = assoc->nslots ? assoc->nslots : 8;
+        while((assoc->count+1)*2 > nslots)
+        {
+            nslots *= 2;
+        }
+        if(!assoc_rehash(assoc, nslots))
+        {
+            return 0;
+        }
+    }
+
+    unsigned int hash = str_hash(key);
+    struct assoc_slot_s *slot = assoc_find(assoc, key, hash);
+    char *val2 = malloc(strlen(val)+1);
+    if(!val2)
+    {
+        return 0;
+    }
+    strcpy(val2, val);
+
+    if(slot->key && slot->key != ASSOC_DELETED)
+    {
+        free(slot->val);
+        slot->val = val2;
+        return 1;
+    }
+
+    char *key2 = malloc(strlen(key)+1);
+    if(!key2)
+    {
+        free(val2);
+        return 0;
+    }
+    strcpy(key2, key);
+
+    if(!slot->key)
+    {
+        assoc->used++;
+    }
+    slot->key  = key2;
+    slot->val  = val2;
+    slot->hash = hash;
+    assoc->count++;
+    return 1;
+}
+
+
+/*
+ * get the element with the given key.
+ *
+ * returns the element's value, or NULL if the element is not set.
+ */
+char *assoc_get(struct symtab_assoc_s *assoc, char *key)
+{
+    struct assoc_slot_s *slot = assoc_find(assoc, key, str_hash(key));
+    return (slot && slot->key && slot->key != ASSOC_DELETED) ? slot->val : NULL;
+}
+
+
+/*
+ * unset the element with the given key.
+ */
+void assoc_unset(struct symtab_assoc_s *assoc, char *key)
+{
+    struct assoc_slot_s *slot = assoc_find(assoc, key, str_hash(key));
+    if(!slot || !slot->key || slot->key == ASSOC_DELETED)
+    {
+        return;
+    }
+    free(slot->key);
+    free(slot->val);
+    slot->key = ASSOC_DELETED;
+    slot->val = NULL;
+    assoc->count--;
+}
+
+
+/*
+ * get the next element of the associative array (in no particular order)..
+ * *pos should be zero for the first call.
+ *
+ * returns 1 and sets *key and *val if there's a next element, 0 otherwise.
+ */
+int assoc_next(struct symtab_assoc_s *assoc, size_t *pos, char **key, char **val)
+{
+    while(*pos < assoc->nslots)
+    {
+        struct assoc_slot_s *slot = &assoc->slots[(*pos)++];
+        if(slot->key && slot->key != ASSOC_DELETED)
+        {
+            *key = slot->key;
+            *val = slot->val;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * get the array of the given entry.. if the entry is not an array, it is
+ * turned into one, with its old value (if any) as element 0.
+ *
+ * returns the array, or NULL if insufficient memory (or if the entry is an
+ * associative array).
+ */
+struct symtab_array_s *symtab_entry_getarray(struct symtab_entry_s *entry)
+{
+    if(entry->val_type == SYM_ARRAY)
+    {
+        return entry->array;
+    }
+
+    if(entry->val_type == SYM_ASSOC)
+    {
+        fprintf(stderr, "error: %s: cannot convert associative array to indexed array\n",
+                entry->name);
+        return NULL;
+    }
+
+    struct symtab_array_s *arr = new_array();
+    if(!arr)
+    {
+        return NULL;
+    }
+
+    char *val = symtab_entry_getval(entry);
+    if(val && !array_set(arr, 0, val))
+    {
+        free_array(arr);
+        return NULL;
+    }
+
+    free_entry_val(entry);
+    entry->num_type = 0;
+    entry->flags   &= ~FLAG_STALE_VAL;
+    entry->val_type = SYM_ARRAY;
+    entry->array    = arr;
+    return arr;
+}
+
+
+/*
+ * get the associative array of the given entry.. if the entry is not an
+ * array, it is turned into one, with its old value (if any) as element "0".
+ *
+ * returns the associative array, or NULL if insufficient memory (or if the
+ * entry is an indexed array).
+ */
+struct symtab_assoc_s *symtab_entry_getassoc(struct symtab_entry_s *entry)
+{
+    if(entry->val_type == SYM_ASSOC)
+    {
+        return entry->assoc;
+    }
+
+    if(entry->val_type == SYM_ARRAY)
+    {
+        fprintf(stderr, "error: %s: cannot convert indexed array to associative array\n",
+                entry->name);
+        return NULL;
+    }
+
+    struct symtab_assoc_s *assoc = new_assoc();
+    if(!assoc)
+    {
+        return NULL;
+    }
+
+    char *val = symtab_entry_getval(entry);
+    if(val && !assoc_set(assoc, "0", val))
+    {
+        free_assoc(assoc);
+        return NULL;
+    }
+
+    free_entry_val(entry);
+    entry->num_type = 0;
+    entry->flags   &= ~FLAG_STALE_VAL;
+    entry->val_type = SYM_ASSOC;
+    entry->assoc    = assoc;
+    return assoc;
+}
+
+
+/*
+ * evaluate the subscript of an indexed array, which is an arithmetic
+ * expression.. negative subscripts count back from the end of the array.
+ *
+ * returns 1 on success, 0 if the subscript is invalid.
+ */
+int array_subscript(struct symtab_entry_s *entry, char *subscript, size_t *index)
+{
+    long n = 0;
+    if(!arithm_eval(subscript, &n))
+    {
+        return 0;
+    }
+
+    if(n < 0)
+    {
+        n += (entry->val_type == SYM_ARRAY) ? (long)entry->array->size : 1;
+        if(n < 0)
+        {
+            fprintf(stderr, "error: %s: bad array subscript\n", entry->name);
+            return 0;
+        }
+    }
+    *index = n;
+    return 1;
+}
+
+
+/*
+ * get the element of the entry with the given (expanded) subscript.. for
+ * variables that are not arrays, subscript 0 gives the variable's value.
+ *
+ * returns the element's value, or NULL if the element is not set.
+ */
+char *symtab_entry_getelem(struct symtab_entry_s *entry, char *subscript)
+{
+    size_t index;
+
+    if(entry->val_type == SYM_ASSOC)
+    {
+        return assoc_get(entry->assoc, subscript);
+    }
+
+    if(!array_subscript(entry, subscript, &index))
+    {
+        return NULL;
+    }
+
+    if(entry->val_type == SYM_ARRAY)
+    {
+        return array_get(entry->array, index);
+    }
+    return index ? NULL : symtab_entry_getval(entry);
+}
+
+
+/*
+ * assign val to the element of the entry with the given (expanded) subscript,
+ * turning the entry into an indexed array if it is not an array.. as with
+ * symtab_entry_assign(), the elements of integer arrays are evaluated as
+ * arithmetic expressions.
+ *
+ * returns 1 if the value is assigned, 0 on error.
+ */
+int symtab_entry_setelem(struct symtab_entry_s *entry, char *subscript, char *val)
+{
+    char buf[32];
+    size_t index;
+
+    if(entry->flags & FLAG_INTEGER)
+    {
+        long num = 0;
+        if(!arithm_eval(val, &num))
+        {
+            return 0;
+        }
+        sprintf(buf, "%ld", num);
+        val = buf;
+    }
+
+    if(entry->val_type == SYM_ASSOC)
+    {
+        return assoc_set(entry->assoc, subscript, val);
+    }
+
+    struct symtab_array_s *arr;
+    if(!array_subscript(entry, subscript, &index) || !(arr = symtab_entry_getarray(entry)))
+    {
+        return 0;
+    }
+    return array_set(arr, index, val);
+}
@@ -30,6 +30,14 @@
 struct symtab_stack_s symtab_stack;
 int    symtab_level;
 
+/*
+ * incremented whenever an entry is added to or removed from the symbol table
+ * stack, or when a symbol table is pushed or popped.. callers who cache entry
+ * pointers (such as compiled arithmetic expressions) use this to know when
+ * they need to repeat the lookup.
+ */
+unsigned long symtab_generation = 1;
+
 
 void init_symtab(void)
 {
@@ -68,6 +76,41 @@ struct symtab_s *new_symtab(int level)
 }
 
 
+/*
+ * free the memory used by the entry's value, whatever its type is.
+ */
+void free_entry_val(struct symtab_entry_s *entry)
+{
+    switch(entry->val_type)
+    {
+        case SYM_FUNC:
+            if(entry->func_body)
+            {
+                free_node_tree(entry->func_body);
+            }
+            break;
+
+        case SYM_ARRAY:
+            free_array(entry->array);
+            break;
+
+        case SYM_ASSOC:
+            free_assoc(entry->assoc);
+            break;
+    }
+    entry->array = NULL;
+
+    if(!(entry->flags & FLAG_SMALL_VAL))
+    {
+        rcstr_unref(entry->val.heap.buf);
+    }
+    entry->val.heap.buf  = NULL;
+    entry->val.heap.len  = 0;
+    entry->val.heap.size = 0;
+    entry->flags &= ~FLAG_SMALL_VAL;
+}
+
+
 void free_symtab(struct symtab_s *symtab)
 {
     if(symtab == NULL)
@@ -84,15 +127,7 @@ void free_symtab(struct symtab_s *symtab)
             free(entry->name);
         }
     
-        if(entry->val)
-        {
-            free(entry->val);
-        }
-    
-        if(entry->func_body)
-        {
-            free_node_tree(entry->func_body);
-        }
+        free_entry_val(entry);
     
     	struct symtab_entry_s *next = entry->next;
         free(entry);
@@ -119,7 +154,7 @@ void dump_local_symtab(void)
     while(entry)
     {
         fprintf(stderr, "%*s[%04d] %-32s '%s'\r\n", indent, " ",
-                i++, entry->name, entry->val);
+                i++, entry->name, symtab_entry_getval(entry));
         entry = entry->next;
     }
     
@@ -160,6 +195,7 @@ struct symtab_entry_s *add_to_symtab(char *symbol)
     }
     
     strcpy(entry->name, symbol);
+    symtab_generation++;
     
     if(!st->first)
     {
@@ -218,48 +254,291 @@ struct symtab_entry_s *get_symtab_entry(char *str)
 }
 
 
-void symtab_entry_setval(struct symtab_entry_s *entry, char *val)
+/*
+ * store len chars of str as the entry's string value.. short values go inside
+ * the entry.. longer ones go in the entry's rcstr buffer, which we keep and
+ * overwrite for as long as new values fit in it, so that a loop that keeps
+ * assigning to a variable doesn't alloc and free memory each time around (we
+ * only give the buffer back if it is much bigger than what we store in it)..
+ * if someone else has a reference to the buffer (see symtab_entry_getref()),
+ * it keeps the old value and we get a new buffer.. str can point to the
+ * entry's current value.
+ *
+ * returns 1 on success, 0 if insufficient memory (the old value is kept).
+ */
+int store_val(struct symtab_entry_s *entry, char *str, size_t len)
 {
-    if(entry->val)
+    char  *buf  = entry->val.heap.buf;
+    size_t size = entry->val.heap.size;
+
+    if(entry->flags & FLAG_SMALL_VAL)
     {
-        free(entry->val);
+        if(len <= SYMTAB_SMALL_VAL)
+        {
+            memmove(entry->val.small.buf, str, len);
+            entry->val.small.buf[len] = '\0';
+            entry->val.small.len = len;
+            return 1;
+        }
+        buf  = NULL;
+        size = 0;
+    }
+    else if(buf && len < size && (size <= 256 || len >= size/4) && !rcstr_shared(buf))
+    {
+        memmove(buf, str, len);
+        buf[len] = '\0';
+        entry->val.heap.len = len;
+        return 1;
     }
 
-    if(!val)
+    if(len <= SYMTAB_SMALL_VAL)
     {
-        entry->val = NULL;
+        /* str might be in buf, which shares its memory with small.buf */
+        char tmp[SYMTAB_SMALL_VAL];
+        memcpy(tmp, str, len);
+        rcstr_unref(buf);
+        memcpy(entry->val.small.buf, tmp, len);
+        entry->val.small.buf[len] = '\0';
+        entry->val.small.len = len;
+        entry->flags |= FLAG_SMALL_VAL;
+        return 1;
     }
-    else
+
+    /* leave some room to grow if the value is growing */
+    size_t size2 = (len < size) ? len+1 : (len+1)+(size/2);
+    char *buf2 = rcstr_alloc(size2);
+    if(!buf2)
     {
-        char *val2 = malloc(strlen(val)+1);
-    
-    	if(val2)
+        return 0;
+    }
+    memcpy(buf2, str, len);
+    buf2[len] = '\0';
+
+    rcstr_unref(buf);
+    entry->val.heap.buf  = buf2;
+    entry->val.heap.len  = len;
+    entry->val.heap.size = size2;
+    entry->flags &= ~FLAG_SMALL_VAL;
+    return 1;
+}
+
+
+void symtab_entry_setval(struct symtab_entry_s *entry, char *val)
+{
+    /* assigning to an array's name assigns to its element 0 */
+    if(entry->val_type == SYM_ARRAY)
+    {
+        if(val)
         {
-            strcpy(val2, val);
+            array_set(entry->array, 0, val);
         }
         else
         {
-            fprintf(stderr, "error: no memory for symbol table entry's value\n");
+            array_unset(entry->array, 0);
         }
-    
-    	entry->val = val2;
+        return;
+    }
+
+    if(entry->val_type == SYM_ASSOC)
+    {
+        if(val)
+        {
+            assoc_set(entry->assoc, "0", val);
+        }
+        else
+        {
+            assoc_unset(entry->assoc, "0");
+        }
+        return;
+    }
+
+    /* the string value is now the only value this entry has */
+    entry->num_type = 0;
+    entry->flags   &= ~FLAG_STALE_VAL;
+
+    if(!val)
+    {
+        free_entry_val(entry);
+    }
+    else if(!store_val(entry, val, strlen(val)))
+    {
+        fprintf(stderr, "error: no memory for symbol table entry's value\n");
     }
 }
 
 
-int rem_from_symtab(struct symtab_entry_s *entry, struct symtab_s *symtab)
+/*
+ * set the entry's value to the given native long integer.. the string form
+ * of the value is not created until someone asks for it (by calling
+ * symtab_entry_getval()), so that arithmetic on the variable doesn't need to
+ * convert the value to a string and back.
+ */
+void symtab_entry_setlong(struct symtab_entry_s *entry, long val)
 {
-    int res = 0;
-    if(entry->val)
+    if(entry->val_type == SYM_ARRAY || entry->val_type == SYM_ASSOC)
     {
-        free(entry->val);
+        char buf[32];
+        sprintf(buf, "%ld", val);
+        symtab_entry_setval(entry, buf);
+        return;
     }
 
-    if(entry->func_body)
+    entry->num_type  = VAL_SINT;
+    entry->num.sint  = val;
+    entry->flags    |= FLAG_STALE_VAL;
+}
+
+
+/*
+ * set the entry's value to the given native floating point number.. as with
+ * symtab_entry_setlong(), the string form of the value is created on demand.
+ * integer variables keep integer values, so the number is truncated.
+ */
+void symtab_entry_setdouble(struct symtab_entry_s *entry, double val)
+{
+    if(entry->flags & FLAG_INTEGER)
     {
-        free_node_tree(entry->func_body);
+        symtab_entry_setlong(entry, (long)val);
+        return;
     }
-    
+
+    if(entry->val_type == SYM_ARRAY || entry->val_type == SYM_ASSOC)
+    {
+        char buf[32];
+        double_to_str(val, buf, sizeof(buf));
+        symtab_entry_setval(entry, buf);
+        return;
+    }
+
+    entry->num_type    = VAL_FLOAT;
+    entry->num.sfloat  = val;
+    entry->flags      |= FLAG_STALE_VAL;
+}
+
+
+/*
+ * get the string value of the given entry, converting the entry's native
+ * value to a string if the string value is out of date.
+ *
+ * returns the value, which might be NULL if the entry has no value.
+ */
+char *symtab_entry_getval(struct symtab_entry_s *entry)
+{
+    /* an array's name alone refers to its element 0 */
+    if(entry->val_type == SYM_ARRAY)
+    {
+        return array_get(entry->array, 0);
+    }
+
+    if(entry->val_type == SYM_ASSOC)
+    {
+        return assoc_get(entry->assoc, "0");
+    }
+
+    if(!(entry->flags & FLAG_STALE_VAL))
+    {
+        return (entry->flags & FLAG_SMALL_VAL) ? entry->val.small.buf : entry->val.heap.buf;
+    }
+
+    char buf[32];
+    size_t len;
+    if(entry->num_type == VAL_FLOAT)
+    {
+        len = double_to_str(entry->num.sfloat, buf, sizeof(buf));
+    }
+    else
+    {
+        len = sprintf(buf, "%ld", entry->num.sint);
+    }
+
+    if(store_val(entry, buf, len))
+    {
+        entry->flags &= ~FLAG_STALE_VAL;
+    }
+    else
+    {
+        fprintf(stderr, "error: no memory for symbol table entry's value\n");
+    }
+    return (entry->flags & FLAG_SMALL_VAL) ? entry->val.small.buf : entry->val.heap.buf;
+}
+
+
+/*
+ * get the length of the string value of the given entry.. we keep the length
+ * of scalar values, so we don't need to scan them to find it.
+ *
+ * returns the length, or 0 if the entry has no value.
+ */
+size_t symtab_entry_getlen(struct symtab_entry_s *entry)
+{
+    char *val = symtab_entry_getval(entry);
+    if(!val)
+    {
+        return 0;
+    }
+    if(entry->val_type != SYM_STR)
+    {
+        return strlen(val);
+    }
+    return (entry->flags & FLAG_SMALL_VAL) ? entry->val.small.len : entry->val.heap.len;
+}
+
+
+/*
+ * get a reference to the string value of the given entry, which the caller
+ * can keep for as long as it needs (giving it back with rcstr_unref()), no
+ * matter what happens to the entry.. long values are shared with the entry,
+ * and only short ones (or array elements) are copied.
+ *
+ * returns the rcstr, or NULL if the entry has no value (or if insufficient
+ * memory).
+ */
+char *symtab_entry_getref(struct symtab_entry_s *entry)
+{
+    char *val = symtab_entry_getval(entry);
+    if(!val)
+    {
+        return NULL;
+    }
+
+    if(entry->val_type == SYM_STR && !(entry->flags & FLAG_SMALL_VAL))
+    {
+        return rcstr_ref(val);
+    }
+    return rcstr_dup(val, symtab_entry_getlen(entry));
+}
+
+
+/*
+ * assign the given value to the entry.. the value of integer variables (the
+ * ones declared with declare -i) is evaluated as an arithmetic expression,
+ * and the result is stored as the entry's native value.
+ *
+ * returns 1 if the value is assigned, 0 on error.
+ */
+int symtab_entry_assign(struct symtab_entry_s *entry, char *val)
+{
+    if(entry->flags & FLAG_INTEGER)
+    {
+        long num = 0;
+        if(val && !arithm_eval(val, &num))
+        {
+            return 0;
+        }
+        symtab_entry_setlong(entry, num);
+        return 1;
+    }
+
+    symtab_entry_setval(entry, val);
+    return 1;
+}
+
+
+int rem_from_symtab(struct symtab_entry_s *entry, struct symtab_s *symtab)
+{
+    int res = 0;
+    symtab_generation++;
+    free_entry_val(entry);
     free(entry->name);
     
     if(symtab->first == entry)
@@ -286,6 +565,10 @@ int rem_from_symtab(struct symtab_entry_s *entry, struct symtab_s *symtab)
     	if(e == entry)
         {
             p->next = entry->next;
+            if(symtab->last == entry)
+            {
+                symtab->last = p;
+            }
             res = 1;
         }
     }
@@ -299,6 +582,7 @@ void symtab_stack_add(struct symtab_s *symtab)
 {
     symtab_stack.symtab_list[symtab_stack.symtab_count++] = symtab;
     symtab_stack.local_symtab = symtab;
+    symtab_generation++;
 }
 
 
@@ -321,6 +605,7 @@ struct symtab_s *symtab_stack_pop(void)
     
     symtab_stack.symtab_list[--symtab_stack.symtab_count] = NULL;
     symtab_level--;
+    symtab_generation++;
     
     if(symtab_stack.symtab_count == 0)
     {
@@ -352,3 +637,9 @@ struct symtab_stack_s *get_symtab_stack(void)
 {
     return &symtab_stack;
 }
+
+
+unsigned long get_symtab_generation(void)
+{
+    return symtab_generation;
+}
@@ -29,17 +29,86 @@ enum symbol_type_e
 {
     SYM_STR ,
     SYM_FUNC,
+    SYM_ARRAY,
+    SYM_ASSOC,
 };
 
-/* the symbol table entry structure */
+/* an element of a sparse indexed array */
+struct array_elem_s
+{
+    size_t  index;                    /* the element's subscript */
+    char   *val;                      /* and its value */
+};
+
+/* the elements of an indexed array */
+struct symtab_array_s
+{
+    char  **vals;                     /* the elements, indexed by subscript */
+    struct  array_elem_s *elems;      /* the elements, if the array is sparse */
+    size_t  size;                     /* one more than the highest subscript */
+    size_t  count;                    /* number of set elements */
+    size_t  alloc;                    /* number of allocated slots in vals/elems */
+};
+
+/* a slot in the hash table of an associative array */
+struct assoc_slot_s
+{
+    char         *key;                /* NULL for empty slots */
+    char         *val;
+    unsigned int  hash;               /* the key's hash value */
+};
+
+/* the elements of an associative array */
+struct symtab_assoc_s
+{
+    struct assoc_slot_s *slots;       /* the hash table */
+    size_t  nslots;                   /* size of the table (a power of 2) */
+    size_t  count;                    /* number of elements */
+    size_t  used;                     /* number of non-empty slots (incl. removed keys) */
+};
+
+/* values up to this long are stored inside the symbol table entry itself */
+#define SYMTAB_SMALL_VAL    22
+
+/*
+ * the symbol table entry structure.. the fields are ordered (and sized) so
+ * that an entry fits in one 64-byte cache line.. the string value is either
+ * stored in the entry (if it is short, see FLAG_SMALL_VAL), or in an rcstr
+ * buffer which is reused by later values that fit in it.. use
+ * symtab_entry_getval() and symtab_entry_getlen() to get the value.
+ */
 struct symtab_entry_s
 {
     char     *name;                   /* key */
-    enum      symbol_type_e val_type; /* type of value */
-    char     *val;                    /* value */
-    unsigned  int flags;              /* flags like readonly, export, ... */
     struct    symtab_entry_s *next;   /* pointer to the next entry */
-    struct    node_s *func_body;      /* func's body AST (for funcs) */
+    union
+    {
+        struct node_s *func_body;     /* func's body AST (for funcs) */
+        struct symtab_array_s *array; /* array elements (for indexed arrays) */
+        struct symtab_assoc_s *assoc; /* array elements (for associative arrays) */
+    };
+    union
+    {
+        long   sint;
+        double sfloat;
+    } num;                            /* native (numeric) value */
+    union
+    {
+        struct
+        {
+            char   *buf;              /* value (an rcstr), NULL if the entry has none */
+            size_t  len;              /* length of value */
+            size_t  size;             /* allocated size of buf */
+        } heap;
+        struct
+        {
+            char    buf[SYMTAB_SMALL_VAL+1];
+            unsigned char len;
+        } small;                      /* short values, if FLAG_SMALL_VAL is set */
+    } val;
+    unsigned  char val_type;          /* type of value (enum symbol_type_e) */
+    unsigned  char num_type;          /* type of the native value (enum val_type_e, 0 if none) */
+    unsigned  short flags;            /* flags like readonly, export, ... */
 };
 
 
@@ -51,6 +120,9 @@ struct symtab_s
 
 /* values for the flags field of struct symtab_entry_s */
 #define FLAG_EXPORT     (1 << 0)    /* export entry to forked commands */
+#define FLAG_INTEGER    (1 << 1)    /* integer variable (declare -i) */
+#define FLAG_STALE_VAL  (1 << 2)    /* val is out of date with the native value */
+#define FLAG_SMALL_VAL  (1 << 3)    /* val is stored inside the entry */
 
 /* the symbol table stack structure */
 #define MAX_SYMTAB	256  /* maximum allowed symbol tables in the stack */
@@ -76,9 +148,41 @@ struct symtab_entry_s *get_symtab_entry(char *str);
 struct symtab_s       *get_local_symtab(void);
 struct symtab_s       *get_global_symtab(void);
 struct symtab_stack_s *get_symtab_stack(void);
+unsigned long          get_symtab_generation(void);
 void                   init_symtab(void);
 void                   dump_local_symtab(void);
 void                   free_symtab(struct symtab_s *symtab);
+void                   free_entry_val(struct symtab_entry_s *entry);
+int                    store_val(struct symtab_entry_s *entry, char *str, size_t len);
 void                   symtab_entry_setval(struct symtab_entry_s *entry, char *val);
+void                   symtab_entry_setlong(struct symtab_entry_s *entry, long val);
+void                   symtab_entry_setdouble(struct symtab_entry_s *entry, double val);
+char                  *symtab_entry_getval(struct symtab_entry_s *entry);
+size_t                 symtab_entry_getlen(struct symtab_entry_s *entry);
+char                  *symtab_entry_getref(struct symtab_entry_s *entry);
+int                    symtab_entry_assign(struct symtab_entry_s *entry, char *val);
+
+/* indexed and associative arrays (array.c) */
+struct symtab_array_s *new_array(void);
+void                   free_array(struct symtab_array_s *arr);
+void                   array_clear(struct symtab_array_s *arr);
+int                    array_reserve(struct symtab_array_s *arr, size_t size);
+int                    array_set(struct symtab_array_s *arr, size_t index, char *str);
+int                    array_setn(struct symtab_array_s *arr, size_t index, char *str, size_t len);
+char                  *array_get(struct symtab_array_s *arr, size_t index);
+void                   array_unset(struct symtab_array_s *arr, size_t index);
+int                    array_next(struct symtab_array_s *arr, size_t *pos, size_t *index, char **val);
+struct symtab_assoc_s *new_assoc(void);
+void                   free_assoc(struct symtab_assoc_s *assoc);
+void                   assoc_clear(struct symtab_assoc_s *assoc);
+int                    assoc_set(struct symtab_assoc_s *assoc, char *key, char *val);
+char                  *assoc_get(struct symtab_assoc_s *assoc, char *key);
+void                   assoc_unset(struct symtab_assoc_s *assoc, char *key);
+int                    assoc_next(struct symtab_assoc_s *assoc, size_t *pos, char **key, char **val);
+struct symtab_array_s *symtab_entry_getarray(struct symtab_entry_s *entry);
+struct symtab_assoc_s *symtab_entry_getassoc(struct symtab_entry_s *entry);
+int                    array_subscript(struct symtab_entry_s *entry, char *subscript, size_t *index);
+char                  *symtab_entry_getelem(struct symtab_entry_s *entry, char *subscript);
+int                    symtab_entry_setelem(struct symtab_entry_s *entry, char *subscript, char *val);
 
 #endif
@@ -0,0 +1,9 @@
+echo $((3*2+1))
+x=$((1+2))
+echo $x
+echo a$((2))b $(echo hi) "$(echo quoted)" ${x}
+i=0
+while [ $i -lt 3 ]; do i=$((i+1)); echo i=$i; done
+[[ $(echo ab) =~ ^a$(echo b)$ ]]; echo $?
+[[ ab =~ ^(a)$(echo b) ]]; echo $? ${BASH_REMATCH[1]}
+case $((1+1)) in 2) echo two ;; esac
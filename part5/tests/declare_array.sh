@@ -0,0 +1,9 @@
+v="p q"
+declare -a x=(1 "2 3" $v)
+echo ${#x[@]} ${x[1]} ${x[3]}
+declare -A q=([a]=1 [b]="two words")
+echo ${q[b]} ${q[a]}
+typeset -i n=(1+1 2*3)
+echo ${n[0]} ${n[1]}
+declare y=(a b) z=5
+echo ${y[1]} $z
@@ -0,0 +1,12 @@
+e=()
+for w in "${e[@]}"; do echo "[$w]"; done
+for w in "${e[@]}" b "${!e[@]}" "${e[@]:1}"; do echo "[$w]"; done
+for w in "x${e[@]}" "${e[@]}""" "${e[*]}"; do echo "[$w]"; done
+set -- "${e[@]}"
+echo $#
+m=("${e[@]}" z "$@")
+echo ${#m[@]}
+a=(1 "" 3)
+for w in "${a[@]}"; do echo "[$w]"; done
+set -- p "q r"
+for w in "${@:3}" "${@:2}"; do echo "[$w]"; done
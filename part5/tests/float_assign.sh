@@ -0,0 +1,13 @@
+v=abc+
+let "# v = 2"
+echo v=$v
+let "# w = 2.5" "# w += 1" "# w *= 2"
+echo w=$w
+x=3
+let "# x++" "# y = x = 1.5"
+echo $x $y
+f=2.5
+echo $((# f*2))
+echo $((f))
+n=7
+echo $((# n/2)) $((n/2))
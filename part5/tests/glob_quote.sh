@@ -0,0 +1,9 @@
+mkdir glob.tmp
+touch glob.tmp/'a\b1' glob.tmp/ab2 glob.tmp/'a"c3' glob.tmp/'q*1' glob.tmp/q22
+echo glob.tmp/"a\b"*
+echo glob.tmp/"a\"c"*
+echo glob.tmp/'q*'*
+echo "glob.tmp/a\b"*
+echo "glob.tmp"'/a'*
+echo glob.tmp/a\\b*
+rm -r glob.tmp
@@ -0,0 +1,11 @@
+m=$(( -9223372036854775807 - 1 ))
+echo $m
+echo $(( m / -1 )) $(( m % -1 ))
+x=$m
+let "x /= -1"
+echo $x
+x=$m
+let "x %= -1"
+echo $x
+echo $(( 7 / -1 )) $(( -7 % -1 )) $(( 7 / 2 )) $(( -7 % 3 ))
+echo after
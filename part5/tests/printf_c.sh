@@ -0,0 +1,6 @@
+printf "a\\cb\\n"
+printf "%b|\\n" "x\\cy" z
+echo
+printf "%s\\c%s\\n" 1 2
+echo -e "p\\cq"
+echo after
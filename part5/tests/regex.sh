@@ -0,0 +1,4 @@
+[[ ab =~ ^(a)$(echo b)$ ]]; echo $? ${BASH_REMATCH[1]}
+[[ ab =~ (a ]]; echo $?
+echo next
+[[ "a b" =~ ^(a b)$ ]]; echo $?
@@ -0,0 +1,46 @@
+#!/bin/sh
+#
+#    file: tests/run.sh
+#    This file is part of the "Let's Build a Linux Shell" tutorial.
+#
+#    run each tests/*.sh script with the shell, and compare what it prints
+#    (stdout and stderr) with the matching .out file.. if there's a matching
+#    .in file, it is the script's standard input.. the tests/*.cmds files are
+#    given to the shell on its standard input instead, and only their stdout
+#    is compared (as the prompts go to stderr).
+#
+
+cd "$(dirname "$0")" || exit 1
+
+fail=0
+for t in *.sh
+do
+    [ "$t" = run.sh ] && continue
+
+    name="${t%.sh}"
+    input=/dev/null
+    [ -f "$name.in" ] && input="$name.in"
+
+    if ../shell "$t" < "$input" 2>&1 | cmp -s - "$name.out"
+    then
+        echo "PASS: $name"
+    else
+        echo "FAIL: $name"
+        fail=1
+    fi
+done
+
+for t in *.cmds
+do
+    [ -f "$t" ] || continue
+
+    name="${t%.cmds}"
+    if ../shell < "$t" 2>/dev/null | cmp -s - "$name.out"
+    then
+        echo "PASS: $name"
+    else
+        echo "FAIL: $name"
+        fail=1
+    fi
+done
+exit $fail
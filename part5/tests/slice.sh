@@ -0,0 +1,14 @@
+set -- x "y z" w
+IFS=:
+echo "${*:1:2}" "${*:2}" ${*:1:2} "${@:2}"
+IFS=" "
+echo "${*:1:2}" "${*: -1}" "${*:5}" "${*:1:0}" "${@: -2:1}"
+for p in "${@:2}"; do echo "<$p>"; done
+for p in "${*:2}"; do echo "[$p]"; done
+echo ${#*} "${*:1:1}"
+a=(p "q r" s)
+a[7]=t
+echo "${a[*]:1}" "${a[@]:0:2}" "${a[@]: -1}" "${a[*]:4}"
+for e in "${a[@]:1:2}"; do echo "<$e>"; done
+v=abcdef
+echo ${v:1:2} ${v: -3} ${v:2:-1}
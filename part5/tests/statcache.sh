@@ -0,0 +1,6 @@
+[ -e run.sh -a -e slice.sh -a -e regex.sh -a -e stdin.sh -a run.sh -ef cmdsubst.sh ]
+echo $?
+[ -e run.sh -a -e slice.sh -a -e regex.sh -a -e stdin.sh -a run.sh -ef ./run.sh ]
+echo $?
+[ -e run.sh -a -e slice.sh -a -e regex.sh -a -e stdin.sh -a run.sh -nt no-such-file ]
+echo $?
@@ -0,0 +1,4 @@
+read a
+echo a=$a
+cat
+echo done
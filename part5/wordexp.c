@@ -47,6 +47,16 @@
  * returns the malloc'd cmd_token struct, or NULL if insufficient memory.
  */
 struct word_s *make_word(char *str)
+{
+    return make_wordn(str, strlen(str));
+}
+
+
+/*
+ * same as make_word(), for the first len chars of str (when we already know
+ * the length, there's no need to scan the string for it again).
+ */
+struct word_s *make_wordn(char *str, size_t len)
 {
     /* alloc struct memory */
     struct word_s *word = malloc(sizeof(struct word_s));
@@ -55,9 +65,8 @@ struct word_s *make_word(char *str)
         return NULL;
     }
 
-    /* alloc string memory */
-    size_t  len  = strlen(str);
-    char   *data = malloc(len+1);
+    /* alloc string memory and copy the string */
+    char   *data = rcstr_dup(str, len);
     
     if(!data)
     {
@@ -65,8 +74,6 @@ struct word_s *make_word(char *str)
         return NULL;
     }
     
-    /* copy string */
-    strcpy(data, str);
     word->data = data;
     word->len  = len;
     word->next = NULL;
@@ -76,6 +83,29 @@ struct word_s *make_word(char *str)
 }
 
 
+/*
+ * make a word from an rcstr (whose length is len), without copying it.. the
+ * caller's reference to the rcstr goes to the word.
+ *
+ * returns the word, or NULL if insufficient memory (in which case the
+ * reference is given back).
+ */
+struct word_s *make_word_ref(char *str, size_t len)
+{
+    struct word_s *word = malloc(sizeof(struct word_s));
+    if(!word)
+    {
+        rcstr_unref(str);
+        return NULL;
+    }
+
+    word->data = str;
+    word->len  = len;
+    word->next = NULL;
+    return word;
+}
+
+
 /*
  * free the memory used by a list of words.
  */
@@ -86,11 +116,8 @@ void free_all_words(struct word_s *first)
         struct word_s *del = first;
         first = first->next;
         
-	if(del->data)
-        {
-            /* free the word text */
-            free(del->data);
-        }
+	/* free the word text */
+        rcstr_unref(del->data);
         
 	/* free the word */
         free(del);
@@ -126,7 +153,8 @@ char *wordlist_to_str(struct word_s *word)
     w = word;
     while(w)
     {
-        sprintf(str2, "%s ", w->data);
+        memcpy(str2, w->data, w->len);
+        str2[w->len] = ' ';
         str2 += w->len+1;
         w     = w->next;
     }
@@ -175,6 +203,69 @@ int is_name(char *str)
 }
 
 
+/*
+ * check if the given str is a variable assignment word in the form name=value,
+ * or name[subscript]=value for array elements.
+ *
+ * returns the length of the name part (including the subscript, if any) if
+ * str is an assignment, 0 otherwise.
+ */
+size_t is_assignment(char *str)
+{
+    char *p = str;
+
+    /* names start with alpha char or an underscore... */
+    if(!isalpha(*p) && *p != '_')
+    {
+        return 0;
+    }
+    /* ...and contain alphanumeric chars and/or underscores */
+    while(isalnum(*p) || *p == '_')
+    {
+        p++;
+    }
+
+    /* skip the subscript */
+    if(*p == '[' && !(p = skip_subscript(p)))
+    {
+        return 0;
+    }
+
+    return (*p == '=') ? (size_t)(p-str) : 0;
+}
+
+
+/*
+ * skip the array subscript that starts at str (which points to the opening
+ * '[').
+ *
+ * returns a pointer to the char after the closing ']', or NULL if the
+ * subscript is not terminated.
+ */
+char *skip_subscript(char *str)
+{
+    int depth = 0;
+
+    do
+    {
+        if(*str == '[')
+        {
+            depth++;
+        }
+        else if(*str == ']')
+        {
+            depth--;
+        }
+        else if(*str == '\\' && str[1])
+        {
+            str++;
+        }
+    } while(*++str && depth);
+
+    return depth ? NULL : str;
+}
+
+
 /*
  * find the closing quote that matches the opening quote, which is the first
  * char of the data string.
@@ -301,32 +392,20 @@ size_t find_closing_brace(char *data)
  */
 char *substitute_str(char *s1, char *s2, size_t start, size_t end)
 {
-    /* get the prefix (the part before start) */
-    char before[start+1];
-    strncpy(before, s1, start);
-    before[start]   = '\0';
-    /* get the postfix (the part after end) */
-    size_t afterlen = strlen(s1)-end+1;
-    char after[afterlen];
-    strcpy(after, s1+end+1);
+    /* the lengths of the inserted string, and the part after end */
+    size_t len2     = strlen(s2);
+    size_t afterlen = strlen(s1+end+1);
     /* alloc memory for the new string */
-    size_t totallen = start+afterlen+strlen(s2);
-    char *final = malloc(totallen+1);
+    char *final = malloc(start+len2+afterlen+1);
     if(!final)
     {
         fprintf(stderr, "error: insufficient memory to perform variable substitution\n");
         return NULL;
     }
-    if(!totallen)       /* empty string */
-    {
-        final[0] = '\0';
-    }
-    else                /* concatenate the three parts into one string */
-    {
-        strcpy(final, before);
-        strcat(final, s2    );
-        strcat(final, after );
-    }
+    /* concatenate the three parts into one string */
+    memcpy(final, s1, start);
+    memcpy(final+start, s2, len2);
+    memcpy(final+start+len2, s1+end+1, afterlen+1);
     /* return the new string */
     return final;
 }
@@ -396,6 +475,33 @@ int substitute_word(char **pstart, char **p, size_t len,
     (*p) = (*pstart)+i+len-1;
     return 1;
 }
+
+
+/*
+ * replace the len chars at *p with str, which is already quoted and doesn't
+ * need any further processing.. str is freed, and *p is left pointing to the
+ * last char of the inserted string.
+ *
+ * returns 1 on success, 0 if insufficient memory (in which case *pstart is
+ * freed).
+ */
+int splice_expansion(char **pstart, char **p, size_t len, char *str)
+{
+    size_t i = (*p)-(*pstart);
+    char *s = substitute_str(*pstart, str, i, i+len-1);
+    size_t slen = strlen(str);
+
+    free(str);
+    free(*pstart);
+    if(!s)
+    {
+        *pstart = NULL;
+        return 0;
+    }
+    *pstart = s;
+    *p = s+i+slen-1;
+    return 1;
+}
                  
 
 /*
@@ -405,17 +511,22 @@ int substitute_word(char **pstart, char **p, size_t len,
  * in the tail pointer.
  */
 
-struct word_s *word_expand(char *orig_word)
+/*
+ * perform tilde expansion, parameter expansion, command substitution and
+ * arithmetic expansion on the given word, without field splitting, pathname
+ * expansion or quote removal (which is what we need for case patterns, for
+ * example).. if _expanded is not NULL, it is set to 1 if the result needs
+ * field splitting, or to -1 if the word gives no fields at all (an empty
+ * "${name[@]}").
+ *
+ * returns the malloc'd result, NULL on error.
+ */
+char *word_expand_raw(char *orig_word, int *_expanded)
 {
     if(!orig_word)
     {
         return NULL;
     }
-    
-    if(!*orig_word)
-    {
-        return make_word(orig_word);
-    }
 
     char *pstart = malloc(strlen(orig_word)+1);
     if(!pstart)
@@ -424,6 +535,11 @@ struct word_s *word_expand(char *orig_word)
     }
     strcpy(pstart, orig_word);
 
+    if(!*pstart)
+    {
+        return pstart;
+    }
+
     char *p = pstart, *p2;
     char *tmp;
     char   c;
@@ -433,6 +549,8 @@ struct word_s *word_expand(char *orig_word)
     int in_var_assign = 0;
     int var_assign_eq = 0;
     int expanded = 0;
+    int no_fields = 0;          /* did we remove an empty "${name[@]}"? */
+    size_t dq_start = 0;        /* where the current double quotes start */
     char *(*func)(char *);
 
     do
@@ -512,6 +630,7 @@ struct word_s *word_expand(char *orig_word)
             case '"':
                 /* toggle quote mode */
                 in_double_quotes = !in_double_quotes;
+                dq_start = p-pstart;
                 break;
                 
             case '=':
@@ -549,7 +668,10 @@ struct word_s *word_expand(char *orig_word)
                 
             case '\\':
                 /* skip backslash (we'll remove it later on) */
-                p++;
+                if(p[1])
+                {
+                    p++;
+                }
                 break;
                 
             case '\'':
@@ -593,7 +715,44 @@ struct word_s *word_expand(char *orig_word)
                             /* not found. bail out */
                             break;
                         }
-                        
+
+                        /*
+                         * "${name[@]}" gives one field per array element, and
+                         * "${@}" one field per positional parameter.
+                         */
+                        if(in_double_quotes)
+                        {
+                            size_t nitems;
+                            tmp = array_expand_quoted(p, len+2, &nitems);
+                            if(tmp)
+                            {
+                                /*
+                                 * with no elements, a "${name[@]}" that is quoted
+                                 * on its own is removed, quotes and all.. a word
+                                 * that is left with nothing gives no fields, just
+                                 * like "$@" with no positional parameters.
+                                 */
+                                if(!nitems && (size_t)(p-pstart) == dq_start+1 && p[len+2] == '"')
+                                {
+                                    p--;
+                                    if(!splice_expansion(&pstart, &p, len+4, tmp))
+                                    {
+                                        return NULL;
+                                    }
+                                    in_double_quotes = 0;
+                                    no_fields = 1;
+                                    expanded = 1;
+                                    break;
+                                }
+                                if(!splice_expansion(&pstart, &p, len+2, tmp))
+                                {
+                                    return NULL;
+                                }
+                                expanded = 1;
+                                break;
+                            }
+                        }
+
 			/*
                          *  calling var_expand() might return an INVALID_VAR result which
                          *  makes the following call fail.
@@ -636,6 +795,50 @@ struct word_s *word_expand(char *orig_word)
                         expanded = 1;
                         break;
                                                 
+                    /* "$@" gives one field per positional parameter */
+                    case '@':
+                        if(in_double_quotes)
+                        {
+                            if(!(tmp = pos_params_expand("@", 1)))
+                            {
+                                free(pstart);
+                                return NULL;
+                            }
+                            /* with no parameters, remove "$@" like "${name[@]}" above */
+                            if(!pos_params_count() && (size_t)(p-pstart) == dq_start+1 && p[2] == '"')
+                            {
+                                p--;
+                                if(!splice_expansion(&pstart, &p, 4, tmp))
+                                {
+                                    return NULL;
+                                }
+                                in_double_quotes = 0;
+                                no_fields = 1;
+                                expanded = 1;
+                                break;
+                            }
+                            if(!splice_expansion(&pstart, &p, 2, tmp))
+                            {
+                                return NULL;
+                            }
+                            expanded = 1;
+                            break;
+                        }
+                        /* fall through */
+
+                    /*
+                     * the exit status of the last command, the positional
+                     * parameters $0 to $9, and the special parameters $# and $*.
+                     */
+                    case '?':
+                    case '#':
+                    case '*':
+                    case '0': case '1': case '2': case '3': case '4':
+                    case '5': case '6': case '7': case '8': case '9':
+                        substitute_word(&pstart, &p, 2, var_expand, 0);
+                        expanded = 1;
+                        break;
+
                     default:
                         /* var names must start with an alphabetic char or _ */
                         if(!isalpha(p[1]) && p[1] != '_')
@@ -676,7 +879,104 @@ struct word_s *word_expand(char *orig_word)
                 break;
         }
     } while(*(++p));
+
+    if(_expanded)
+    {
+        *_expanded = (no_fields && !pstart[strspn(pstart, " \t\n")]) ? -1 : expanded;
+    }
+    return pstart;
+}
+
+
+/*
+ * check if the word is a double-quoted variable and nothing else ("$name" or
+ * "${name}"), which expands to the variable's value as-is.
+ *
+ * returns 1 if so (and sets *entry to the variable's entry, or NULL if it is
+ * not set), 0 otherwise.
+ */
+int is_quoted_var(char *word, struct symtab_entry_s **entry)
+{
+    if(word[0] != '"' || word[1] != '$')
+    {
+        return 0;
+    }
+
+    char *p = word+2, *name;
+    int brace = (*p == '{');
+    p += brace;
+    name = p;
+
+    if(!isalpha(*p) && *p != '_')
+    {
+        return 0;
+    }
+    while(isalnum(*p) || *p == '_')
+    {
+        p++;
+    }
+
+    size_t len = p-name;
+    if((brace && *p++ != '}') || p[0] != '"' || p[1])
+    {
+        return 0;
+    }
+
+    char var_name[len+1];
+    memcpy(var_name, name, len);
+    var_name[len] = '\0';
+    *entry = get_symtab_entry(var_name);
+    return 1;
+}
+
+
+/*
+ * perform word expansion on a word that has already gone through brace
+ * expansion (or doesn't need it, such as the value of a variable assignment).
+ *
+ * returns the head of the linked list of the expanded fields.
+ */
+struct word_s *word_expand_fields(char *orig_word)
+{
+    if(!orig_word)
+    {
+        return NULL;
+    }
     
+    if(!*orig_word)
+    {
+        return make_word(orig_word);
+    }
+
+    /*
+     * "$@" on its own is the common case, which we can make from the
+     * positional parameters directly, without joining and splitting them.
+     */
+    if(strcmp(orig_word, "\"$@\"") == 0 || strcmp(orig_word, "\"${@}\"") == 0)
+    {
+        return pos_params_words();
+    }
+
+    /*
+     * so is "$name", whose value we can share with the variable, instead of
+     * copying it into the word (which might be a long way to go, if the value
+     * is long).
+     */
+    struct symtab_entry_s *entry;
+    if(is_quoted_var(orig_word, &entry))
+    {
+        char *val = entry ? symtab_entry_getref(entry) : NULL;
+        return val ? make_word_ref(val, symtab_entry_getlen(entry)) : make_word("");
+    }
+
+    int   expanded = 0;
+    char *pstart = word_expand_raw(orig_word, &expanded);
+    if(!pstart || expanded < 0)
+    {
+        free(pstart);
+        return NULL;
+    }
+
     /* if we performed word expansion, do field splitting */
     struct word_s *words = NULL;
     if(expanded)
@@ -700,13 +1000,75 @@ struct word_s *word_expand(char *orig_word)
 
     /* perform pathname expansion and quote removal */
     words = pathnames_expand(words);
-    remove_quotes(words);
 
     /* return the expanded list */
     return words;
 }
 
 
+/*
+ * perform brace expansion on the word, followed by the rest of word expansion
+ * on each of the words it gives.. words that have nothing left to expand (as
+ * is the case with most words coming out of a range) are made directly.
+ *
+ * returns the head of the linked list of the expanded fields.
+ */
+struct word_s *word_expand(char *orig_word)
+{
+    size_t count, i;
+    char **strs;
+
+    if(!orig_word || !(strs = brace_expand(orig_word, &count)))
+    {
+        return word_expand_fields(orig_word);
+    }
+
+    struct word_s *head = NULL, *tail = NULL, *w;
+    for(i = 0; i < count; i++)
+    {
+        /* the strings are stored one after the other */
+        char  *str = strs[i];
+        size_t len = (i+1 < count) ? (size_t)(strs[i+1]-str-1) : strlen(str);
+
+        /* unquoted empty words are removed */
+        if(!len)
+        {
+            continue;
+        }
+
+        if(strpbrk(str, "$`'\"\\~*?["))
+        {
+            w = word_expand_fields(str);
+        }
+        else if(!(w = make_wordn(str, len)))
+        {
+            fprintf(stderr, "error: insufficient memory\n");
+        }
+
+        if(!w)
+        {
+            continue;
+        }
+
+        if(tail)
+        {
+            tail->next = w;
+        }
+        else
+        {
+            head = w;
+        }
+        for(tail = w; tail->next; tail = tail->next)
+        {
+            ;
+        }
+    }
+
+    free(strs);
+    return head;
+}
+
+
 /*
  * perform tilde expansion.
  *
@@ -723,9 +1085,9 @@ char *tilde_expand(char *s)
     if(len == 1)
     {
         entry = get_symtab_entry("HOME");
-        if(entry && entry->val)
+        if(entry && symtab_entry_getval(entry))
         {
-            home = entry->val;
+            home = symtab_entry_getval(entry);
         }
         else
         {
@@ -772,47 +1134,505 @@ char *tilde_expand(char *s)
 
 
 /*
- * perform variable (parameter) expansion.
- * our options are:
- * syntax           POSIX description   var defined     var undefined
- * ======           =================   ===========     =============
- * $var             Substitute          var             nothing
- * ${var}           Substitute          var             nothing
- * ${var:-thing}    Use Deflt Values    var             thing (var unchanged)
- * ${var:=thing}    Assgn Deflt Values  var             thing (var set to thing)
- * ${var:?message}  Error if NULL/Unset var             print message and exit shell,
- *                                                      (if message is empty, print
- *                                                      "var: parameter not set")
- * ${var:+thing}    Use Alt. Value      thing           nothing
- * ${#var}          Calculate String Length
- *
- * Using the same options in the table above, but without the colon, results in
- * a test for a parameter that is unset. using the colon results in a test for a
- * parameter that is unset or null.
- *
- * TODO: we should test our implementation of the following string processing
- *       functions (see section 2.6.2 - Parameter Expansion in POSIX):
- *
- *       ${parameter%[word]}      Remove Smallest Suffix Pattern
- *       ${parameter%%[word]}     Remove Largest Suffix Pattern
- *       ${parameter#[word]}      Remove Smallest Prefix Pattern
- *       ${parameter##[word]}     Remove Largest Prefix Pattern
+ * return the number of items a ${name[@]:offset:length} slice is taken from,
+ * which is one more than the highest subscript of an indexed array, and the
+ * number of elements of other arrays.
  */
+size_t array_slice_size(struct symtab_entry_s *entry)
+{
+    int type = entry ? entry->val_type : SYM_STR;
+    return (type == SYM_ARRAY) ? entry->array->size :
+           (type == SYM_ASSOC) ? entry->assoc->count :
+           (entry && symtab_entry_getval(entry)) ? 1 : 0;
+}
 
 
 /*
- * perform variable (parameter) expansion.
+ * join at most count elements (or subscripts, if keys is non-zero) of the
+ * given array with the sep string, starting with the element of the given
+ * subscript (or the next set one after it).. the elements of an associative
+ * array are counted in the order we keep them.. if quote is non-zero, each
+ * element is quoted as if it appeared inside double quotes.. a variable that
+ * is not an array is treated as an array with one element (of subscript 0)..
+ * if nitems is not NULL, it is set to the number of elements we've joined.
  *
- * returns an malloc'd string of the expanded variable value, or NULL if the
- * variable is not defined or the expansion failed.
- *
- * this function should not be called directly by any function outside of this
- * module (hence the double underscores that prefix the function name).
+ * returns the malloc'd result, or NULL on error.
  */
-char *var_expand(char *orig_var_name)
+char *array_join_range(struct symtab_entry_s *entry, int keys, char *sep, int quote,
+                       size_t start, size_t count, size_t *nitems)
 {
-    /* sanity check */
-    if(!orig_var_name)
+    size_t seplen = strlen(sep), len = 0, size = 0, pos = 0, index, n = 0;
+    size_t count0 = count;              /* to count the elements we join */
+    char   buf[32], *key, *val, *res = NULL, *res2;
+    int    type = entry ? entry->val_type : SYM_STR;
+
+    while(count)
+    {
+        if(type == SYM_ARRAY)
+        {
+            if(!array_next(entry->array, &pos, &index, &val))
+            {
+                break;
+            }
+            sprintf(buf, "%zu", index);
+            key = buf;
+        }
+        else if(type == SYM_ASSOC)
+        {
+            if(!assoc_next(entry->assoc, &pos, &key, &val))
+            {
+                break;
+            }
+        }
+        else
+        {
+            if(pos++ || !entry || !(val = symtab_entry_getval(entry)))
+            {
+                break;
+            }
+            key = "0";
+        }
+
+        /* skip the elements before the start of the range */
+        if(((type == SYM_ARRAY) ? index : n++) < start)
+        {
+            continue;
+        }
+        count--;
+
+        char *str = keys ? key : val;
+        char *qstr = quote ? quote_val(str, 0) : NULL;
+        if(qstr)
+        {
+            str = qstr;
+        }
+
+        size_t n = strlen(str);
+        if(len+seplen+n+1 > size)
+        {
+            size = (size ? size*2 : 64)+seplen+n;
+            if(!(res2 = realloc(res, size)))
+            {
+                free(qstr);
+                free(res);
+                return NULL;
+            }
+            res = res2;
+        }
+
+        if(len)
+        {
+            memcpy(res+len, sep, seplen);
+            len += seplen;
+        }
+        memcpy(res+len, str, n);
+        len += n;
+        free(qstr);
+    }
+
+    if(!res && !(res = malloc(1)))
+    {
+        return NULL;
+    }
+    res[len] = '\0';
+    if(nitems)
+    {
+        *nitems = count0-count;
+    }
+    return res;
+}
+
+
+/*
+ * join all the elements (or the subscripts) of the given array.
+ *
+ * returns the malloc'd result, or NULL on error.
+ */
+char *array_join(struct symtab_entry_s *entry, int keys, char *sep, int quote)
+{
+    return array_join_range(entry, keys, sep, quote, 0, (size_t)-1, NULL);
+}
+
+
+/*
+ * get the subscript of the given ${name[subscript]} word.
+ *
+ * returns a pointer to the subscript (with the closing ']' replaced by a NUL
+ * char), or NULL if the name has no subscript.
+ */
+char *get_var_subscript(char *name)
+{
+    char *subscript = strchr(name, '[');
+    if(!subscript)
+    {
+        return NULL;
+    }
+    *subscript++ = '\0';
+    subscript[strlen(subscript)-1] = '\0';
+    return subscript;
+}
+
+
+/*
+ * get the first char of $IFS, which separates the elements of ${name[*]}..
+ * that's a space if $IFS is not set, or NUL if it's empty.
+ */
+char get_IFS_sep(void)
+{
+    struct symtab_entry_s *entry = get_symtab_entry("IFS");
+    char *IFS = entry ? symtab_entry_getval(entry) : NULL;
+    return IFS ? IFS[0] : ' ';
+}
+
+
+/*
+ * expand "${name[@]}" (or "${!name[@]}") inside double quotes, which gives
+ * a separate field for each element (or subscript) of the array.. we close
+ * and reopen the double quotes between the elements, separating them with
+ * an $IFS char, and leave the rest to field splitting.. "${@}" does the same
+ * with the positional parameters, and "${@:offset:length}" and
+ * "${name[@]:offset:length}" with the elements in the range.. nitems is set
+ * to the number of fields (elements) we give.
+ *
+ * returns the malloc'd expansion, or NULL if the word (which is len chars
+ * long) is not in this form.
+ */
+char *array_expand_quoted(char *word, size_t len, size_t *nitems)
+{
+    size_t start = 0, count = (size_t)-1;
+
+    /* skip the ${ and the } */
+    char name[len];
+    strncpy(name, word+2, len-3);
+    name[len-3] = '\0';
+
+    char *p = name;
+    if(*p == '!')
+    {
+        p++;
+    }
+    else if(*p == '@' && (!p[1] || p[1] == ':'))
+    {
+        size_t total = pos_params_count()+1;     /* $0 counts in a slice */
+        if(!p[1])
+        {
+            *nitems = total-1;
+            return pos_params_expand("@", 1);
+        }
+        if(!substring_range(p+2, total, 0, &start, &count))
+        {
+            return NULL;
+        }
+        *nitems = (start >= total) ? 0 : (count < total-start) ? count : total-start;
+        return pos_params_slice("@", 1, start, count);
+    }
+
+    char *sub = strchr(p, '[');
+    if(!sub || strncmp(sub, "[@]", 3) != 0 || (sub[3] && sub[3] != ':'))
+    {
+        return NULL;
+    }
+    *sub = '\0';
+    if(!is_name(p))
+    {
+        return NULL;
+    }
+
+    struct symtab_entry_s *entry = get_symtab_entry(p);
+    if(sub[3] && !substring_range(sub+4, array_slice_size(entry), 0, &start, &count))
+    {
+        return NULL;
+    }
+
+    char c = get_IFS_sep();
+    char sep[4] = { '"', c ? c : ' ', '"', '\0' };
+    return array_join_range(entry, (*name == '!'), sep, 1, start, count, nitems);
+}
+
+
+/*
+ * find the first unquoted occurrence of c in str, skipping quoted parts and
+ * nested expansions.
+ *
+ * returns a pointer to c, or NULL if not found.
+ */
+char *find_unquoted_char(char *str, char c)
+{
+    size_t i;
+
+    while(*str)
+    {
+        if(*str == c)
+        {
+            return str;
+        }
+
+        switch(*str)
+        {
+            case '\\':
+                if(str[1])
+                {
+                    str++;
+                }
+                break;
+
+            case '\'':
+            case  '"':
+            case  '`':
+                if((i = find_closing_quote(str)))
+                {
+                    str += i;
+                }
+                break;
+
+            case '$':
+                if((str[1] == '{' || str[1] == '(') && (i = find_closing_brace(str+1)))
+                {
+                    str += i+1;
+                }
+                break;
+        }
+        str++;
+    }
+    return NULL;
+}
+
+
+/*
+ * find the range given by ${var:offset} or ${var:offset:length}, where expr
+ * is the part after the first colon, in something that is size items long
+ * (the chars of a value, or the elements of an array).. offset and length are
+ * arithmetic expressions.. a negative offset counts from the end, and a
+ * negative length (if neg_len is non-zero) gives the end of the range as an
+ * offset from the end.
+ *
+ * returns 1 and sets *start and *count on success, 0 on error.
+ */
+int substring_range(char *expr, size_t size, int neg_len, size_t *start, size_t *count)
+{
+    long   off, len = size;
+    char  *colon = find_unquoted_char(expr, ':');
+
+    if(colon)
+    {
+        *colon = '\0';
+    }
+
+    char *s = word_expand_single(expr);
+    int   ok = s && *s && arithm_eval(s, &off);
+    free(s);
+
+    if(ok && colon)
+    {
+        s  = word_expand_single(colon+1);
+        ok = s && *s && arithm_eval(s, &len);
+        free(s);
+    }
+
+    if(colon)
+    {
+        *colon = ':';
+    }
+
+    if(!ok)
+    {
+        fprintf(stderr, "error: invalid substring expression: %s\n", expr);
+        return 0;
+    }
+
+    if(off < 0)
+    {
+        off += size;
+    }
+    if(off < 0 || (size_t)off > size)
+    {
+        *start = size;
+        *count = 0;
+        return 1;
+    }
+
+    if(len < 0)
+    {
+        if(neg_len)
+        {
+            len += size-off;
+        }
+        if(len < 0)
+        {
+            fprintf(stderr, "error: %s: substring expression < 0\n", colon+1);
+            return 0;
+        }
+    }
+    if((size_t)len > size-off)
+    {
+        len = size-off;
+    }
+
+    *start = off;
+    *count = len;
+    return 1;
+}
+
+
+/*
+ * expand ${var:offset} and ${var:offset:length}, where expr is the part after
+ * the first colon (see substring_range()).
+ *
+ * returns the malloc'd substring, or NULL on error.
+ */
+char *substring_expand(char *val, char *expr)
+{
+    size_t start, len;
+
+    if(!substring_range(expr, strlen(val), 1, &start, &len))
+    {
+        return NULL;
+    }
+
+    char *res = malloc(len+1);
+    if(res)
+    {
+        memcpy(res, val+start, len);
+        res[len] = '\0';
+    }
+    return res;
+}
+
+
+/*
+ * expand the case conversion operators ${var^}, ${var^^}, ${var,} and
+ * ${var,,}, which convert the first char (or all the chars) of the value to
+ * upper or lower case, and the pattern replacement operators ${var/pat/rep},
+ * ${var//pat/rep}, ${var/#pat/rep} and ${var/%pat/rep}.. sub points to the
+ * operator.. the pattern is expanded in the same way as the patterns of [[ ]],
+ * and the replacement in the same way as the word of a case clause.
+ *
+ * returns the malloc'd result, or NULL on error.
+ */
+char *modify_expand(char *val, char *sub)
+{
+    char *pattern, *res;
+    char  op = *sub++;
+    int   mode = 0;
+
+    if(op == '^' || op == ',')
+    {
+        int all = (*sub == op);
+        if(all)
+        {
+            sub++;
+        }
+
+        struct glob_pat_s *pat = NULL;
+        if(*sub)
+        {
+            if(!(pattern = word_expand_pattern(sub, "*?[]\\")))
+            {
+                return NULL;
+            }
+            pat = get_glob_pat(pattern);
+            free(pattern);
+            if(!pat)
+            {
+                return NULL;
+            }
+        }
+
+        res = convert_case(val, op == '^', all, pat);
+        release_glob_pat(pat);
+        return res;
+    }
+
+    /* ${var//pat/rep}, ${var/#pat/rep} and ${var/%pat/rep} */
+    if(*sub == '/' || *sub == '#' || *sub == '%')
+    {
+        mode = *sub++;
+    }
+
+    char *slash = find_unquoted_char(sub, '/');
+    char *rep = "";
+    if(slash)
+    {
+        *slash = '\0';
+    }
+
+    /* an empty pattern doesn't match anything */
+    if(!*sub && mode != '#' && mode != '%')
+    {
+        if(slash)
+        {
+            *slash = '/';
+        }
+        return get_malloced_str(val);
+    }
+
+    pattern = word_expand_pattern(sub, "*?[]\\");
+    if(slash)
+    {
+        *slash = '/';
+        rep = word_expand_single(slash+1);
+    }
+
+    res = (pattern && rep) ? replace_match(pattern, val, rep, mode) : NULL;
+    free(pattern);
+    if(slash)
+    {
+        free(rep);
+    }
+    return res;
+}
+
+
+/*
+ * perform variable (parameter) expansion.
+ * our options are:
+ * syntax           POSIX description   var defined     var undefined
+ * ======           =================   ===========     =============
+ * $var             Substitute          var             nothing
+ * ${var}           Substitute          var             nothing
+ * ${var:-thing}    Use Deflt Values    var             thing (var unchanged)
+ * ${var:=thing}    Assgn Deflt Values  var             thing (var set to thing)
+ * ${var:?message}  Error if NULL/Unset var             print message and exit shell,
+ *                                                      (if message is empty, print
+ *                                                      "var: parameter not set")
+ * ${var:+thing}    Use Alt. Value      thing           nothing
+ * ${#var}          Calculate String Length
+ *
+ * we also have the following non-POSIX extensions:
+ *
+ *       ${var:off:len}  substring of len chars (or up to the end) from offset off
+ *       ${var^} ${var^^} convert the first char (or all chars) to upper case
+ *       ${var,} ${var,,} convert the first char (or all chars) to lower case
+ *       ${var/pat/rep}  replace the first match of pat with rep (// for all,
+ *                       /# for a match at the start, /% for one at the end)
+ *
+ * Using the same options in the table above, but without the colon, results in
+ * a test for a parameter that is unset. using the colon results in a test for a
+ * parameter that is unset or null.
+ *
+ * TODO: we should test our implementation of the following string processing
+ *       functions (see section 2.6.2 - Parameter Expansion in POSIX):
+ *
+ *       ${parameter%[word]}      Remove Smallest Suffix Pattern
+ *       ${parameter%%[word]}     Remove Largest Suffix Pattern
+ *       ${parameter#[word]}      Remove Smallest Prefix Pattern
+ *       ${parameter##[word]}     Remove Largest Prefix Pattern
+ */
+
+
+/*
+ * perform variable (parameter) expansion.
+ *
+ * returns an malloc'd string of the expanded variable value, or NULL if the
+ * variable is not defined or the expansion failed.
+ *
+ * this function should not be called directly by any function outside of this
+ * module (hence the double underscores that prefix the function name).
+ */
+char *var_expand(char *orig_var_name)
+{
+    /* sanity check */
+    if(!orig_var_name)
     {
        return NULL;
     }
@@ -837,61 +1657,207 @@ char *var_expand(char *orig_var_name)
        return NULL;
     }
 
-    int get_length = 0;
-    /* if varname starts with #, we need to get the string length */
-    if(*orig_var_name == '#')
+    int get_length = 0;
+    /* if varname starts with #, we need to get the string length (unless it is $#) */
+    if(*orig_var_name == '#' && orig_var_name[1])
+    {
+        /* use of '#' should come with omission of ':' */
+        if(strchr(orig_var_name, ':'))
+        {
+            fprintf(stderr, "error: invalid variable substitution: %s\n", orig_var_name);
+            return INVALID_VAR;
+        }
+        get_length = 1;
+        orig_var_name++;
+    }
+
+    int get_keys = 0;
+    /* ${!name[@]} gives the subscripts of the array */
+    if(*orig_var_name == '!')
+    {
+        get_keys = 1;
+        orig_var_name++;
+    }
+
+    /* check we don't have an empty varname */
+    if(!*orig_var_name)
+    {
+        return NULL;
+    }
+
+    /*
+     * search for a colon, which we use to separate the variable name from the
+     * value or substitution we are going to perform on the variable.
+     */
+    /* the special parameters $?, $#, $@ and $* have one-char names */
+    char *name_end = orig_var_name + !!strchr("?#@*", *orig_var_name);
+    while(isalnum(*name_end) || *name_end == '_')
+    {
+        name_end++;
+    }
+
+    /* skip the array subscript, if any */
+    if(*name_end == '[' && !(name_end = skip_subscript(name_end)))
+    {
+        fprintf(stderr, "error: invalid variable substitution: %s\n", orig_var_name);
+        return INVALID_VAR;
+    }
+
+    /* the substitution operator (if any) comes right after the name */
+    char *sub    = *name_end ? name_end : NULL;
+    char *substr = NULL;
+
+    /* get the length of the variable name (without the substitution part) */
+    len = sub ? (size_t)(sub-orig_var_name) : strlen(orig_var_name);
+
+    /* if we have a colon+substitution, skip the colon */
+    if(sub && *sub == ':')
+    {
+        sub++;
+        /* a colon that is not followed by one of -=?+ is ${var:offset:length} */
+        if(!*sub || !strchr("-=?+", *sub))
+        {
+            substr = sub;
+        }
+    }
+
+    /* copy the varname to a buffer */
+    char var_name[len+1];
+    strncpy(var_name, orig_var_name, len);
+    var_name[len]   = '\0';
+
+    /* ${name[@]} and ${name[*]} give all the elements of the array */
+    char *subscript = get_var_subscript(var_name);
+    int   all_elems = subscript && (strcmp(subscript, "@") == 0 || strcmp(subscript, "*") == 0);
+    if(get_keys && !all_elems)
+    {
+        fprintf(stderr, "error: invalid variable substitution: !%s\n", orig_var_name);
+        return INVALID_VAR;
+    }
+
+    /*
+     * commence variable substitution.
+     */
+    char *empty_val  = "";
+    char *tmp        = NULL;
+    char  setme      = 0;
+    char *tmpbuf     = NULL;    /* the joined elements, or the expanded subscript */
+    int   literal    = 0;       /* values are not expanded again, only words are */
+    char *entry_val  = NULL;    /* the variable's own value.. */
+    size_t tmplen    = 0;       /* ..and its length */
+    int   sliced     = 0;       /* tmp is already the ${name[@]:off:len} slice */
+    char *res        = NULL;
+
+    /* the positional parameters are not kept in the symbol table */
+    int   pos_param  = is_pos_param(var_name);
+    char  numbuf[32];
+
+    struct symtab_entry_s *entry = pos_param ? NULL : get_symtab_entry(var_name);
+    if(pos_param)
+    {
+        /* $# (and ${#@}, ${#*}) is the number of positional parameters */
+        if(*var_name == '#' || (get_length && (*var_name == '@' || *var_name == '*')))
+        {
+            sprintf(numbuf, "%zu", pos_params_count());
+            if(get_length)
+            {
+                return get_malloced_str(numbuf) ? : INVALID_VAR;
+            }
+            tmp = numbuf;
+        }
+        else if(*var_name == '@' || *var_name == '*')
+        {
+            /* ${@:offset:length} takes the parameters in the range */
+            size_t start = 1, count = pos_params_count();
+            if(substr && !substring_range(substr, count+1, 0, &start, &count))
+            {
+                return INVALID_VAR;
+            }
+            if(!(tmpbuf = pos_params_slice(var_name, 0, start, count)))
+            {
+                return INVALID_VAR;
+            }
+            tmp = tmpbuf;
+            sliced = !!substr;
+        }
+        else
+        {
+            tmp = get_pos_param(strtoul(var_name, NULL, 10));
+        }
+        literal = 1;
+    }
+    else if(all_elems)
+    {
+        /* ${#name[@]} is the number of elements */
+        if(get_length)
+        {
+            size_t count = !entry ? 0 :
+                           (entry->val_type == SYM_ARRAY) ? entry->array->count :
+                           (entry->val_type == SYM_ASSOC) ? entry->assoc->count :
+                           !!symtab_entry_getval(entry);
+            char buf[32];
+            sprintf(buf, "%zu", count);
+            return get_malloced_str(buf) ? : INVALID_VAR;
+        }
+
+        /* ${name[@]:offset:length} takes the elements in the range */
+        size_t start = 0, count = (size_t)-1;
+        if(substr && !substring_range(substr, array_slice_size(entry), 0, &start, &count))
+        {
+            return INVALID_VAR;
+        }
+
+        char sep[2] = { (*subscript == '*') ? get_IFS_sep() : ' ', '\0' };
+        if(!(tmpbuf = array_join_range(entry, get_keys, sep, 0, start, count, NULL)))
+        {
+            return INVALID_VAR;
+        }
+        tmp = tmpbuf;
+        sliced = !!substr;
+        literal = 1;
+    }
+    else if(subscript)
     {
-        /* use of '#' should come with omission of ':' */
-        if(strchr(orig_var_name, ':'))
+        if(!(tmpbuf = word_expand_single(subscript)))
         {
-            fprintf(stderr, "error: invalid variable substitution: %s\n", orig_var_name);
             return INVALID_VAR;
         }
-        get_length = 1;
-        orig_var_name++;
+        tmp = entry ? symtab_entry_getelem(entry, tmpbuf) : NULL;
+        literal = 1;
     }
-
-    /* check we don't have an empty varname */
-    if(!*orig_var_name)
+    else
     {
-        return NULL;
+        tmp = entry ? symtab_entry_getval(entry) : NULL;
+        tmplen = tmp ? symtab_entry_getlen(entry) : 0;
+        entry_val = tmp;
+        literal = 1;
     }
+    tmp = (tmp && tmp[0]) ? tmp : empty_val;
 
-    /*
-     * search for a colon, which we use to separate the variable name from the
-     * value or substitution we are going to perform on the variable.
-     */
-    char *sub   = strchr(orig_var_name, ':');
-    if(!sub)    /* we have a substitution without a colon */
+    /* the substring, case conversion and pattern replacement operators */
+    if(sliced)
     {
-        /* search for the char that indicates what type of substitution we need to do */
-        sub = strchr_any(orig_var_name, "-=?+%#");
+        res = get_malloced_str(tmp) ? : INVALID_VAR;
+        goto end;
     }
 
-    /* get the length of the variable name (without the substitution part) */
-    len = sub ? (size_t)(sub-orig_var_name) : strlen(orig_var_name);
-
-    /* if we have a colon+substitution, skip the colon */
-    if(sub && *sub == ':')
+    if(substr || (sub && strchr("/^,", *sub)))
     {
-        sub++;
+        char *val = literal ? get_malloced_str(tmp) : word_expand_to_str(tmp);
+        if(!val)
+        {
+            res = INVALID_VAR;
+            goto end;
+        }
+        res = substr ? substring_expand(val, substr) : modify_expand(val, sub);
+        free(val);
+        if(!res)
+        {
+            res = INVALID_VAR;
+        }
+        goto end;
     }
 
-    /* copy the varname to a buffer */
-    char var_name[len+1];
-    strncpy(var_name, orig_var_name, len);
-    var_name[len]   = '\0';
-
-    /*
-     * commence variable substitution.
-     */
-    char *empty_val  = "";
-    char *tmp        = NULL;
-    char  setme      = 0;
-
-    struct symtab_entry_s *entry = get_symtab_entry(var_name);
-    tmp = (entry && entry->val && entry->val[0]) ? entry->val : empty_val;
-
     /*
      * first case: variable is unset or empty.
      */
@@ -905,14 +1871,19 @@ char *var_expand(char *orig_var_name)
             {
                 case '-':          /* use default value */
                     tmp = sub+1;
+                    literal = 0;
                     break;
 
                 case '=':          /* assign the variable a value */
-                    /*
-                     * NOTE: only variables, not positional or special parameters can be
-                     *       assigned this way (we'll fix this later).
-                     */
+                    /* only variables, not positional or special parameters can be assigned this way */
+                    if(pos_param)
+                    {
+                        fprintf(stderr, "error: $%s: cannot assign in this way\n", var_name);
+                        res = INVALID_VAR;
+                        goto end;
+                    }
                     tmp = sub+1;
+                    literal = 0;
                     /*
                      * assign the EXPANSION OF tmp, not tmp
                      * itself, to var_name (we'll set the value below).
@@ -929,11 +1900,13 @@ char *var_expand(char *orig_var_name)
                     {
                         fprintf(stderr, "error: %s: %s\n", var_name, sub+1);
                     }
-                    return INVALID_VAR;
+                    res = INVALID_VAR;
+                    goto end;
 
                 /* use alternative value (we don't have alt. value here) */
                 case '+':
-                    return NULL;
+                    res = NULL;
+                    goto end;
 
                 /*
                  * pattern matching notation. can't match anything
@@ -944,7 +1917,8 @@ char *var_expand(char *orig_var_name)
                     break;
 
                 default:                /* unknown operator */
-                    return INVALID_VAR;
+                    res = INVALID_VAR;
+                    goto end;
             }
         }
         /* no substitution clause. return NULL as the variable is unset/null */
@@ -972,6 +1946,7 @@ char *var_expand(char *orig_var_name)
                 /* use alternative value */
                 case '+':
                     tmp = sub+1;
+                    literal = 0;
                     break;
 
                 /*
@@ -982,11 +1957,12 @@ char *var_expand(char *orig_var_name)
                 case '%':       /* match suffix */
                     sub++;
                     /* perform word expansion on the value */
-                    char *p = word_expand_to_str(tmp);
+                    char *p = literal ? get_malloced_str(tmp) : word_expand_to_str(tmp);
                     /* word expansion failed */
                     if(!p)
                     {
-                        return INVALID_VAR;
+                        res = INVALID_VAR;
+                        goto end;
                     }
                     int longest = 0;
                     /* match the longest or shortest suffix */
@@ -994,29 +1970,20 @@ char *var_expand(char *orig_var_name)
                     {
                         longest = 1, sub++;
                     }
-                    /* perform the match */
-                    if((len = match_suffix(sub, p, longest)) == 0)
-                    {
-                        return p;
-                    }
-                    /* return the match */
-                    char *p2 = malloc(len+1);
-                    if(p2)
-                    {
-                        strncpy(p2, p, len);
-                        p2[len] = '\0';
-                    }
-                    free(p);
-                    return p2;
+                    /* perform the match and cut the suffix off */
+                    p[match_suffix(sub, p, longest)] = '\0';
+                    res = p;
+                    goto end;
 
                 case '#':       /* match prefix */
                     sub++;
                     /* perform word expansion on the value */
-                    p = word_expand_to_str(tmp);
+                    p = literal ? get_malloced_str(tmp) : word_expand_to_str(tmp);
                     /* word expansion failed */
                     if(!p)
                     {
-                        return INVALID_VAR;
+                        res = INVALID_VAR;
+                        goto end;
                     }
                     longest = 0;
                     /* match the longest or shortest suffix */
@@ -1024,32 +1991,28 @@ char *var_expand(char *orig_var_name)
                     {
                         longest = 1, sub++;
                     }
-                    /* perform the match */
-                    if((len = match_prefix(sub, p, longest)) == 0)
+                    /* perform the match and cut the prefix off */
+                    if((len = match_prefix(sub, p, longest)))
                     {
-                        return p;
+                        memmove(p, p+len, strlen(p+len)+1);
                     }
-                    /* return the match */
-                    p2 = malloc(strlen(p)-len+1);
-                    if(p2)
-                    {
-                        strcpy(p2, p+len);
-                    }
-                    free(p);
-                    return p2;
+                    res = p;
+                    goto end;
 
                 default:                /* unknown operator */
-                    return INVALID_VAR;
+                    res = INVALID_VAR;
+                    goto end;
             }
         }
         /* no substitution clause. return the variable's original value */
     }
 
     /*
-     * we have substituted the variable's value. now go POSIX style on it.
+     * we have substituted the variable's value, which we use as-is. if we've got
+     * the word after the operator instead, go POSIX style on it.
      */
     int expanded = 0;
-    if(tmp)
+    if(tmp && !literal)
     {
         if((tmp = word_expand_to_str(tmp)))
         {
@@ -1068,36 +2031,34 @@ char *var_expand(char *orig_var_name)
         /* and set its value */
         if(entry)
         {
-            symtab_entry_setval(entry, tmp);
+            if(subscript)
+            {
+                symtab_entry_setelem(entry, tmpbuf, tmp);
+            }
+            else
+            {
+                symtab_entry_assign(entry, tmp);
+            }
         }
     }
 
     char buf[32];
     char *p = NULL;
+    /* we know the length of the variable's own value, unless we've changed tmp */
+    size_t n = !tmp ? 0 : (tmp == entry_val) ? tmplen : strlen(tmp);
     if(get_length)
     {
-        if(!tmp)
-        {
-            sprintf(buf, "0");
-        }
-        else
-        {
-            sprintf(buf, "%lu", strlen(tmp));
-        }
+        sprintf(buf, "%zu", n);
         /* get a copy of the buffer */
-        p = malloc(strlen(buf)+1);
-        if(p)
-        {
-            strcpy(p, buf);
-        }
+        p = get_malloced_str(buf);
     }
     else
     {
         /* "normal" variable value */
-        p = malloc(strlen(tmp)+1);
+        p = malloc(n+1);
         if(p)
         {
-            strcpy(p, tmp);
+            memcpy(p, tmp, n+1);
         }
     }
 
@@ -1107,8 +2068,15 @@ char *var_expand(char *orig_var_name)
         free(tmp);
     }
 
+    res = p ? : INVALID_VAR;
+
+end:
+    if(tmpbuf)
+    {
+        free(tmpbuf);
+    }
     /* return the result */
-    return p ? : INVALID_VAR;
+    return res;
 }
 
 
@@ -1181,6 +2149,8 @@ char *command_substitute(char *orig_cmd)
         }
     }
 
+    /* don't let the child inherit (and flush) our buffered output */
+    flush_output();
     FILE *fp = popen(cmd2, "r");
 
     /* check if we have opened the pipe */
@@ -1332,14 +2302,15 @@ void skip_IFS_delim(char *str, char *IFS_space, char *IFS_delim, size_t *_i, siz
 
 
 /*
- * convert the words resulting from a word expansion into separate fields.
+ * get the whitespace and the other delimiter chars in $IFS separately.. the
+ * buffers must be at least 64 bytes long.
  *
- * returns a pointer to the first field, NULL if no field splitting was done.
+ * returns 0 if $IFS is empty (i.e. no field splitting), 1 otherwise.
  */
-struct word_s *field_split(char *str)
+int get_IFS_chars(char *IFS_space, char *IFS_delim)
 {
     struct symtab_entry_s *entry = get_symtab_entry("IFS");
-    char *IFS = entry ? entry->val : NULL;
+    char *IFS = entry ? symtab_entry_getval(entry) : NULL;
     char *p;
     
     /* POSIX says no IFS means: "space/tab/NL" */
@@ -1351,13 +2322,9 @@ struct word_s *field_split(char *str)
     /* POSIX says empty IFS means no field splitting */
     if(IFS[0] == '\0')
     {
-        return NULL;
+        return 0;
     }
     
-    /* get the IFS spaces and delimiters separately */
-    char IFS_space[64];
-    char IFS_delim[64];
-    
     if(strcmp(IFS, " \t\n") == 0)   /* "standard" IFS */
     {
         IFS_space[0] = ' ' ;
@@ -1387,14 +2354,35 @@ struct word_s *field_split(char *str)
     	*sp = '\0';
         *dp = '\0';
     }
+    return 1;
+}
+
+
+/*
+ * convert the words resulting from a word expansion into separate fields.
+ *
+ * returns a pointer to the first field, NULL if no field splitting was done.
+ */
+struct word_s *field_split(char *str)
+{
+    char IFS_space[64];
+    char IFS_delim[64];
+    char *p;
+
+    /* POSIX says empty IFS means no field splitting */
+    if(!get_IFS_chars(IFS_space, IFS_delim))
+    {
+        return NULL;
+    }
 
-    size_t len    = strlen(str);
+    size_t len;
     size_t i      = 0, j = 0, k;
     int    fields = 1;
     char   quote  = 0;
     
     /* skip any leading whitespaces in the string */
     skip_IFS_whitespace(&str, IFS_space);
+    len = strlen(str);
     
     /* estimate the needed number of fields */
     do
@@ -1508,7 +2496,7 @@ struct word_s *field_split(char *str)
                    is_IFS_char(str[i], IFS_delim) || (i == len))
                 {
                     /* copy the field text */
-                    char *tmp = malloc(i-j+1);
+                    char *tmp = rcstr_dup(str+j, i-j);
     
     		    if(!tmp)
                     {
@@ -1516,15 +2504,12 @@ struct word_s *field_split(char *str)
                         return first_field;
                     }
     
-    		    strncpy(tmp, str+j, i-j);
-                    tmp[i-j] = '\0';
-    
     		    /* create a new struct for the field */
                     struct word_s *fld = malloc(sizeof(struct word_s));
     
     		    if(!fld)
                     {
-                        free(tmp);
+                        rcstr_unref(tmp);
                         return first_field;
                     }
     
@@ -1567,7 +2552,9 @@ struct word_s *field_split(char *str)
 
 
 /*
- * perform pathname expansion.
+ * perform pathname expansion, followed by quote removal on the words we don't
+ * replace with pathnames.. the pathnames we find are left as they are, as the
+ * quote chars and backslashes in them are part of the names.
  */
 struct word_s *pathnames_expand(struct word_s *words)
 {
@@ -1579,35 +2566,29 @@ struct word_s *pathnames_expand(struct word_s *words)
         char *p = w->data;
     
     	/* check if we should perform filename globbing */
-        if(!has_glob_chars(p, strlen(p)))
+        if(!has_glob_chars(p, w->len))
         {
+            remove_word_quotes(w);
             pw = w;
             w = w->next;
             continue;
         }
     
-    	glob_t glob;
-        char **matches = get_filename_matches(p, &glob);
+    	int count;
+        char **matches = get_filename_matches(p, &count);
     
     	/* no matches found */
-        if(!matches || !matches[0])
+        if(!matches)
         {
-            globfree(&glob);
+            remove_word_quotes(w);
         }
         else
         {
             /* save the matches */
             struct word_s *head = NULL, *tail = NULL;
     
-    	    for(size_t j = 0; j < glob.gl_pathc; j++)
+    	    for(int j = 0; j < count; j++)
             {
-                /* skip '..' and '.' */
-                if(matches[j][0] == '.' &&
-                  (matches[j][1] == '.' || matches[j][1] == '\0' || matches[j][1] == '/'))
-                {
-                    continue;
-                }
-    
     		/* add the path to the list */
                 if(!head)
                 {
@@ -1646,7 +2627,7 @@ struct word_s *pathnames_expand(struct word_s *words)
             w = tail;
     
     	    /* free the matches list */
-            globfree(&glob);
+            free_buffer(count, matches);
             /* finished globbing this word */
         }
     
@@ -1659,111 +2640,242 @@ struct word_s *pathnames_expand(struct word_s *words)
 
 
 /*
- * perform quote removal.
+ * perform quote removal on the given word.. we copy the word onto itself,
+ * skipping the quote chars, so that the whole word is processed in one pass.
  */
-void remove_quotes(struct word_s *wordlist)
+void remove_word_quotes(struct word_s *word)
 {
-    if(!wordlist)
+    int in_double_quotes = 0;
+
+    /* p is where we read the word, q is where we write it back */
+    char *p = word->data, *q = word->data;
+    while(*p)
     {
-        return;
+        switch(*p)
+        {
+            case '"':
+                /* toggle quote mode */
+                in_double_quotes = !in_double_quotes;
+                p++;
+                break;
+
+            case '\'':
+                /* don't delete if inside double quotes */
+                if(in_double_quotes)
+                {
+                    *q++ = *p++;
+                    break;
+                }
+
+                /* copy up to the closing quote, and remove it */
+                p++;
+                while(*p && *p != '\'')
+                {
+                    *q++ = *p++;
+                }
+                if(*p == '\'')
+                {
+                    p++;
+                }
+                break;
+
+            case '`':
+                p++;
+                break;
+
+            case '\\':
+                /*
+                 * in double quotes, backslash preserves its special quoting
+                 * meaning only when followed by one of the following chars.
+                 */
+                if(in_double_quotes && (!p[1] || !strchr("$`\"\\\n", p[1])))
+                {
+                    *q++ = *p++;
+                    break;
+                }
+
+                /* remove the backslash, and keep the char it quotes */
+                p++;
+                if(*p)
+                {
+                    *q++ = *p++;
+                }
+                break;
+
+            default:
+                *q++ = *p++;
+                break;
+        }
     }
 
-    int in_double_quotes = 0;
+    /* update the word's length */
+    *q = '\0';
+    word->len = q-word->data;
+}
+
+
+/*
+ * perform quote removal on the words in the list.
+ */
+void remove_quotes(struct word_s *wordlist)
+{
     struct word_s *word = wordlist;
-    char *p;
-    
     while(word)
     {
-        p = word->data;
-        while(*p)
+        remove_word_quotes(word);
+        word = word->next;
+    }
+}
+
+
+/*
+ * expand a word that doesn't undergo field splitting or pathname expansion,
+ * such as the word of a case clause.
+ *
+ * returns the malloc'd expansion, NULL on error.
+ */
+char *word_expand_single(char *word)
+{
+    char *p = word_expand_raw(word, NULL);
+    if(!p)
+    {
+        return NULL;
+    }
+
+    struct word_s w = { .data = p, .len = 0, .next = NULL };
+    remove_quotes(&w);
+    return p;
+}
+
+
+/*
+ * add the first n chars of s to the end of the malloc'd buffer *buf, escaping
+ * the chars in specials (if not NULL) with backslashes.
+ *
+ * returns 1 on success, 0 if insufficient memory.
+ */
+int append_escaped(char **buf, size_t *len, size_t *size, char *s, size_t n, char *specials)
+{
+    if(*len+2*n+1 > *size)
+    {
+        size_t newsize = 2*(*len+2*n+1);
+        char *newbuf = realloc(*buf, newsize);
+        if(!newbuf)
         {
-            switch(*p)
-            {
-                case '"':
-                    /* toggle quote mode */
-                    in_double_quotes = !in_double_quotes;
-                    delete_char_at(p, 0);
-                    break;
+            return 0;
+        }
+        *buf  = newbuf;
+        *size = newsize;
+    }
 
-                case '\'':
-                    /* don't delete if inside double quotes */
-                    if(in_double_quotes)
-                    {
-                        p++;
-                        break;
-                    }
+    while(n--)
+    {
+        if(specials && strchr(specials, *s))
+        {
+            (*buf)[(*len)++] = '\\';
+        }
+        (*buf)[(*len)++] = *s++;
+    }
+    (*buf)[*len] = '\0';
+    return 1;
+}
 
-                    delete_char_at(p, 0);
-                
-		    /* find the closing quote */
-                    while(*p && *p != '\'')
-                    {
-                        p++;
-                    }
-                
-		    /* and remove it */
-                    if(*p == '\'')
-                    {
-                        delete_char_at(p, 0);
-                    }
-                    break;
 
-                case '`':
-                    delete_char_at(p, 0);
-                    break;
+/*
+ * expand a word that is used as a pattern, such as the right operand of the ==
+ * and =~ operators in [[ ]].. the results of unquoted expansions are active
+ * pattern chars, while the quoted parts of the word (including the results of
+ * quoted expansions) are matched literally, that is, the chars in specials are
+ * escaped there with backslashes.
+ *
+ * returns the malloc'd pattern, or NULL on error.
+ */
+char *word_expand_pattern(char *word, char *specials)
+{
+    size_t len = 0, size = 0, i;
+    char  *res = NULL, *p = word;
 
-                case '\v':
-                case '\f':
-                case '\t':
-                case '\r':
-                case '\n':
-                    p++;
-                    break;
+    if(!append_escaped(&res, &len, &size, "", 0, NULL))
+    {
+        return NULL;
+    }
 
-                case '\\':
-                    if(in_double_quotes)
-                    {
-                        switch(p[1])
-                        {
-                            /*
-                             * in double quotes, backslash preserves its special quoting
-                             * meaning only when followed by one of the following chars.
-                             */
-                            case  '$':
-                            case  '`':
-                            case  '"':
-                            case '\\':
-                            case '\n':
-                                delete_char_at(p, 0);
-                                p++;
-                                break;
+    while(*p)
+    {
+        int quoted = 1;
+        i = 0;
+        switch(*p)
+        {
+            case '\'':
+            case  '"':
+                i = find_closing_quote(p);
+                break;
 
-                            default:
-                                p++;
-                                break;
-                        }
+            case '`':
+                i = find_closing_quote(p);
+                quoted = 0;
+                break;
+
+            case '\\':
+                i = p[1] ? 1 : 0;
+                break;
+
+            case '$':
+                quoted = 0;
+                if(p[1] == '{' || p[1] == '(')
+                {
+                    if((i = find_closing_brace(p+1)))
+                    {
+                        i++;
                     }
-                    else
+                }
+                else if(isalpha(p[1]) || p[1] == '_')
+                {
+                    while(isalnum(p[i+1]) || p[i+1] == '_')
                     {
-                        /* parse single-character backslash quoting. */
-                        delete_char_at(p, 0);
-                        p++;
+                        i++;
                     }
-                    break;
+                }
+                else if(p[1] && strchr("0123456789*@#!?$-", p[1]))
+                {
+                    i = 1;
+                }
+                break;
+        }
 
-                default:
-                    p++;
-                    break;
+        /* an ordinary char, or a quote or brace with no match */
+        if(!i)
+        {
+            if(!append_escaped(&res, &len, &size, p++, 1, NULL))
+            {
+                free(res);
+                return NULL;
             }
+            continue;
         }
 
-        /* update the word's length */
-        word->len = strlen(word->data);
+        /* expand this part of the word on its own */
+        char part[i+2];
+        memcpy(part, p, i+1);
+        part[i+1] = '\0';
+        p += i+1;
 
-
-        /* move on to the next word */
-        word = word->next;
+        char *val = word_expand_single(part);
+        if(!val)
+        {
+            free(res);
+            return NULL;
+        }
+        i = append_escaped(&res, &len, &size, val, strlen(val), quoted ? specials : NULL);
+        free(val);
+        if(!i)
+        {
+            free(res);
+            return NULL;
+        }
     }
+
+    return res;
 }
 
 
@@ -1773,7 +2885,7 @@ void remove_quotes(struct word_s *wordlist)
  */
 char *word_expand_to_str(char *word)
 {
-    struct word_s *w = word_expand(word);
+    struct word_s *w = word_expand_fields(word);
 
     if(!w)
     {